@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace veekay {
+
+constexpr size_t default_arena_block_size = 256 * 1024;
+
+// NOTE: Monotonic allocator for short-lived data, use it through std::pmr
+//       containers. Allocation bumps an offset, deallocation does nothing,
+//       reset releases everything at once. Not thread-safe
+class Arena : public std::pmr::memory_resource {
+public:
+	explicit Arena(size_t block_size = default_arena_block_size);
+	~Arena() override;
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// NOTE: Memory is kept for reuse, once an arena has grown to its working set
+	//       allocations stop reaching the heap. Arenas that had to spill into
+	//       several blocks are merged into one block big enough for all of them
+	void reset();
+
+	// NOTE: Bytes handed out since the last reset
+	size_t used() const;
+	// NOTE: Bytes of blocks the arena owns
+	size_t capacity() const;
+
+private:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	struct Block {
+		std::byte* data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t block_size;
+	// NOTE: Block allocations come from and the offset into it
+	size_t current;
+	size_t offset;
+	size_t used_bytes;
+};
+
+// NOTE: Arena of the main thread, reset at every frame boundary. Whatever is
+//       allocated from it must not be kept past the frame. Call from main thread
+Arena& frameArena();
+
+// NOTE: Arena of the calling thread. On main thread it is frameArena, job workers
+//       reset theirs after every job. Other threads never have theirs reset
+//       for them, they must call reset on their own
+Arena& threadArena();
+
+// NOTE: operator new calls made by the whole process so far. Counted only in
+//       builds with VEEKAY_COUNT_ALLOCATIONS, which replaces global operator new,
+//       always zero otherwise. Allocations through malloc, e.g. by ImGui or
+//       drivers, are not seen
+uint64_t heapAllocationCount();
+
+// NOTE: Same as heapAllocationCount, but over the previous frame only. Meant for
+//       checking that a steady-state frame loop does not touch the heap.
+//       Call from main thread
+uint64_t frameHeapAllocations();
+
+} // namespace veekay
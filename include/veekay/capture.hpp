@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace veekay {
+
+enum class ImageFormat : uint32_t {
+	// NOTE: RGBA8 pixels without any header
+	raw,
+	ppm,
+	png,
+};
+
+// NOTE: Tightly packed RGBA8 pixels, rows go top to bottom
+typedef std::function<void(const uint8_t* pixels, uint32_t width, uint32_t height)> CaptureFunc;
+
+// NOTE: Copy the next rendered frame (scene and UI) into a staging buffer.
+//       func is called on the main thread a few frames later, once GPU has
+//       finished the copy. Rendering never waits for it. pixels are only valid
+//       during the call. Call from main thread
+void captureFrame(CaptureFunc func);
+
+// NOTE: Capture the next rendered frame and write it to path on a background thread
+void captureFrame(const char* path, ImageFormat format);
+
+// NOTE: Capture every rendered frame until stopRecording, e.g. for video export.
+//       path_pattern takes the frame index printf-style, e.g. "frame_%05u.ppm".
+//       Frames are dropped rather than stalling when all staging buffers are busy,
+//       a buffer stays busy until the background thread has written it out
+void startRecording(const char* path_pattern, ImageFormat format);
+void stopRecording();
+
+// NOTE: Write RGBA8 pixels right away on the calling thread
+bool writeImage(const char* path, ImageFormat format,
+                const uint8_t* pixels, uint32_t width, uint32_t height);
+
+// NOTE: Read a binary PPM file into RGBA8 pixels with opaque alpha
+bool readImage(const char* path, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height);
+
+struct ImageDifference {
+	// NOTE: Largest difference of a single channel, 0-255
+	uint32_t max_error;
+	// NOTE: Average difference per channel over the whole image
+	double mean_error;
+	// NOTE: Pixels where some channel differs by more than tolerance
+	uint64_t differing_pixels;
+};
+
+// NOTE: Compare two RGBA8 images of the same size, e.g. a capture against a golden image
+ImageDifference compareImages(const uint8_t* a, const uint8_t* b,
+                              uint32_t width, uint32_t height, uint32_t tolerance);
+
+} // namespace veekay
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Object names and command buffer regions for RenderDoc, Nsight and
+//       validation messages. Defined in every build configuration except
+//       Release and MinSizeRel, there they compile to nothing. They also do
+//       nothing at runtime when VK_EXT_debug_utils is not available.
+//       Pass handles cast to uint64_t, e.g. (uint64_t)pipeline
+
+#ifdef VEEKAY_DEBUG_LABELS
+
+void setObjectName(VkObjectType type, uint64_t handle, const char* name);
+
+// NOTE: Regions nest, every beginLabel needs a matching endLabel in the same command buffer
+void beginLabel(VkCommandBuffer cmd, const char* name);
+void endLabel(VkCommandBuffer cmd);
+
+#else
+
+inline void setObjectName(VkObjectType, uint64_t, const char*) {}
+inline void beginLabel(VkCommandBuffer, const char*) {}
+inline void endLabel(VkCommandBuffer) {}
+
+#endif
+
+} // namespace veekay
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Max depth pyramid (Hi-Z) built from the previous frame's depth buffer when
+//       ApplicationInfo::depth_pyramid is set. Level 0 is depth reduced to the previous
+//       power of two in each dimension, every next level halves it. A texel holds the
+//       farthest depth of the screen area it covers, so anything whose nearest depth
+//       is farther than that was hidden last frame. Before the first frame every texel
+//       is 1 and nothing is hidden
+struct DepthPyramid {
+	// NOTE: Whole mip chain, R32_SFLOAT. Sample it from render, outside of the
+	//       render pass, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	VkImageView view;
+	// NOTE: Nearest filtering, clamps to edge
+	VkSampler sampler;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+};
+
+// NOTE: Handles are null when the pyramid is not built
+const DepthPyramid& depthPyramid();
+
+} // namespace veekay
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Everything one draw needs. Null descriptor_set, vertex_buffer or
+//       index_buffer leave that state alone, indices are uint32. Non-null
+//       indirect_buffer draws one VkDrawIndexedIndirectCommand from it instead
+//       of index_count indices, non-zero vertex_count draws that many vertices
+//       without indices, e.g. for geometry generated in the vertex shader
+struct DrawPacket {
+	VkPipeline pipeline;
+	VkPipelineLayout layout;
+	// NOTE: Bound at set 0
+	VkDescriptorSet descriptor_set;
+
+	VkBuffer vertex_buffer;
+	VkDeviceSize vertex_offset;
+	VkBuffer index_buffer;
+	VkDeviceSize index_offset;
+
+	uint32_t index_count;
+	uint32_t vertex_count;
+	VkBuffer indirect_buffer;
+	VkDeviceSize indirect_offset;
+
+	// NOTE: Copied on submit, pushed at offset zero right before the draw
+	const void* push_constants;
+	uint32_t push_constants_size;
+	VkShaderStageFlags push_constant_stages;
+
+	// NOTE: Normalized depth in [0, 1], draws sharing state go front to back
+	float depth;
+};
+
+struct DrawQueueStats {
+	uint32_t draws;
+	// NOTE: Binds a loop binding everything for every draw would record
+	uint32_t submitted_binds;
+	// NOTE: Binds left after dropping the ones that change nothing
+	uint32_t recorded_binds;
+	uint32_t pipeline_binds;
+	uint32_t descriptor_binds;
+	uint32_t vertex_binds;
+	uint32_t index_binds;
+};
+
+// NOTE: Collects draws of a frame and records them ordered by a 64-bit key of
+//       pipeline, descriptor set, mesh and depth, so draws sharing state end up
+//       next to each other and their binds are recorded once. Ordering of draws
+//       is not preserved, use separate queues where it matters
+class DrawQueue {
+public:
+	void submit(const DrawPacket& packet);
+
+	// NOTE: Sort and record everything submitted since the last flush inside
+	//       the current render pass, then start over
+	void flush(VkCommandBuffer cmd);
+
+	// NOTE: Counters of the last flush
+	const DrawQueueStats& stats() const { return last_stats; }
+
+private:
+	struct SortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	uint32_t stateId(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t handle, uint32_t bits);
+
+	std::vector<DrawPacket> packets;
+	// NOTE: Where each packet's push constants start in push_constant_data
+	std::vector<uint32_t> push_constant_offsets;
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> scratch;
+	std::vector<uint8_t> push_constant_data;
+
+	// NOTE: Small ids of handles seen so far, they only group equal state in keys
+	std::unordered_map<uint64_t, uint32_t> pipeline_ids;
+	std::unordered_map<uint64_t, uint32_t> descriptor_ids;
+	std::unordered_map<uint64_t, uint32_t> mesh_ids;
+
+	DrawQueueStats last_stats{};
+};
+
+} // namespace veekay
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/scheduler.hpp>
+
+namespace veekay {
+
+struct InstanceBufferStats {
+	// NOTE: Records written since the previous upload whose bytes changed
+	uint32_t dirty_records;
+	// NOTE: Records plus their indices that went through the upload buffer
+	VkDeviceSize uploaded_bytes;
+	// NOTE: What rewriting every record written so far would have taken
+	VkDeviceSize full_bytes;
+};
+
+// NOTE: Device local array of fixed-size per-instance records, e.g. transforms,
+//       bound by shaders as a storage buffer. Records are written into a CPU copy
+//       and only those whose bytes changed are uploaded: they are packed with
+//       their indices into a small host visible buffer and a compute pass scatters
+//       them into place, so upload size follows what changed, not instance count.
+//       Without glslc at build time the scatter falls back to a buffer copy per
+//       changed record. Records start zeroed. Call everything from main thread
+class InstanceBuffer {
+public:
+	InstanceBuffer() = default;
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	// NOTE: record_size must be a multiple of 4. Returns false on failure
+	bool create(uint32_t record_size, uint32_t capacity, const char* name);
+	// NOTE: Released once GPU is done with frames that may still use it
+	void destroy();
+
+	// NOTE: Copies record_size bytes, index must be below capacity. Writing
+	//       what the record already holds does not mark it dirty
+	void write(uint32_t index, const void* record);
+
+	// NOTE: Records scatter of dirty records into the frame's command buffer,
+	//       outside of a render pass, and makes them visible to shader reads at
+	//       dst_stages. Records nothing when nothing changed. Upload buffers are
+	//       reused once frames they went into are done, call at most once per frame
+	bool upload(VkCommandBuffer cmd, VkPipelineStageFlags dst_stages);
+
+	VkBuffer buffer() const { return device_buffer; }
+	VkDeviceSize size() const { return VkDeviceSize(record_size) * capacity; }
+
+	// NOTE: Counters of the last upload
+	const InstanceBufferStats& stats() const { return last_stats; }
+
+private:
+	struct UploadSlot {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		void* mapped;
+		VkDeviceSize size;
+		VkDescriptorSet descriptor_set;
+		bool busy;
+		// NOTE: Value of lastFrame when the slot was recorded, the frame it went
+		//       into is the first one submitted after that
+		uint64_t recorded_after;
+		// NOTE: Zero value until that frame is submitted
+		TimelinePoint frame;
+	};
+
+	bool reserveSlot(UploadSlot& slot, VkDeviceSize bytes);
+	void releaseSlot(UploadSlot& slot);
+
+	uint32_t record_size = 0;
+	uint32_t capacity = 0;
+	// NOTE: One past the highest index written so far
+	uint32_t record_count = 0;
+
+	VkBuffer device_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory device_memory = VK_NULL_HANDLE;
+	bool cleared = false;
+	// NOTE: Consumers of the previous upload, the next one waits for their reads
+	VkPipelineStageFlags last_dst_stages = 0;
+
+	VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+	std::vector<UploadSlot> slots;
+	uint32_t next_slot = 0;
+
+	std::vector<uint8_t> records;
+	std::vector<uint8_t> dirty_flags;
+	std::vector<uint32_t> dirty;
+
+	InstanceBufferStats last_stats{};
+};
+
+} // namespace veekay
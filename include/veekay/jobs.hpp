@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+
+namespace veekay {
+
+// NOTE: Handle of a job started with async, zero means "no job" and counts as done
+typedef uint32_t JobId;
+
+typedef std::function<void()> JobFunc;
+
+// NOTE: Run func on a worker thread once every job in dependencies is done.
+//       Meant for coarse tasks like pipeline compilation or mesh upload, not
+//       per-frame work. Vulkan calls are fine as long as objects a job touches
+//       are not used by other threads at the same time
+JobId async(JobFunc func, std::span<const JobId> dependencies = {});
+
+bool isDone(JobId job);
+
+// NOTE: Block the calling thread until a job is done
+void waitJob(JobId job);
+
+} // namespace veekay
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+enum class MemoryCategory : uint32_t {
+	// NOTE: Vertices, indices, meshlets and other mesh data
+	geometry,
+	// NOTE: Images rendered to, depth and everything the render graph creates
+	render_target,
+	// NOTE: Host visible buffers data goes through on its way to or from GPU
+	staging,
+	// NOTE: Textures and buffers of the application's own UI. ImGui backend
+	//       allocates on its own, its memory shows up as untracked heap usage
+	ui,
+	other,
+};
+
+constexpr uint32_t memory_category_count = 5;
+
+struct MemoryCategoryStats {
+	VkDeviceSize bytes;
+	VkDeviceSize peak_bytes;
+	uint32_t allocations;
+};
+
+struct MemoryHeapStats {
+	VkDeviceSize size;
+	VkMemoryHeapFlags flags;
+	// NOTE: Allocated through veekay::allocateMemory
+	VkDeviceSize tracked_bytes;
+	// NOTE: What the driver reports for the whole process, untracked
+	//       allocations included. Zero without VK_EXT_memory_budget
+	VkDeviceSize usage;
+	VkDeviceSize budget;
+};
+
+struct MemoryStats {
+	MemoryCategoryStats categories[memory_category_count];
+	VkDeviceSize bytes;
+	VkDeviceSize peak_bytes;
+	uint32_t allocations;
+
+	MemoryHeapStats heaps[VK_MAX_MEMORY_HEAPS];
+	uint32_t heap_count;
+};
+
+// NOTE: vkAllocateMemory and vkFreeMemory that keep count of allocations per
+//       category and heap. Memory from allocateMemory must go back through
+//       freeMemory, null is ignored. Callable from any thread
+VkResult allocateMemory(const VkMemoryAllocateInfo& info, MemoryCategory category, VkDeviceMemory* memory);
+void freeMemory(VkDeviceMemory memory);
+
+MemoryStats memoryStats();
+
+const char* memoryCategoryName(MemoryCategory category);
+
+// NOTE: ImGui window with counters per category and usage against budget per
+//       heap. Call from update, open may be null
+void showMemoryWindow(bool* open);
+
+} // namespace veekay
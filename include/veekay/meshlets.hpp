@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+constexpr uint32_t max_meshlet_vertices = 64;
+constexpr uint32_t max_meshlet_triangles = 124;
+
+// NOTE: Matches std430 layout, can be uploaded into a storage buffer as is
+struct Meshlet {
+	// NOTE: Bounding sphere in mesh space, xyz is center and w is radius
+	float sphere[4];
+	// NOTE: Normal cone, xyz is axis and w is cutoff. The whole meshlet faces
+	//       away from a camera at p when
+	//       dot(center - p, axis) >= cutoff * length(center - p) + radius.
+	//       Cutoff of 1 means the cone is too wide to ever cull
+	float cone[4];
+	// NOTE: Where the meshlet's triangles start in MeshletMesh::indices
+	uint32_t index_offset;
+	uint32_t triangle_count;
+	uint32_t vertex_count;
+	uint32_t padding;
+};
+
+struct MeshletMesh {
+	std::vector<Meshlet> meshlets;
+	// NOTE: Triangles of the source mesh regrouped meshlet by meshlet,
+	//       still indexing the original vertex buffer
+	std::vector<uint32_t> indices;
+};
+
+// NOTE: Split an indexed triangle list into clusters of at most max_meshlet_vertices
+//       unique vertices and max_meshlet_triangles triangles, following index order,
+//       so well ordered meshes give compact clusters. Each vertex must start with
+//       its position as 3 floats. front_face is the pipeline's one and decides
+//       which way cone axes point
+MeshletMesh buildMeshlets(const void* vertices, uint32_t vertex_stride, uint32_t vertex_count,
+                          std::span<const uint32_t> indices, VkFrontFace front_face);
+
+} // namespace veekay
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+struct ObjectCacheStats {
+	uint32_t created;
+	// NOTE: Requests answered with an object created earlier
+	uint64_t reused;
+};
+
+// NOTE: Shared state objects. Every create info is compared in full, following
+//       arrays it points to, and requests describing the same object get the
+//       same handle. Objects belong to veekay and are destroyed after shutdown
+//       callback returns, never destroy them yourself. Shader modules and other
+//       referenced objects count by handle, keep modules alive while pipelines
+//       made of them may still be requested. pNext chains are not supported.
+//       Returns nullptr on failure. Callable from any thread
+VkDescriptorSetLayout cachedDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& info);
+VkPipelineLayout cachedPipelineLayout(const VkPipelineLayoutCreateInfo& info);
+VkSampler cachedSampler(const VkSamplerCreateInfo& info);
+VkPipeline cachedGraphicsPipeline(const VkGraphicsPipelineCreateInfo& info);
+VkPipeline cachedComputePipeline(const VkComputePipelineCreateInfo& info);
+
+ObjectCacheStats objectCacheStats();
+
+} // namespace veekay
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Bit N enables shader feature N
+typedef uint32_t FeatureMask;
+
+// NOTE: Builds a pipeline with specialization passed to every shader stage.
+//       Runs on a worker thread, so only read state that does not change after init
+typedef VkPipeline (*VariantFactory)(VkShaderModule vertex, VkShaderModule fragment,
+                                     const VkSpecializationInfo* specialization);
+
+// NOTE: Pipelines specialized for feature sets, so shaders test features against
+//       constants the driver folds away instead of branching at runtime.
+//       Specialized variants get constant_id 0 set to true and constant_id N + 1
+//       set to bit N of their mask, all as VkBool32. A generic pipeline built without
+//       specialization keeps default values and should test features at runtime
+class PipelineVariants {
+public:
+	// NOTE: Modules must stay alive until destroy
+	void init(VkShaderModule vertex, VkShaderModule fragment,
+	          VariantFactory factory, uint32_t feature_count);
+
+	// NOTE: Rebuild variants from new shaders, e.g. from veekay::watchShaders reload
+	//       callback. Current variants are released through deferDestroy and get
+	//       returns fallback until new ones compile. Modules are created from the
+	//       code and owned from then on. Call from main thread
+	void reload(std::span<const uint32_t> vertex_code, std::span<const uint32_t> fragment_code);
+
+	// NOTE: Pipeline specialized for features if it is ready, otherwise fallback
+	//       while the variant compiles in background. Variants that failed to build
+	//       keep returning fallback. Call from main thread
+	VkPipeline get(FeatureMask features, VkPipeline fallback);
+
+	uint32_t readyCount();
+
+	// NOTE: Waits for compilations in flight, pipelines must not be in use anymore
+	void destroy();
+
+private:
+	VkShaderModule vertex;
+	VkShaderModule fragment;
+	VariantFactory factory;
+	uint32_t feature_count;
+
+	std::mutex mutex;
+	std::condition_variable compiled;
+	// NOTE: Null while compiling or when compilation failed
+	std::unordered_map<FeatureMask, VkPipeline> variants;
+	uint32_t compiling = 0;
+
+	// NOTE: Bumped by reload, variants of older shaders are dropped once built
+	uint32_t generation = 0;
+	// NOTE: Modules created by reload, destroyed once no compilation uses them
+	bool owns_modules = false;
+	std::vector<VkShaderModule> retired_modules;
+};
+
+} // namespace veekay
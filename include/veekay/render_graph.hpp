@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: How a pass touches an image. Decides image layout, pipeline stages
+//       and access masks the graph synchronizes with
+enum class Access : uint32_t {
+	color_attachment,
+	depth_attachment,
+	sampled,
+	storage,
+	transfer_src,
+	transfer_dst,
+};
+
+struct ImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	// NOTE: Zero means one. Images with more layers get 2D array views,
+	//       e.g. for multiview render passes writing a layer per view
+	uint32_t layers;
+	// NOTE: Extra usage flags, ones implied by declared accesses are added automatically
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspect;
+};
+
+typedef uint32_t ResourceId;
+typedef uint32_t PassId;
+
+// NOTE: Passes declare which images they read and write. On compile the graph
+//       drops passes whose results nobody consumes, plans layout transitions and
+//       barriers between passes, and lets transient images with non-overlapping
+//       lifetimes share device memory. Passes execute in the order they were added
+class RenderGraph {
+public:
+	typedef std::function<void(VkCommandBuffer)> PassFunc;
+
+	// NOTE: Image owned outside of the graph, e.g. a swapchain image, counts as graph output.
+	//       Each frame it starts in initial_layout after initial_stage and is left in final_layout,
+	//       with graph's writes visible to later accesses that layout is meant for.
+	//       Handle must be provided with setImage before execute
+	ResourceId importImage(const char* name, VkImageAspectFlags aspect,
+	                       VkImageLayout initial_layout, VkPipelineStageFlags initial_stage,
+	                       VkImageLayout final_layout);
+
+	// NOTE: Image owned by the graph, its contents do not survive between frames
+	ResourceId createImage(const char* name, const ImageDesc& desc);
+
+	PassId addPass(const char* name, PassFunc func);
+	void read(PassId pass, ResourceId resource, Access access);
+	void write(PassId pass, ResourceId resource, Access access);
+
+	bool compile();
+	void execute(VkCommandBuffer cmd);
+	void destroy();
+
+	void setImage(ResourceId resource, VkImage image, VkImageView view);
+	VkImage image(ResourceId resource) const;
+	VkImageView view(ResourceId resource) const;
+
+	bool isActive(PassId pass) const;
+
+private:
+	struct Resource {
+		const char* name;
+		bool imported;
+		ImageDesc desc;
+
+		VkImageLayout initial_layout;
+		VkPipelineStageFlags initial_stage;
+		VkImageLayout final_layout;
+
+		VkImage image;
+		VkImageView view;
+		uint32_t memory_block;
+
+		// NOTE: Lifetime in active passes, first > last when unused
+		uint32_t first_pass;
+		uint32_t last_pass;
+	};
+
+	struct Use {
+		ResourceId resource;
+		Access access;
+		bool reads;
+		bool writes;
+	};
+
+	struct Barriers {
+		std::vector<VkImageMemoryBarrier> images;
+		std::vector<ResourceId> resources;
+		VkPipelineStageFlags src_stages;
+		VkPipelineStageFlags dst_stages;
+	};
+
+	struct Pass {
+		const char* name;
+		PassFunc func;
+		std::vector<Use> uses;
+		bool active;
+		Barriers barriers;
+	};
+
+	struct MemoryBlock {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t type_bits;
+		std::vector<ResourceId> occupants;
+	};
+
+	void addUse(PassId pass, ResourceId resource, Access access, bool writes);
+	void cull();
+	bool allocate();
+	void planBarriers();
+	void record(VkCommandBuffer cmd, Barriers& barriers);
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<MemoryBlock> blocks;
+	Barriers final_barriers;
+};
+
+} // namespace veekay
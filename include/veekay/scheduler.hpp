@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Logical queues exposed by veekay. When a device has no separate
+//       compute or transfer family, those fall back to the graphics queue
+enum class Queue : uint32_t {
+	graphics,
+	compute,
+	transfer,
+};
+
+constexpr uint32_t queue_count = 3;
+
+// NOTE: A moment on a queue's timeline semaphore, reached when all work
+//       submitted up to (and including) that submission has finished
+struct TimelinePoint {
+	Queue queue;
+	uint64_t value;
+};
+
+// NOTE: Submit a command buffer to one of the queues. Work waits at wait_stage
+//       until every point in waits is reached. Returns the point this submission signals.
+//       Resources shared between queue families must be created with
+//       VK_SHARING_MODE_CONCURRENT or transferred explicitly
+TimelinePoint submit(Queue queue, VkCommandBuffer cmd,
+                     std::span<const TimelinePoint> waits = {},
+                     VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+// NOTE: Make graphics work of the frame being recorded wait for a point,
+//       e.g. culling results computed asynchronously. Call before render returns
+void waitInFrame(TimelinePoint point, VkPipelineStageFlags wait_stage);
+
+// NOTE: Point reached once the most recently submitted frame has finished on GPU.
+//       Pass it to submit to overlap compute with graphics of the previous frame
+TimelinePoint lastFrame();
+
+// NOTE: Last point submitted to a queue so far
+TimelinePoint lastSubmitted(Queue queue);
+
+bool isComplete(TimelinePoint point);
+
+// NOTE: Block the calling thread until a point is reached
+void wait(TimelinePoint point);
+
+// NOTE: Run destroy once GPU has finished the frame being recorded and everything
+//       already submitted to any queue, so a resource can be released without
+//       vkDeviceWaitIdle. Callable from any thread, destroy runs on the main thread
+//       between frames. Anything still queued runs at shutdown, before the device goes
+void deferDestroy(std::function<void()> destroy);
+
+// NOTE: Same, but only wait for a known point, e.g. the last submission using a buffer
+void deferDestroy(TimelinePoint point, std::function<void()> destroy);
+
+} // namespace veekay
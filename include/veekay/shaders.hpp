@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Create a shader module straight from SPIR-V words, e.g. an array
+//       embedded with compile_shader(... EMBED). Returns nullptr on failure
+VkShaderModule createShaderModule(std::span<const uint32_t> code);
+
+// NOTE: Builds a pipeline out of freshly compiled shader modules. Runs on a
+//       background thread, so only read state that does not change after init.
+//       Modules are destroyed once it returns
+typedef VkPipeline (*PipelineFactory)(VkShaderModule vertex, VkShaderModule fragment);
+typedef VkPipeline (*ComputePipelineFactory)(VkShaderModule compute);
+
+// NOTE: Called on main thread right after a reloaded pipeline is swapped in, with
+//       SPIR-V it was built from, e.g. to rebuild pipelines derived from the same
+//       shaders. Code is only valid during the call
+typedef void (*ReloadFunc)(std::span<const uint32_t> vertex, std::span<const uint32_t> fragment);
+
+// NOTE: Watch GLSL sources of a pipeline for changes. Edited sources are recompiled
+//       in background (shaderc when available, glslc otherwise), the pipeline is
+//       rebuilt by factory and *pipeline is swapped at the next frame boundary.
+//       Pipelines are cached by SPIR-V hash, so reverting an edit is instant.
+//       Veekay takes ownership of *pipeline and destroys it, together with every
+//       reloaded one, after shutdown callback returns, also when hot reload
+//       could not be started. reload may be null
+void watchShaders(const char* vertex_path, const char* fragment_path,
+                  PipelineFactory factory, VkPipeline* pipeline, ReloadFunc reload = nullptr);
+
+// NOTE: Same for a compute pipeline made of a single .comp source
+void watchComputeShader(const char* compute_path, ComputePipelineFactory factory, VkPipeline* pipeline);
+
+} // namespace veekay
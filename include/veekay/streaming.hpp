@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Handle of a mesh registered with addStreamedMesh
+typedef uint32_t StreamedMeshId;
+
+// NOTE: Geometry of a resident LOD, both vertices and uint32 indices live in one
+//       device local buffer. Vertices start at offset zero, indices at index_offset
+struct StreamedMesh {
+	VkBuffer buffer;
+	VkDeviceSize index_offset;
+	uint32_t index_count;
+	// NOTE: LOD that is actually resident, may differ from the requested one
+	uint32_t lod;
+};
+
+struct StreamingStats {
+	VkDeviceSize resident_bytes;
+	VkDeviceSize budget_bytes;
+	uint32_t resident_lods;
+	uint32_t loading_lods;
+	uint64_t evictions;
+};
+
+// NOTE: Write geometry in the format streamed meshes are read in: a small header,
+//       tightly packed vertices of vertex_stride bytes each, then indices
+bool writeMeshFile(const char* path, const void* vertices, uint32_t vertex_stride,
+                   uint32_t vertex_count, std::span<const uint32_t> indices);
+
+// NOTE: Register a mesh whose LOD files go from the finest to the coarsest.
+//       Nothing is loaded up front except the coarsest LOD, which is queued
+//       right away and never evicted, so there is always something to draw.
+//       Call from main thread
+StreamedMeshId addStreamedMesh(std::span<const char* const> lod_paths);
+
+// NOTE: Ask for a LOD to draw this frame. Missing LODs are loaded from disk
+//       on a background thread and uploaded through transfer queue. Meanwhile
+//       the closest resident LOD is returned, coarser ones first. Returns
+//       false when nothing of the mesh is resident yet. Call from main thread
+bool requestMesh(StreamedMeshId mesh, uint32_t lod, StreamedMesh& result);
+
+// NOTE: Limit device memory used by streamed meshes. Zero, the default, follows
+//       what VK_EXT_memory_budget reports, or half of device local memory without
+//       it. Least recently drawn LODs are evicted while usage is over the limit
+void setStreamingBudget(VkDeviceSize bytes);
+
+StreamingStats streamingStats();
+
+} // namespace veekay
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+namespace veekay {
+
+// NOTE: Timeline of CPU zones and GPU zones, dumped in Chrome trace format.
+//       Open dumps in chrome://tracing or ui.perfetto.dev. Every thread keeps its
+//       last few thousand zones in its own ring buffer, recording takes no locks.
+//       Zone and thread names are kept by pointer, pass string literals
+
+void beginZone(const char* name);
+void endZone();
+
+// NOTE: Zone lasting until the end of the scope
+class TraceZone {
+public:
+	explicit TraceZone(const char* name) { beginZone(name); }
+	~TraceZone() { endZone(); }
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+};
+
+// NOTE: Label of the calling thread's track in dumps
+void setThreadName(const char* name);
+
+// NOTE: GPU zones are timestamps written into the frame command buffer veekay is
+//       recording, calls with any other command buffer are ignored. Render graph
+//       passes get a zone each already. Placed on the CPU timeline through
+//       VK_EXT_calibrated_timestamps against CLOCK_MONOTONIC on Linux, without
+//       it frame's first zone is aligned with its submission. Call from main thread
+void beginGpuZone(VkCommandBuffer cmd, const char* name);
+void endGpuZone(VkCommandBuffer cmd);
+
+// NOTE: Write whatever is buffered right now to path, on a background job.
+//       GPU zones show up once their frame is done, the last frames in flight
+//       are missing. Call from main thread while veekay::run is running
+void dumpTrace(const char* path);
+
+// NOTE: Dump by itself once a frame takes longer than frame_milliseconds,
+//       a few frames later so the slow frame's GPU zones make it in. path_pattern
+//       takes the frame index printf-style, e.g. "spike_%u.json". Zero disables.
+//       Call from main thread
+void dumpTraceOnSpike(double frame_milliseconds, const char* path_pattern);
+
+} // namespace veekay
@@ -1,30 +1,116 @@
 #pragma once
 
+#include <cstdint>
+
 #include <vulkan/vulkan_core.h>
 
 namespace veekay {
 
+// NOTE: Simulation results are handed to render through this many snapshot slots
+constexpr uint32_t snapshot_slot_count = 2;
+
+// NOTE: Whether Vulkan validation layers are loaded. automatic enables them
+//       in builds without NDEBUG. VEEKAY_VALIDATION=0 or =1 environment
+//       variable overrides whatever was chosen here
+enum class Validation : uint32_t {
+	automatic,
+	enabled,
+	disabled,
+};
+
 typedef void (*InitFunc)();
 typedef void (*ShutdownFunc)();
 typedef void (*UpdateFunc)(double time);
+typedef void (*SimulateFunc)(double delta_time);
+typedef void (*SnapshotFunc)(uint32_t slot);
 typedef void (*RenderFunc)(VkCommandBuffer, VkFramebuffer);
 
 struct Application {
 	uint32_t window_width;
 	uint32_t window_height;
 
+	// NOTE: Scene pass renders view_count views of this size, placed side by side
+	//       across the window afterwards. With a single view it is the whole window
+	uint32_t view_width;
+	uint32_t view_height;
+	uint32_t view_count;
+
 	VkDevice vk_device;
 	VkPhysicalDevice vk_physical_device;
 	VkRenderPass vk_render_pass;
 
+	// NOTE: Compute and transfer queues are dedicated ones when the device has them,
+	//       otherwise they are the same as graphics queue. Submit through veekay::submit
+	VkQueue vk_graphics_queue;
+	uint32_t vk_graphics_queue_family;
+	VkQueue vk_compute_queue;
+	uint32_t vk_compute_queue_family;
+	VkQueue vk_transfer_queue;
+	uint32_t vk_transfer_queue_family;
+
+	// NOTE: How far into the next simulation step we are, in [0, 1).
+	//       Use it in render to interpolate between the last two simulated states
+	double simulation_alpha;
+	// NOTE: Snapshot slot render should read simulated state from
+	uint32_t render_snapshot;
+
 	bool running;
 };
 
 struct ApplicationInfo {
 	InitFunc init;
 	ShutdownFunc shutdown;
+	// NOTE: Called once per rendered frame with absolute time in seconds, build UI here.
+	//       While the window is unfocused it runs at about 10 Hz instead
 	UpdateFunc update;
+	// NOTE: Records the scene pass into a command buffer veekay has already begun,
+	//       begin vk_render_pass on the given framebuffer there
 	RenderFunc render;
+
+	// NOTE: Optional, called at a fixed rate with a constant delta_time,
+	//       independently of how fast frames are rendered
+	SimulateFunc simulate;
+	// NOTE: Simulation ticks per second, defaults to 60 when left zero
+	double simulation_rate;
+	// NOTE: Upper bound of ticks run per frame to catch up after a stall,
+	//       defaults to 5 when left zero. Time beyond that is dropped
+	uint32_t max_simulation_steps;
+
+	// NOTE: Called right after simulation ticks, copy everything render needs
+	//       from simulated state into your own snapshots[slot]
+	SnapshotFunc snapshot;
+	// NOTE: Run simulate and snapshot on a separate thread, overlapping next frame's
+	//       simulation with recording and submission of the current one.
+	//       Requires snapshot, render must then only read simulated state from snapshots
+	bool threaded_simulation;
+
+	Validation validation;
+
+	// NOTE: Render without a window into offscreen images, e.g. for captures
+	//       on machines without a display. Time advances one simulation step
+	//       per frame, input and presentation are unavailable
+	bool headless;
+	// NOTE: Stop after this many frames, zero runs until the window is closed
+	//       or running is cleared. Headless runs should set one of the two
+	uint64_t max_frames;
+
+	// NOTE: Keep depth after the scene pass and reduce it into a depth pyramid
+	//       for occlusion tests in the next frame, see veekay::depthPyramid
+	bool depth_pyramid;
+
+	// NOTE: Write time and UI input of every frame into a binary log at this path
+	const char* record_input;
+	// NOTE: Take time and UI input from a log written with record_input instead
+	//       of the clock and the window, headless runs included. Stops when the
+	//       log ends. Frames replay the same as long as the application's state
+	//       only depends on time, simulation and UI
+	const char* replay_input;
+
+	// NOTE: Render this many views in one scene pass through multiview: draws are
+	//       recorded once and run per view, vertex shaders pick what differs by
+	//       gl_ViewIndex. Zero means one. Each view gets window width divided by
+	//       the count, depth pyramid is unavailable with more than one
+	uint32_t view_count;
 };
 
 extern Application app;
@@ -0,0 +1,58 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// NOTE: No vertex attributes, cylinder side is rebuilt from gl_VertexIndex.
+//       Draw 6 * segments vertices without vertex and index buffers
+
+// NOTE: Same outputs as shader.vert, shader.frag is shared
+layout (location = 0) out vec3 f_position;
+layout (location = 1) out float f_height;
+
+// NOTE: Transforms of every instance, written by veekay::InstanceBuffer
+layout (std430, set = 0, binding = 0) readonly buffer Instances {
+	mat4 transforms[];
+};
+
+// NOTE: Must match declaration order of a C struct
+layout (push_constant, std430) uniform ShaderConstants {
+	mat4 projection;
+	vec3 color;
+	uint features;
+	mat4 second_projection;
+	// NOTE: Cylinder of this draw, may differ between instances
+	float radius;
+	float height;
+	uint segments;
+	// NOTE: Index of this draw's transform
+	uint instance;
+};
+
+const float PI = 3.14159265358979f;
+
+// NOTE: Triangle corners of a segment in generateCylinder's index order.
+//       x steps to the next segment, y picks the top ring
+const uvec2 CORNERS[6] = uvec2[](
+	uvec2(0, 0), uvec2(1, 0), uvec2(1, 1),
+	uvec2(0, 0), uvec2(1, 1), uvec2(0, 1)
+);
+
+void main() {
+	uvec2 corner = CORNERS[gl_VertexIndex % 6];
+	uint segment = (uint(gl_VertexIndex) / 6 + corner.x) % segments;
+
+	float angle = float(segment) / float(segments) * 2.0f * PI;
+	float y = corner.y == 1 ? height * 0.5f : -height * 0.5f;
+
+	vec4 point = vec4(radius * cos(angle), y, radius * sin(angle), 1.0f);
+
+	// NOTE: Always 0 outside of multiview passes
+	mat4 view_projection = gl_ViewIndex == 0 ? projection : second_projection;
+
+	vec4 transformed = transforms[instance] * point;
+
+	f_position = transformed.xyz;
+	// NOTE: Gradient in shader.frag expects the 2 units high default cylinder
+	f_height = y / height * 2.0f;
+
+	gl_Position = view_projection * transformed;
+}
@@ -1,7 +1,8 @@
 #version 450
 
 // NOTE: out attributes of vertex shader must be in's
-// layout (location = 0) in type name;
+layout (location = 0) in vec3 f_position;
+layout (location = 1) in float f_height;
 
 // NOTE: Pixel color
 layout (location = 0) out vec4 final_color;
@@ -9,10 +10,43 @@ layout (location = 0) out vec4 final_color;
 // NOTE: Must match declaration order of a C struct
 layout (push_constant, std430) uniform ShaderConstants {
 	mat4 projection;
-	mat4 transform;
 	vec3 color;
+	uint features;
 };
 
+// NOTE: Set by veekay::PipelineVariants. Specialized pipelines take features
+//       from constants and lose the branches, generic one reads push constants
+layout (constant_id = 0) const bool specialized = false;
+layout (constant_id = 1) const bool lighting_feature = false;
+layout (constant_id = 2) const bool gradient_feature = false;
+
+// NOTE: Must match ShaderFeature bits
+const uint LIGHTING_BIT = 1u << 0;
+const uint GRADIENT_BIT = 1u << 1;
+
+bool lightingEnabled() {
+	return specialized ? lighting_feature : (features & LIGHTING_BIT) != 0;
+}
+
+bool gradientEnabled() {
+	return specialized ? gradient_feature : (features & GRADIENT_BIT) != 0;
+}
+
 void main() {
-	final_color = vec4(color, 1.0f);
+	vec3 result = color;
+
+	// NOTE: Darker towards the bottom of the model
+	if (gradientEnabled()) {
+		result *= mix(0.4f, 1.0f, clamp(f_height * 0.5f + 0.5f, 0.0f, 1.0f));
+	}
+
+	// NOTE: Flat diffuse lighting, face normal comes from screen-space derivatives
+	if (lightingEnabled()) {
+		vec3 normal = normalize(cross(dFdx(f_position), dFdy(f_position)));
+		vec3 light = normalize(vec3(0.4f, 0.8f, 0.6f));
+
+		result *= 0.25f + 0.75f * abs(dot(normal, light));
+	}
+
+	final_color = vec4(result, 1.0f);
 }
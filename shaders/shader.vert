@@ -1,20 +1,44 @@
 #version 450
+#extension GL_EXT_multiview : require
 
 // NOTE: Attributes must match the declaration of VkVertexInputAttribute array
 layout (location = 0) in vec3 v_position;
 // layout (location = 1) in type name;
 
+// NOTE: Position in camera space and height along the model, for fragment features
+layout (location = 0) out vec3 f_position;
+layout (location = 1) out float f_height;
+
+// NOTE: Transforms of every instance, written by veekay::InstanceBuffer
+layout (std430, set = 0, binding = 0) readonly buffer Instances {
+	mat4 transforms[];
+};
+
 // NOTE: Must match declaration order of a C struct
 layout (push_constant, std430) uniform ShaderConstants {
 	mat4 projection;
-	mat4 transform;
 	vec3 color;
+	uint features;
+	// NOTE: Second view of a multiview pass projects with this one
+	mat4 second_projection;
+	// NOTE: Cylinder parameters of procedural.vert, unused here
+	float radius;
+	float height;
+	uint segments;
+	// NOTE: Index of this draw's transform
+	uint instance;
 };
 
 void main() {
+	// NOTE: Always 0 outside of multiview passes
+	mat4 view_projection = gl_ViewIndex == 0 ? projection : second_projection;
+
 	vec4 point = vec4(v_position, 1.0f);
-	vec4 transformed = transform * point;
-	vec4 projected = projection * transformed;
+	vec4 transformed = transforms[instance] * point;
+	vec4 projected = view_projection * transformed;
+
+	f_position = transformed.xyz;
+	f_height = v_position.y;
 
 	// NOTE: Write our projected point out
 	gl_Position = projected;
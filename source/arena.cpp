@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include <veekay/arena.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+std::atomic<uint64_t> heap_allocations;
+
+thread_local veekay::Arena thread_arena;
+
+veekay::Arena* frame_arena;
+uint64_t frame_start_allocations;
+uint64_t frame_allocations;
+
+} // namespace
+
+#ifdef VEEKAY_COUNT_ALLOCATIONS
+
+// NOTE: Replacements of the global operators, every other form of new and
+//       delete forwards to these by default
+void* operator new(std::size_t size) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* pointer = std::malloc(size ? size : 1)) {
+		return pointer;
+	}
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+#endif
+
+veekay::Arena::Arena(size_t block_size)
+	: block_size(block_size), current(0), offset(0), used_bytes(0) {}
+
+veekay::Arena::~Arena() {
+	for (Block& block : blocks) {
+		::operator delete(block.data);
+	}
+}
+
+void veekay::Arena::reset() {
+	// NOTE: Next time everything fits without crossing blocks
+	if (current > 0) {
+		size_t total = 0;
+
+		for (Block& block : blocks) {
+			total += block.size;
+			::operator delete(block.data);
+		}
+
+		blocks.clear();
+		blocks.push_back(Block{
+			.data = static_cast<std::byte*>(::operator new(total)),
+			.size = total,
+		});
+	}
+
+	current = 0;
+	offset = 0;
+	used_bytes = 0;
+}
+
+size_t veekay::Arena::used() const {
+	return used_bytes;
+}
+
+size_t veekay::Arena::capacity() const {
+	size_t total = 0;
+
+	for (const Block& block : blocks) {
+		total += block.size;
+	}
+
+	return total;
+}
+
+void* veekay::Arena::do_allocate(size_t bytes, size_t alignment) {
+	while (current < blocks.size()) {
+		Block& block = blocks[current];
+
+		const uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+		const uintptr_t aligned = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+		const size_t start = static_cast<size_t>(aligned - base);
+
+		if (start + bytes <= block.size) {
+			offset = start + bytes;
+			used_bytes += bytes;
+			return block.data + start;
+		}
+
+		// NOTE: Rest of the block is wasted until reset
+		if (current + 1 == blocks.size()) {
+			break;
+		}
+
+		++current;
+		offset = 0;
+	}
+
+	// NOTE: Blocks come from the default new, aligned to max_align_t, extra
+	//       room covers stricter alignments
+	const size_t size = std::max(block_size, bytes + alignment);
+
+	blocks.push_back(Block{
+		.data = static_cast<std::byte*>(::operator new(size)),
+		.size = size,
+	});
+
+	current = blocks.size() - 1;
+	offset = 0;
+
+	return do_allocate(bytes, alignment);
+}
+
+void veekay::Arena::do_deallocate(void*, size_t, size_t) {}
+
+bool veekay::Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
+veekay::Arena& veekay::frameArena() {
+	return *frame_arena;
+}
+
+veekay::Arena& veekay::threadArena() {
+	return thread_arena;
+}
+
+uint64_t veekay::heapAllocationCount() {
+	return heap_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t veekay::frameHeapAllocations() {
+	return frame_allocations;
+}
+
+void veekay::internal::initArenas() {
+	frame_arena = &thread_arena;
+	frame_start_allocations = heapAllocationCount();
+}
+
+void veekay::internal::beginArenaFrame() {
+	const uint64_t count = heapAllocationCount();
+
+	frame_allocations = count - frame_start_allocations;
+	frame_start_allocations = count;
+
+	frame_arena->reset();
+}
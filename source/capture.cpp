@@ -0,0 +1,614 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/capture.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/memory.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+// NOTE: Enough for every frame in flight to carry a capture, plus slack
+//       for results still waiting to be picked up or written out
+constexpr uint32_t staging_ring_size = 4;
+
+struct CaptureRequest {
+	veekay::CaptureFunc func;
+	std::string path;
+	veekay::ImageFormat format;
+};
+
+struct StagingSlot {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	void* mapped;
+	// NOTE: Guarded by writer_mutex, writer frees slots it is done with
+	bool busy;
+	veekay::TimelinePoint point;
+	CaptureRequest request;
+};
+
+// NOTE: Pixels stay in the staging slot until they are written, so the queue
+//       never holds more than the ring does
+struct WriteJob {
+	std::string path;
+	veekay::ImageFormat format;
+	uint32_t slot;
+};
+
+VkFormat capture_format;
+VkExtent2D capture_extent;
+VkImageLayout capture_layout;
+bool capture_coherent;
+
+StagingSlot slots[staging_ring_size];
+// NOTE: Busy slots in submission order, results are handed out in this order
+std::deque<uint32_t> in_flight;
+uint32_t recorded_slot = UINT_MAX;
+
+std::deque<CaptureRequest> requests;
+
+bool recording;
+std::string recording_pattern;
+veekay::ImageFormat recording_format;
+uint32_t recording_index;
+
+bool capture_bgra;
+
+std::thread writer_thread;
+std::mutex writer_mutex;
+std::condition_variable writer_condition;
+std::deque<WriteJob> write_queue;
+bool writer_quit;
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+	static uint32_t table[256];
+
+	if (!table[1]) {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; ++bit) {
+				value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+			}
+			table[i] = value;
+		}
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+	putBigEndian(out, static_cast<uint32_t>(data.size()));
+
+	const size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+
+	putBigEndian(out, crc32(out.data() + start, out.size() - start));
+}
+
+// NOTE: RGB8 PNG with uncompressed deflate blocks. Files are big, but
+//       encoding is as fast as a copy and needs no zlib
+std::vector<uint8_t> encodePNG(const uint8_t* rgba, uint32_t width, uint32_t height) {
+	std::vector<uint8_t> scanlines;
+	scanlines.reserve((width * 3 + 1) * height);
+
+	for (uint32_t y = 0; y < height; ++y) {
+		// NOTE: Filter type "none"
+		scanlines.push_back(0);
+
+		const uint8_t* row = rgba + size_t(y) * width * 4;
+		for (uint32_t x = 0; x < width; ++x) {
+			scanlines.insert(scanlines.end(), row + x * 4, row + x * 4 + 3);
+		}
+	}
+
+	std::vector<uint8_t> zlib{0x78, 0x01};
+
+	constexpr size_t max_block = 65535;
+
+	for (size_t offset = 0; offset < scanlines.size() || offset == 0; offset += max_block) {
+		const size_t size = std::min(max_block, scanlines.size() - offset);
+		const bool last = offset + size == scanlines.size();
+
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back(size & 0xff);
+		zlib.push_back(size >> 8);
+		zlib.push_back(~size & 0xff);
+		zlib.push_back((~size >> 8) & 0xff);
+		zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+
+		if (last) {
+			break;
+		}
+	}
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : scanlines) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	putBigEndian(zlib, (b << 16) | a);
+
+	std::vector<uint8_t> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	// NOTE: 8 bits per channel, RGB, default compression, filtering and no interlace
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+
+	std::vector<uint8_t> result{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+	putChunk(result, "IHDR", header);
+	putChunk(result, "IDAT", zlib);
+	putChunk(result, "IEND", {});
+
+	return result;
+}
+
+// NOTE: In place, staging memory is cached whenever the device has such
+void toRGBA(uint8_t* pixels) {
+	if (!capture_bgra) {
+		return;
+	}
+
+	const size_t size = size_t(capture_extent.width) * capture_extent.height * 4;
+
+	for (size_t i = 0; i < size; i += 4) {
+		std::swap(pixels[i], pixels[i + 2]);
+	}
+}
+
+void writerMain() {
+	veekay::setThreadName("capture writer");
+
+	std::unique_lock lock(writer_mutex);
+
+	for (;;) {
+		writer_condition.wait(lock, [] { return !write_queue.empty() || writer_quit; });
+
+		if (write_queue.empty()) {
+			break;
+		}
+
+		WriteJob job = std::move(write_queue.front());
+		write_queue.pop_front();
+
+		StagingSlot& slot = slots[job.slot];
+
+		lock.unlock();
+		{
+			veekay::TraceZone zone("write image");
+
+			uint8_t* pixels = static_cast<uint8_t*>(slot.mapped);
+			toRGBA(pixels);
+			veekay::writeImage(job.path.c_str(), job.format, pixels, capture_extent.width, capture_extent.height);
+		}
+		lock.lock();
+
+		slot.busy = false;
+	}
+}
+
+void finishSlot(uint32_t index) {
+	StagingSlot& slot = slots[index];
+
+	if (!capture_coherent) {
+		VkMappedMemoryRange range{
+			.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = slot.memory,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		};
+
+		vkInvalidateMappedMemoryRanges(veekay::app.vk_device, 1, &range);
+	}
+
+	CaptureRequest request = std::move(slot.request);
+
+	if (request.func) {
+		uint8_t* pixels = static_cast<uint8_t*>(slot.mapped);
+		toRGBA(pixels);
+		request.func(pixels, capture_extent.width, capture_extent.height);
+
+		std::lock_guard lock(writer_mutex);
+		slot.busy = false;
+		return;
+	}
+
+	// NOTE: Slot stays busy until it is written, a writer falling behind makes
+	//       recording drop frames instead of piling them up in memory
+	{
+		std::lock_guard lock(writer_mutex);
+
+		write_queue.push_back(WriteJob{
+			.path = std::move(request.path),
+			.format = request.format,
+			.slot = index,
+		});
+	}
+
+	writer_condition.notify_one();
+}
+
+} // namespace
+
+void veekay::captureFrame(CaptureFunc func) {
+	requests.push_back(CaptureRequest{.func = std::move(func)});
+}
+
+void veekay::captureFrame(const char* path, ImageFormat format) {
+	requests.push_back(CaptureRequest{.path = path, .format = format});
+}
+
+void veekay::startRecording(const char* path_pattern, ImageFormat format) {
+	recording = true;
+	recording_pattern = path_pattern;
+	recording_format = format;
+	recording_index = 0;
+}
+
+void veekay::stopRecording() {
+	recording = false;
+}
+
+bool veekay::writeImage(const char* path, ImageFormat format,
+                        const uint8_t* pixels, uint32_t width, uint32_t height) {
+	FILE* file = std::fopen(path, "wb");
+	if (!file) {
+		std::cerr << "Failed to open image file for writing: " << path << '\n';
+		return false;
+	}
+
+	switch (format) {
+	case ImageFormat::raw:
+		std::fwrite(pixels, 1, size_t(width) * height * 4, file);
+		break;
+
+	case ImageFormat::ppm: {
+		std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+		std::vector<uint8_t> row(width * 3);
+
+		for (uint32_t y = 0; y < height; ++y) {
+			const uint8_t* src = pixels + size_t(y) * width * 4;
+			for (uint32_t x = 0; x < width; ++x) {
+				memcpy(&row[x * 3], &src[x * 4], 3);
+			}
+
+			std::fwrite(row.data(), 1, row.size(), file);
+		}
+
+		break;
+	}
+
+	case ImageFormat::png: {
+		const std::vector<uint8_t> png = encodePNG(pixels, width, height);
+		std::fwrite(png.data(), 1, png.size(), file);
+		break;
+	}
+	}
+
+	std::fclose(file);
+
+	return true;
+}
+
+bool veekay::readImage(const char* path, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height) {
+	FILE* file = std::fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+
+	uint32_t max_value = 0;
+	if (std::fscanf(file, "P6 %u %u %u", &width, &height, &max_value) != 3 || max_value != 255) {
+		std::cerr << "Not a binary 8-bit PPM image: " << path << '\n';
+		std::fclose(file);
+		return false;
+	}
+
+	// NOTE: Exactly one whitespace character separates header from pixels
+	std::fgetc(file);
+
+	std::vector<uint8_t> rgb(size_t(width) * height * 3);
+	const bool complete = std::fread(rgb.data(), 1, rgb.size(), file) == rgb.size();
+
+	std::fclose(file);
+
+	if (!complete) {
+		std::cerr << "Truncated PPM image: " << path << '\n';
+		return false;
+	}
+
+	pixels.resize(size_t(width) * height * 4);
+
+	for (size_t i = 0, e = size_t(width) * height; i < e; ++i) {
+		memcpy(&pixels[i * 4], &rgb[i * 3], 3);
+		pixels[i * 4 + 3] = 255;
+	}
+
+	return true;
+}
+
+veekay::ImageDifference veekay::compareImages(const uint8_t* a, const uint8_t* b,
+                                              uint32_t width, uint32_t height, uint32_t tolerance) {
+	ImageDifference result{};
+
+	const size_t pixel_count = size_t(width) * height;
+	uint64_t total_error = 0;
+
+	for (size_t i = 0; i < pixel_count; ++i) {
+		uint32_t pixel_error = 0;
+
+		for (size_t c = 0; c < 4; ++c) {
+			const uint32_t error = std::abs(int(a[i * 4 + c]) - int(b[i * 4 + c]));
+
+			total_error += error;
+			pixel_error = std::max(pixel_error, error);
+		}
+
+		result.max_error = std::max(result.max_error, pixel_error);
+
+		if (pixel_error > tolerance) {
+			++result.differing_pixels;
+		}
+	}
+
+	if (pixel_count) {
+		result.mean_error = double(total_error) / double(pixel_count * 4);
+	}
+
+	return result;
+}
+
+bool veekay::internal::initCapture(VkFormat format, VkExtent2D extent, VkImageLayout layout) {
+	VkDevice device = veekay::app.vk_device;
+
+	capture_format = format;
+	capture_extent = extent;
+	capture_layout = layout;
+	capture_bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(veekay::app.vk_physical_device, &properties);
+
+	for (StagingSlot& slot : slots) {
+		VkBufferCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = VkDeviceSize(extent.width) * extent.height * 4,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		};
+
+		if (vkCreateBuffer(device, &info, nullptr, &slot.buffer) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan capture staging buffer\n";
+			return false;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device, slot.buffer, &requirements);
+
+		// NOTE: CPU reads these, cached memory makes that much faster
+		uint32_t index = UINT_MAX;
+		const VkMemoryPropertyFlags wanted[] = {
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		};
+
+		for (VkMemoryPropertyFlags flags : wanted) {
+			for (uint32_t i = 0; i < properties.memoryTypeCount && index == UINT_MAX; ++i) {
+				if ((requirements.memoryTypeBits & (1 << i)) &&
+				    (properties.memoryTypes[i].propertyFlags & flags) == flags) {
+					index = i;
+				}
+			}
+		}
+
+		if (index == UINT_MAX) {
+			std::cerr << "Failed to find host visible memory for capture\n";
+			return false;
+		}
+
+		capture_coherent = properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		VkMemoryAllocateInfo allocate_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = requirements.size,
+			.memoryTypeIndex = index,
+		};
+
+		if (veekay::allocateMemory(allocate_info, veekay::MemoryCategory::staging, &slot.memory) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate Vulkan capture staging memory\n";
+			return false;
+		}
+
+		if (vkBindBufferMemory(device, slot.buffer, slot.memory, 0) != VK_SUCCESS ||
+		    vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped) != VK_SUCCESS) {
+			std::cerr << "Failed to set up Vulkan capture staging memory\n";
+			return false;
+		}
+	}
+
+	writer_quit = false;
+	writer_thread = std::thread(writerMain);
+
+	return true;
+}
+
+void veekay::internal::recordCapture(VkCommandBuffer cmd, VkImage image) {
+	recorded_slot = UINT_MAX;
+
+	if (requests.empty() && !recording) {
+		return;
+	}
+
+	uint32_t index = 0;
+	{
+		std::lock_guard lock(writer_mutex);
+
+		while (index < staging_ring_size && slots[index].busy) {
+			++index;
+		}
+	}
+
+	// NOTE: Every staging buffer is in use, try again next frame
+	if (index == staging_ring_size) {
+		return;
+	}
+
+	StagingSlot& slot = slots[index];
+
+	if (!requests.empty()) {
+		slot.request = std::move(requests.front());
+		requests.pop_front();
+	} else {
+		char path[1024];
+		std::snprintf(path, sizeof(path), recording_pattern.c_str(), recording_index++);
+
+		slot.request = CaptureRequest{.path = path, .format = recording_format};
+	}
+
+	const VkImageSubresourceRange range{
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.levelCount = 1,
+		.layerCount = 1,
+	};
+
+	VkImageMemoryBarrier to_transfer{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+		.oldLayout = capture_layout,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = range,
+	};
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	                     0, nullptr, 0, nullptr, 1, &to_transfer);
+
+	VkBufferImageCopy region{
+		.imageSubresource = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.layerCount = 1,
+		},
+		.imageExtent = {capture_extent.width, capture_extent.height, 1},
+	};
+
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	                       slot.buffer, 1, &region);
+
+	VkImageMemoryBarrier to_final{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = 0,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		.newLayout = capture_layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = range,
+	};
+
+	VkBufferMemoryBarrier to_host{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = slot.buffer,
+		.size = VK_WHOLE_SIZE,
+	};
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+	                     0, nullptr, 1, &to_host, 1, &to_final);
+
+	{
+		std::lock_guard lock(writer_mutex);
+		slot.busy = true;
+	}
+
+	slot.point = {};
+	recorded_slot = index;
+}
+
+void veekay::internal::submitCapture(TimelinePoint point) {
+	if (recorded_slot == UINT_MAX) {
+		return;
+	}
+
+	slots[recorded_slot].point = point;
+	in_flight.push_back(recorded_slot);
+	recorded_slot = UINT_MAX;
+}
+
+void veekay::internal::pollCaptures() {
+	while (!in_flight.empty() && veekay::isComplete(slots[in_flight.front()].point)) {
+		const uint32_t index = in_flight.front();
+		in_flight.pop_front();
+
+		finishSlot(index);
+	}
+}
+
+void veekay::internal::shutdownCapture() {
+	VkDevice device = veekay::app.vk_device;
+
+	// NOTE: Device is idle by now, hand out whatever is left
+	while (!in_flight.empty()) {
+		const uint32_t index = in_flight.front();
+		in_flight.pop_front();
+
+		finishSlot(index);
+	}
+
+	requests.clear();
+
+	if (writer_thread.joinable()) {
+		{
+			std::lock_guard lock(writer_mutex);
+			writer_quit = true;
+		}
+
+		writer_condition.notify_all();
+		writer_thread.join();
+	}
+
+	for (StagingSlot& slot : slots) {
+		vkDestroyBuffer(device, slot.buffer, nullptr);
+		veekay::freeMemory(slot.memory);
+		slot = {};
+	}
+}
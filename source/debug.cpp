@@ -0,0 +1,72 @@
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/debug.hpp>
+
+#include "internal.hpp"
+
+#ifdef VEEKAY_DEBUG_LABELS
+
+namespace {
+
+// NOTE: Stay null when VK_EXT_debug_utils is not enabled, labels become no-ops
+PFN_vkSetDebugUtilsObjectNameEXT set_object_name;
+PFN_vkCmdBeginDebugUtilsLabelEXT cmd_begin_label;
+PFN_vkCmdEndDebugUtilsLabelEXT cmd_end_label;
+
+} // namespace
+
+void veekay::internal::initDebugLabels(VkInstance instance, bool available) {
+	if (!available) {
+		return;
+	}
+
+	set_object_name = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(
+		vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+	cmd_begin_label = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(
+		vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+	cmd_end_label = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(
+		vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+}
+
+void veekay::setObjectName(VkObjectType type, uint64_t handle, const char* name) {
+	if (!set_object_name || !handle) {
+		return;
+	}
+
+	VkDebugUtilsObjectNameInfoEXT info{
+		.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+		.objectType = type,
+		.objectHandle = handle,
+		.pObjectName = name,
+	};
+
+	set_object_name(app.vk_device, &info);
+}
+
+void veekay::beginLabel(VkCommandBuffer cmd, const char* name) {
+	if (!cmd_begin_label) {
+		return;
+	}
+
+	VkDebugUtilsLabelEXT label{
+		.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
+		.pLabelName = name,
+	};
+
+	cmd_begin_label(cmd, &label);
+}
+
+void veekay::endLabel(VkCommandBuffer cmd) {
+	if (cmd_end_label) {
+		cmd_end_label(cmd);
+	}
+}
+
+#else
+
+void veekay::internal::initDebugLabels(VkInstance, bool) {}
+
+#endif
@@ -0,0 +1,553 @@
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/depth_pyramid.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/object_cache.hpp>
+#include <veekay/memory.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+#ifdef VEEKAY_HAS_DEPTH_PYRAMID
+constexpr uint32_t depth_pyramid_spv[] = {
+#include "depth_pyramid.comp.inc"
+};
+#endif
+
+constexpr uint32_t group_size = 8;
+
+// NOTE: Must match declaration order of PyramidConstants in depth_pyramid.comp
+struct PyramidConstants {
+	int32_t source_size[2];
+	int32_t destination_size[2];
+};
+
+veekay::DepthPyramid pyramid;
+
+VkImage pyramid_image;
+VkDeviceMemory pyramid_memory;
+// NOTE: Single level views, written as storage images and read by the next level
+std::vector<VkImageView> level_views;
+
+VkExtent2D depth_extent;
+// NOTE: Depth aspect only, combined depth stencil views can not be sampled
+VkImageView depth_view;
+
+VkDescriptorSetLayout descriptor_set_layout;
+VkDescriptorPool descriptor_pool;
+// NOTE: One per level
+std::vector<VkDescriptorSet> descriptor_sets;
+VkPipelineLayout pipeline_layout;
+VkPipeline pipeline;
+
+uint32_t previousPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
+	while (result <= value / 2) {
+		result *= 2;
+	}
+	return result;
+}
+
+VkExtent2D levelExtent(uint32_t level) {
+	return {std::max(1u, pyramid.width >> level), std::max(1u, pyramid.height >> level)};
+}
+
+bool createImage() {
+	VkDevice device = veekay::app.vk_device;
+
+	VkImageCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = VK_FORMAT_R32_SFLOAT,
+		.extent = {pyramid.width, pyramid.height, 1},
+		.mipLevels = pyramid.mip_count,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		// NOTE: Transfer is only for the initial clear
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+		         VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	if (vkCreateImage(device, &info, nullptr, &pyramid_image) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan depth pyramid image\n";
+		return false;
+	}
+
+	veekay::setObjectName(VK_OBJECT_TYPE_IMAGE, (uint64_t)pyramid_image, "depth pyramid");
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, pyramid_image, &requirements);
+
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(veekay::app.vk_physical_device, &properties);
+
+	uint32_t index = UINT_MAX;
+	for (uint32_t i = 0; i < properties.memoryTypeCount && index == UINT_MAX; ++i) {
+		if ((requirements.memoryTypeBits & (1 << i)) &&
+		    (properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			index = i;
+		}
+	}
+
+	if (index == UINT_MAX) {
+		std::cerr << "Failed to find device local memory for depth pyramid\n";
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocate_info{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = index,
+	};
+
+	if (veekay::allocateMemory(allocate_info, veekay::MemoryCategory::render_target, &pyramid_memory) != VK_SUCCESS ||
+	    vkBindImageMemory(device, pyramid_image, pyramid_memory, 0) != VK_SUCCESS) {
+		std::cerr << "Failed to allocate Vulkan depth pyramid memory\n";
+		return false;
+	}
+
+	VkImageViewCreateInfo view_info{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = pyramid_image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = VK_FORMAT_R32_SFLOAT,
+		.subresourceRange = {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = pyramid.mip_count,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+	};
+
+	if (vkCreateImageView(device, &view_info, nullptr, &pyramid.view) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan depth pyramid image view\n";
+		return false;
+	}
+
+	level_views.resize(pyramid.mip_count);
+
+	for (uint32_t i = 0; i < pyramid.mip_count; ++i) {
+		view_info.subresourceRange.baseMipLevel = i;
+		view_info.subresourceRange.levelCount = 1;
+
+		if (vkCreateImageView(device, &view_info, nullptr, &level_views[i]) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan depth pyramid level view " << i << '\n';
+			return false;
+		}
+	}
+
+	VkSamplerCreateInfo sampler_info{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_NEAREST,
+		.minFilter = VK_FILTER_NEAREST,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.minLod = 0.0f,
+		.maxLod = VK_LOD_CLAMP_NONE,
+	};
+
+	pyramid.sampler = veekay::cachedSampler(sampler_info);
+	if (!pyramid.sampler) {
+		std::cerr << "Failed to create Vulkan depth pyramid sampler\n";
+		return false;
+	}
+
+	return true;
+}
+
+// NOTE: Fill the pyramid with far depth, so first frame hides nothing,
+//       and leave it in the layout the render graph expects it in
+bool clearImage() {
+	VkDevice device = veekay::app.vk_device;
+
+	VkCommandPool pool;
+
+	VkCommandPoolCreateInfo pool_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = veekay::app.vk_graphics_queue_family,
+	};
+
+	if (vkCreateCommandPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan command pool for depth pyramid\n";
+		return false;
+	}
+
+	VkCommandBuffer cmd;
+
+	VkCommandBufferAllocateInfo allocate_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+
+	if (vkAllocateCommandBuffers(device, &allocate_info, &cmd) != VK_SUCCESS) {
+		std::cerr << "Failed to allocate Vulkan command buffer for depth pyramid\n";
+		vkDestroyCommandPool(device, pool, nullptr);
+		return false;
+	}
+
+	VkCommandBufferBeginInfo begin_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	vkBeginCommandBuffer(cmd, &begin_info);
+
+	VkImageSubresourceRange range{
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = pyramid.mip_count,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	};
+
+	VkImageMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = pyramid_image,
+		.subresourceRange = range,
+	};
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	                     0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkClearColorValue far_depth{.float32 = {1.0f, 1.0f, 1.0f, 1.0f}};
+	vkCmdClearColorImage(cmd, pyramid_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                     &far_depth, 1, &range);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+	                     0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkEndCommandBuffer(cmd);
+
+	veekay::wait(veekay::submit(veekay::Queue::graphics, cmd));
+
+	vkDestroyCommandPool(device, pool, nullptr);
+
+	return true;
+}
+
+bool createPipeline() {
+#ifdef VEEKAY_HAS_DEPTH_PYRAMID
+	VkDevice device = veekay::app.vk_device;
+
+	{
+		VkDescriptorSetLayoutBinding bindings[] = {
+			{
+				.binding = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			{
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		};
+
+		VkDescriptorSetLayoutCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 2,
+			.pBindings = bindings,
+		};
+
+		descriptor_set_layout = veekay::cachedDescriptorSetLayout(info);
+		if (!descriptor_set_layout) {
+			std::cerr << "Failed to create Vulkan depth pyramid descriptor set layout\n";
+			return false;
+		}
+	}
+
+	{
+		VkDescriptorPoolSize sizes[] = {
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramid.mip_count},
+			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramid.mip_count},
+		};
+
+		VkDescriptorPoolCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = pyramid.mip_count,
+			.poolSizeCount = 2,
+			.pPoolSizes = sizes,
+		};
+
+		if (vkCreateDescriptorPool(device, &info, nullptr, &descriptor_pool) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan depth pyramid descriptor pool\n";
+			return false;
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(pyramid.mip_count, descriptor_set_layout);
+		descriptor_sets.resize(pyramid.mip_count);
+
+		VkDescriptorSetAllocateInfo allocate_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = descriptor_pool,
+			.descriptorSetCount = pyramid.mip_count,
+			.pSetLayouts = layouts.data(),
+		};
+
+		if (vkAllocateDescriptorSets(device, &allocate_info, descriptor_sets.data()) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate Vulkan depth pyramid descriptor sets\n";
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < pyramid.mip_count; ++i) {
+		// NOTE: Level 0 reads depth the render graph left for sampling,
+		//       other levels read the previous one while the pass keeps them in general
+		VkDescriptorImageInfo source{
+			.sampler = pyramid.sampler,
+			.imageView = i == 0 ? depth_view : level_views[i - 1],
+			.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
+		};
+
+		VkDescriptorImageInfo destination{
+			.imageView = level_views[i],
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+		};
+
+		VkWriteDescriptorSet writes[] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = descriptor_sets[i],
+				.dstBinding = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &source,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = descriptor_sets[i],
+				.dstBinding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = &destination,
+			},
+		};
+
+		vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+	}
+
+	{
+		VkPushConstantRange push_constants{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.size = sizeof(PyramidConstants),
+		};
+
+		VkPipelineLayoutCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &descriptor_set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constants,
+		};
+
+		pipeline_layout = veekay::cachedPipelineLayout(info);
+		if (!pipeline_layout) {
+			std::cerr << "Failed to create Vulkan depth pyramid pipeline layout\n";
+			return false;
+		}
+	}
+
+	{
+		VkShaderModuleCreateInfo module_info{
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = sizeof(depth_pyramid_spv),
+			.pCode = depth_pyramid_spv,
+		};
+
+		VkShaderModule module;
+		if (vkCreateShaderModule(device, &module_info, nullptr, &module) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan depth pyramid shader module\n";
+			return false;
+		}
+
+		VkComputePipelineCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = {
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+				.module = module,
+				.pName = "main",
+			},
+			.layout = pipeline_layout,
+		};
+
+		const VkResult result = vkCreateComputePipelines(device, nullptr, 1, &info, nullptr, &pipeline);
+		vkDestroyShaderModule(device, module, nullptr);
+
+		if (result != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan depth pyramid pipeline\n";
+			return false;
+		}
+
+		veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipeline, "depth pyramid");
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // namespace
+
+const veekay::DepthPyramid& veekay::depthPyramid() {
+	return pyramid;
+}
+
+bool veekay::internal::depthPyramidAvailable() {
+#ifdef VEEKAY_HAS_DEPTH_PYRAMID
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool veekay::internal::initDepthPyramid(VkImage depth_image, VkFormat depth_format, VkExtent2D extent) {
+	depth_extent = extent;
+
+	pyramid.width = previousPowerOfTwo(extent.width);
+	pyramid.height = previousPowerOfTwo(extent.height);
+	pyramid.mip_count = 1;
+
+	while ((std::max(pyramid.width, pyramid.height) >> pyramid.mip_count) > 0) {
+		++pyramid.mip_count;
+	}
+
+	{
+		VkImageViewCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = depth_image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = depth_format,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+
+		if (vkCreateImageView(veekay::app.vk_device, &info, nullptr, &depth_view) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan depth view for depth pyramid\n";
+			return false;
+		}
+	}
+
+	if (!createImage() || !clearImage()) {
+		return false;
+	}
+
+	if (!createPipeline()) {
+		std::cerr << "Failed to set up depth pyramid pipeline\n";
+		return false;
+	}
+
+	return true;
+}
+
+VkImage veekay::internal::depthPyramidImage() {
+	return pyramid_image;
+}
+
+void veekay::internal::recordDepthPyramid(VkCommandBuffer cmd) {
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	for (uint32_t i = 0; i < pyramid.mip_count; ++i) {
+		const VkExtent2D source = i == 0 ? depth_extent : levelExtent(i - 1);
+		const VkExtent2D destination = levelExtent(i);
+
+		const PyramidConstants constants{
+			.source_size = {int32_t(source.width), int32_t(source.height)},
+			.destination_size = {int32_t(destination.width), int32_t(destination.height)},
+		};
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout,
+		                        0, 1, &descriptor_sets[i], 0, nullptr);
+		vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+		                   0, sizeof(constants), &constants);
+		vkCmdDispatch(cmd, (destination.width + group_size - 1) / group_size,
+		              (destination.height + group_size - 1) / group_size, 1);
+
+		if (i + 1 == pyramid.mip_count) {
+			break;
+		}
+
+		// NOTE: Next level reads this one, render graph handles the rest
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = pyramid_image,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = i,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
+
+void veekay::internal::shutdownDepthPyramid() {
+	VkDevice device = veekay::app.vk_device;
+
+	// NOTE: Layouts and sampler belong to the object cache
+	vkDestroyPipeline(device, pipeline, nullptr);
+	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+
+	vkDestroyImageView(device, pyramid.view, nullptr);
+
+	for (VkImageView view : level_views) {
+		vkDestroyImageView(device, view, nullptr);
+	}
+
+	vkDestroyImage(device, pyramid_image, nullptr);
+	veekay::freeMemory(pyramid_memory);
+
+	vkDestroyImageView(device, depth_view, nullptr);
+
+	level_views.clear();
+	descriptor_sets.clear();
+	pyramid = {};
+}
@@ -0,0 +1,206 @@
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/draw_queue.hpp>
+
+namespace {
+
+// NOTE: Key layout from the most significant bit: pipeline, descriptor set, mesh, depth
+constexpr uint32_t pipeline_bits = 12;
+constexpr uint32_t descriptor_bits = 10;
+constexpr uint32_t mesh_bits = 18;
+constexpr uint32_t depth_bits = 24;
+
+constexpr uint32_t mesh_shift = depth_bits;
+constexpr uint32_t descriptor_shift = mesh_shift + mesh_bits;
+constexpr uint32_t pipeline_shift = descriptor_shift + descriptor_bits;
+
+static_assert(pipeline_shift + pipeline_bits == 64);
+
+constexpr uint32_t radix_bits = 8;
+constexpr uint32_t radix_size = 1 << radix_bits;
+constexpr uint32_t radix_passes = 64 / radix_bits;
+
+// NOTE: Least significant digit first, so it is stable and equal keys keep
+//       submission order. Digits every key agrees on are skipped. Runs on the
+//       calling thread: tens of thousands of draws sort well under a millisecond,
+//       handing passes to the job pool would tie the frame to whatever it is compiling
+template <typename Entry>
+void radixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch) {
+	const size_t count = entries.size();
+	if (count < 2) {
+		return;
+	}
+
+	scratch.resize(count);
+
+	uint64_t varying = 0;
+	for (const Entry& entry : entries) {
+		varying |= entry.key ^ entries[0].key;
+	}
+
+	Entry* source = entries.data();
+	Entry* destination = scratch.data();
+
+	uint32_t offsets[radix_size];
+
+	for (uint32_t pass = 0; pass < radix_passes; ++pass) {
+		const uint32_t shift = pass * radix_bits;
+		if (!((varying >> shift) & (radix_size - 1))) {
+			continue;
+		}
+
+		std::fill(std::begin(offsets), std::end(offsets), 0);
+		for (size_t i = 0; i < count; ++i) {
+			++offsets[(source[i].key >> shift) & (radix_size - 1)];
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < radix_size; ++digit) {
+			const uint32_t digit_count = offsets[digit];
+			offsets[digit] = offset;
+			offset += digit_count;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			destination[offsets[(source[i].key >> shift) & (radix_size - 1)]++] = source[i];
+		}
+
+		std::swap(source, destination);
+	}
+
+	if (source != entries.data()) {
+		entries.swap(scratch);
+	}
+}
+
+} // namespace
+
+uint32_t veekay::DrawQueue::stateId(std::unordered_map<uint64_t, uint32_t>& ids,
+                                    uint64_t handle, uint32_t bits) {
+	auto it = ids.try_emplace(handle, static_cast<uint32_t>(ids.size())).first;
+
+	// NOTE: Ids only group equal state. When they run out, start over,
+	//       which costs a frame of worse ordering at most
+	if (ids.size() > (size_t(1) << bits)) {
+		ids.clear();
+		it = ids.emplace(handle, 0).first;
+	}
+
+	return it->second;
+}
+
+void veekay::DrawQueue::submit(const DrawPacket& packet) {
+	const uint32_t index = static_cast<uint32_t>(packets.size());
+
+	packets.push_back(packet);
+	packets.back().push_constants = nullptr;
+
+	push_constant_offsets.push_back(static_cast<uint32_t>(push_constant_data.size()));
+
+	if (packet.push_constants_size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(packet.push_constants);
+		push_constant_data.insert(push_constant_data.end(), bytes, bytes + packet.push_constants_size);
+	}
+
+	const uint64_t mesh_handle = (uint64_t)packet.vertex_buffer * 0x9e3779b97f4a7c15ull ^
+	                             (uint64_t)packet.index_buffer;
+
+	const uint64_t pipeline = stateId(pipeline_ids, (uint64_t)packet.pipeline, pipeline_bits);
+	const uint64_t descriptor = stateId(descriptor_ids, (uint64_t)packet.descriptor_set, descriptor_bits);
+	const uint64_t mesh = stateId(mesh_ids, mesh_handle, mesh_bits);
+
+	const float depth_scale = float((1u << depth_bits) - 1);
+	const uint64_t depth = uint64_t(std::clamp(packet.depth, 0.0f, 1.0f) * depth_scale);
+
+	entries.push_back(SortEntry{
+		.key = pipeline << pipeline_shift | descriptor << descriptor_shift | mesh << mesh_shift | depth,
+		.packet = index,
+	});
+}
+
+void veekay::DrawQueue::flush(VkCommandBuffer cmd) {
+	last_stats = {};
+
+	radixSort(entries, scratch);
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+	VkBuffer vertex_buffer = VK_NULL_HANDLE;
+	VkDeviceSize vertex_offset = 0;
+	VkBuffer index_buffer = VK_NULL_HANDLE;
+	VkDeviceSize index_offset = 0;
+
+	for (const SortEntry& entry : entries) {
+		const DrawPacket& packet = packets[entry.packet];
+
+		last_stats.submitted_binds += 1 + (packet.descriptor_set != VK_NULL_HANDLE) +
+		                              (packet.vertex_buffer != VK_NULL_HANDLE) +
+		                              (packet.index_buffer != VK_NULL_HANDLE);
+
+		if (packet.pipeline != pipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+			pipeline = packet.pipeline;
+			++last_stats.pipeline_binds;
+		}
+
+		// NOTE: Sets bound through another layout may be disturbed, bind again
+		if (packet.layout != layout) {
+			layout = packet.layout;
+			descriptor_set = VK_NULL_HANDLE;
+		}
+
+		if (packet.descriptor_set && packet.descriptor_set != descriptor_set) {
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.layout,
+			                        0, 1, &packet.descriptor_set, 0, nullptr);
+			descriptor_set = packet.descriptor_set;
+			++last_stats.descriptor_binds;
+		}
+
+		if (packet.vertex_buffer &&
+		    (packet.vertex_buffer != vertex_buffer || packet.vertex_offset != vertex_offset)) {
+			vkCmdBindVertexBuffers(cmd, 0, 1, &packet.vertex_buffer, &packet.vertex_offset);
+			vertex_buffer = packet.vertex_buffer;
+			vertex_offset = packet.vertex_offset;
+			++last_stats.vertex_binds;
+		}
+
+		if (packet.index_buffer &&
+		    (packet.index_buffer != index_buffer || packet.index_offset != index_offset)) {
+			vkCmdBindIndexBuffer(cmd, packet.index_buffer, packet.index_offset, VK_INDEX_TYPE_UINT32);
+			index_buffer = packet.index_buffer;
+			index_offset = packet.index_offset;
+			++last_stats.index_binds;
+		}
+
+		if (packet.push_constants_size) {
+			vkCmdPushConstants(cmd, packet.layout, packet.push_constant_stages, 0, packet.push_constants_size,
+			                   push_constant_data.data() + push_constant_offsets[entry.packet]);
+		}
+
+		if (packet.indirect_buffer) {
+			vkCmdDrawIndexedIndirect(cmd, packet.indirect_buffer, packet.indirect_offset, 1,
+			                         sizeof(VkDrawIndexedIndirectCommand));
+		} else if (packet.vertex_count) {
+			vkCmdDraw(cmd, packet.vertex_count, 1, 0, 0);
+		} else {
+			vkCmdDrawIndexed(cmd, packet.index_count, 1, 0, 0, 0);
+		}
+
+		++last_stats.draws;
+	}
+
+	last_stats.recorded_binds = last_stats.pipeline_binds + last_stats.descriptor_binds +
+	                            last_stats.vertex_binds + last_stats.index_binds;
+
+	packets.clear();
+	push_constant_offsets.clear();
+	push_constant_data.clear();
+	entries.clear();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace veekay::internal {
+
+constexpr uint64_t hash_seed = 14695981039346656037ull;
+
+// NOTE: FNV-1a, good enough for cache keys and change detection
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = hash_seed) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+template <typename T>
+inline uint64_t hashValue(const T& value, uint64_t hash = hash_seed) {
+	return hashBytes(&value, sizeof(T), hash);
+}
+
+} // namespace veekay::internal
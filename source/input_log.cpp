@@ -0,0 +1,278 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include <veekay/arena.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+constexpr char log_magic[4] = {'V', 'K', 'I', 'L'};
+constexpr uint32_t log_version = 1;
+
+struct LogHeader {
+	char magic[4];
+	uint32_t version;
+	// NOTE: Time before the first frame, simulation steps of the first
+	//       frame depend on it
+	double start_time;
+};
+
+// NOTE: One per frame, UI frames are followed by event_count events
+struct FrameRecord {
+	double time;
+	float delta_time;
+	float display_size[2];
+	float framebuffer_scale[2];
+	uint16_t event_count;
+	uint8_t focused;
+	uint8_t ui;
+};
+
+static_assert(sizeof(FrameRecord) == 32);
+
+// NOTE: ImGuiInputEvent squeezed into fixed fields, meaning depends on type:
+//       mouse position and wheel use x and y, mouse buttons and keys put their
+//       index into value, text puts the character there
+struct EventRecord {
+	uint8_t type;
+	uint8_t mouse_source;
+	uint8_t down;
+	uint8_t padding;
+	uint32_t value;
+	float x;
+	float y;
+};
+
+static_assert(sizeof(EventRecord) == 16);
+
+FILE* record_file;
+// NOTE: Events queued by ImGui get increasing ids, the ones a previous
+//       frame left in the queue are already in the log
+uint32_t last_recorded_event;
+
+FILE* replay_file;
+FrameRecord replayed_frame;
+std::vector<EventRecord> replayed_events;
+uint64_t replayed_frame_count;
+
+FILE* openLog(const char* path, const char* mode) {
+	FILE* file = std::fopen(path, mode);
+	if (!file) {
+		std::cerr << "Failed to open input log: " << path << '\n';
+	}
+
+	return file;
+}
+
+bool recordEvent(const ImGuiInputEvent& event, EventRecord& record) {
+	record = EventRecord{.type = static_cast<uint8_t>(event.Type)};
+
+	switch (event.Type) {
+	case ImGuiInputEventType_MousePos:
+		record.mouse_source = static_cast<uint8_t>(event.MousePos.MouseSource);
+		record.x = event.MousePos.PosX;
+		record.y = event.MousePos.PosY;
+		return true;
+
+	case ImGuiInputEventType_MouseWheel:
+		record.mouse_source = static_cast<uint8_t>(event.MouseWheel.MouseSource);
+		record.x = event.MouseWheel.WheelX;
+		record.y = event.MouseWheel.WheelY;
+		return true;
+
+	case ImGuiInputEventType_MouseButton:
+		record.mouse_source = static_cast<uint8_t>(event.MouseButton.MouseSource);
+		record.down = event.MouseButton.Down;
+		record.value = static_cast<uint32_t>(event.MouseButton.Button);
+		return true;
+
+	case ImGuiInputEventType_Key:
+		record.down = event.Key.Down;
+		record.value = static_cast<uint32_t>(event.Key.Key);
+		record.x = event.Key.AnalogValue;
+		return true;
+
+	case ImGuiInputEventType_Text:
+		record.value = event.Text.Char;
+		return true;
+
+	case ImGuiInputEventType_Focus:
+		record.down = event.AppFocused.Focused;
+		return true;
+
+	default:
+		// NOTE: Viewport events only exist with multi-viewports
+		return false;
+	}
+}
+
+void replayEvent(ImGuiIO& io, const EventRecord& record) {
+	switch (record.type) {
+	case ImGuiInputEventType_MousePos:
+		io.AddMouseSourceEvent(static_cast<ImGuiMouseSource>(record.mouse_source));
+		io.AddMousePosEvent(record.x, record.y);
+		break;
+
+	case ImGuiInputEventType_MouseWheel:
+		io.AddMouseSourceEvent(static_cast<ImGuiMouseSource>(record.mouse_source));
+		io.AddMouseWheelEvent(record.x, record.y);
+		break;
+
+	case ImGuiInputEventType_MouseButton:
+		io.AddMouseSourceEvent(static_cast<ImGuiMouseSource>(record.mouse_source));
+		io.AddMouseButtonEvent(static_cast<int>(record.value), record.down);
+		break;
+
+	case ImGuiInputEventType_Key:
+		io.AddKeyAnalogEvent(static_cast<ImGuiKey>(record.value), record.down, record.x);
+		break;
+
+	case ImGuiInputEventType_Text:
+		io.AddInputCharacter(record.value);
+		break;
+
+	case ImGuiInputEventType_Focus:
+		io.AddFocusEvent(record.down);
+		break;
+	}
+}
+
+} // namespace
+
+bool veekay::internal::initInputLog(const char* record_path, const char* replay_path, double& start_time) {
+	if (record_path) {
+		record_file = openLog(record_path, "wb");
+		if (!record_file) {
+			return false;
+		}
+
+		LogHeader header{
+			.version = log_version,
+			.start_time = start_time,
+		};
+		std::memcpy(header.magic, log_magic, sizeof(log_magic));
+
+		std::fwrite(&header, sizeof(header), 1, record_file);
+	}
+
+	if (replay_path) {
+		replay_file = openLog(replay_path, "rb");
+		if (!replay_file) {
+			return false;
+		}
+
+		LogHeader header;
+		if (std::fread(&header, sizeof(header), 1, replay_file) != 1 ||
+		    std::memcmp(header.magic, log_magic, sizeof(log_magic)) != 0 ||
+		    header.version != log_version) {
+			std::cerr << "Not a veekay input log of version " << log_version << ": " << replay_path << '\n';
+			return false;
+		}
+
+		start_time = header.start_time;
+	}
+
+	return true;
+}
+
+bool veekay::internal::replayFrame(double& time, bool& focused, bool& ui) {
+	if (std::fread(&replayed_frame, sizeof(replayed_frame), 1, replay_file) != 1) {
+		std::cerr << "Input log ended after " << replayed_frame_count << " frames\n";
+		return false;
+	}
+
+	replayed_events.resize(replayed_frame.event_count);
+
+	if (replayed_frame.event_count &&
+	    std::fread(replayed_events.data(), sizeof(EventRecord),
+	               replayed_events.size(), replay_file) != replayed_events.size()) {
+		std::cerr << "Truncated input log at frame " << replayed_frame_count << '\n';
+		return false;
+	}
+
+	++replayed_frame_count;
+
+	time = replayed_frame.time;
+	focused = replayed_frame.focused;
+	ui = replayed_frame.ui;
+
+	return true;
+}
+
+void veekay::internal::replayInput() {
+	ImGuiIO& io = ImGui::GetIO();
+
+	io.DeltaTime = replayed_frame.delta_time;
+	io.DisplaySize = ImVec2(replayed_frame.display_size[0], replayed_frame.display_size[1]);
+	io.DisplayFramebufferScale = ImVec2(replayed_frame.framebuffer_scale[0], replayed_frame.framebuffer_scale[1]);
+
+	for (const EventRecord& record : replayed_events) {
+		replayEvent(io, record);
+	}
+}
+
+void veekay::internal::recordFrame(double time, bool focused, bool ui) {
+	if (!record_file) {
+		return;
+	}
+
+	FrameRecord frame{
+		.time = time,
+		.focused = focused,
+		.ui = ui,
+	};
+
+	std::pmr::vector<EventRecord> events(&veekay::frameArena());
+
+	if (ui) {
+		const ImGuiIO& io = ImGui::GetIO();
+
+		frame.delta_time = io.DeltaTime;
+		frame.display_size[0] = io.DisplaySize.x;
+		frame.display_size[1] = io.DisplaySize.y;
+		frame.framebuffer_scale[0] = io.DisplayFramebufferScale.x;
+		frame.framebuffer_scale[1] = io.DisplayFramebufferScale.y;
+
+		for (const ImGuiInputEvent& event : ImGui::GetCurrentContext()->InputEventsQueue) {
+			if (event.EventId <= last_recorded_event) {
+				continue;
+			}
+
+			// NOTE: Whatever does not fit is recorded with the next frame
+			if (events.size() == UINT16_MAX) {
+				break;
+			}
+
+			last_recorded_event = event.EventId;
+
+			EventRecord record;
+			if (recordEvent(event, record)) {
+				events.push_back(record);
+			}
+		}
+
+		frame.event_count = static_cast<uint16_t>(events.size());
+	}
+
+	std::fwrite(&frame, sizeof(frame), 1, record_file);
+	std::fwrite(events.data(), sizeof(EventRecord), events.size(), record_file);
+}
+
+void veekay::internal::shutdownInputLog() {
+	if (record_file) {
+		std::fclose(record_file);
+		record_file = nullptr;
+	}
+
+	if (replay_file) {
+		std::fclose(replay_file);
+		replay_file = nullptr;
+	}
+}
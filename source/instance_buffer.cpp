@@ -0,0 +1,524 @@
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <algorithm>
+#include <memory_resource>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/instance_buffer.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/object_cache.hpp>
+#include <veekay/memory.hpp>
+#include <veekay/arena.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+#ifdef VEEKAY_HAS_INSTANCE_SCATTER
+constexpr uint32_t instance_scatter_spv[] = {
+#include "instance_scatter.comp.inc"
+};
+#endif
+
+// NOTE: Enough for every frame in flight to carry an upload, plus slack
+//       for the one being recorded
+constexpr uint32_t upload_slot_count = 4;
+
+// NOTE: Upload buffers start this big and grow to the next power of two
+constexpr VkDeviceSize min_upload_size = 4096;
+
+constexpr uint32_t group_size = 64;
+// NOTE: Guaranteed maxComputeWorkGroupCount, larger uploads take several dispatches
+constexpr uint32_t max_dispatch_words = 65535 * group_size;
+
+// NOTE: Must match declaration order of ScatterConstants in instance_scatter.comp
+struct ScatterConstants {
+	uint32_t record_count;
+	uint32_t record_words;
+	uint32_t first_word;
+};
+
+// NOTE: Shared by every instance buffer, null when scatter falls back to copies
+VkDescriptorSetLayout scatter_descriptor_layout;
+VkPipelineLayout scatter_pipeline_layout;
+VkPipeline scatter_pipeline;
+
+uint32_t findMemoryType(uint32_t type_bits, VkMemoryPropertyFlags flags) {
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(veekay::app.vk_physical_device, &properties);
+
+	for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+		if ((type_bits & (1 << i)) && (properties.memoryTypes[i].propertyFlags & flags) == flags) {
+			return i;
+		}
+	}
+
+	return UINT_MAX;
+}
+
+bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags,
+                  veekay::MemoryCategory category, VkBuffer& buffer, VkDeviceMemory& memory) {
+	VkDevice device = veekay::app.vk_device;
+
+	VkBufferCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+
+	if (vkCreateBuffer(device, &info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan instance buffer\n";
+		return false;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+	const uint32_t index = findMemoryType(requirements.memoryTypeBits, flags);
+	if (index == UINT_MAX) {
+		std::cerr << "Failed to find memory type for Vulkan instance buffer\n";
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocate_info{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = index,
+	};
+
+	if (veekay::allocateMemory(allocate_info, category, &memory) != VK_SUCCESS ||
+	    vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS) {
+		std::cerr << "Failed to allocate Vulkan instance buffer memory\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool createScatterPipeline() {
+#ifdef VEEKAY_HAS_INSTANCE_SCATTER
+	VkDevice device = veekay::app.vk_device;
+
+	{
+		VkDescriptorSetLayoutBinding bindings[2];
+
+		for (uint32_t i = 0; i < 2; ++i) {
+			bindings[i] = VkDescriptorSetLayoutBinding{
+				.binding = i,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			};
+		}
+
+		VkDescriptorSetLayoutCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 2,
+			.pBindings = bindings,
+		};
+
+		scatter_descriptor_layout = veekay::cachedDescriptorSetLayout(info);
+		if (!scatter_descriptor_layout) {
+			std::cerr << "Failed to create Vulkan instance scatter descriptor set layout\n";
+			return false;
+		}
+	}
+
+	{
+		VkPushConstantRange push_constants{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.size = sizeof(ScatterConstants),
+		};
+
+		VkPipelineLayoutCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &scatter_descriptor_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constants,
+		};
+
+		scatter_pipeline_layout = veekay::cachedPipelineLayout(info);
+		if (!scatter_pipeline_layout) {
+			std::cerr << "Failed to create Vulkan instance scatter pipeline layout\n";
+			return false;
+		}
+	}
+
+	{
+		VkShaderModuleCreateInfo module_info{
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = sizeof(instance_scatter_spv),
+			.pCode = instance_scatter_spv,
+		};
+
+		VkShaderModule module;
+		if (vkCreateShaderModule(device, &module_info, nullptr, &module) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan instance scatter shader module\n";
+			return false;
+		}
+
+		// NOTE: Not cached, the module is gone right after and its handle may be reused
+		VkComputePipelineCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = {
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+				.module = module,
+				.pName = "main",
+			},
+			.layout = scatter_pipeline_layout,
+		};
+
+		const VkResult result = vkCreateComputePipelines(device, nullptr, 1, &info, nullptr, &scatter_pipeline);
+		vkDestroyShaderModule(device, module, nullptr);
+
+		if (result != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan instance scatter pipeline\n";
+			scatter_pipeline = VK_NULL_HANDLE;
+			return false;
+		}
+
+		veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)scatter_pipeline, "instance scatter");
+	}
+#endif
+
+	return true;
+}
+
+} // namespace
+
+bool veekay::InstanceBuffer::create(uint32_t record_size, uint32_t capacity, const char* name) {
+	VkDevice device = app.vk_device;
+
+	if (record_size == 0 || record_size % sizeof(uint32_t) != 0 || capacity == 0) {
+		std::cerr << "Instance records must be a non-zero multiple of 4 bytes, capacity must be non-zero\n";
+		return false;
+	}
+
+	if (!scatter_pipeline && !createScatterPipeline()) {
+		return false;
+	}
+
+	this->record_size = record_size;
+	this->capacity = capacity;
+
+	if (!createBuffer(size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::geometry,
+	                  device_buffer, device_memory)) {
+		return false;
+	}
+
+	setObjectName(VK_OBJECT_TYPE_BUFFER, (uint64_t)device_buffer, name);
+
+	slots.assign(upload_slot_count, UploadSlot{});
+
+	if (scatter_pipeline) {
+		VkDescriptorPoolSize pool_size{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * upload_slot_count};
+
+		VkDescriptorPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = upload_slot_count,
+			.poolSizeCount = 1,
+			.pPoolSizes = &pool_size,
+		};
+
+		if (vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan instance scatter descriptor pool\n";
+			return false;
+		}
+
+		for (UploadSlot& slot : slots) {
+			VkDescriptorSetAllocateInfo allocate_info{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+				.descriptorPool = descriptor_pool,
+				.descriptorSetCount = 1,
+				.pSetLayouts = &scatter_descriptor_layout,
+			};
+
+			if (vkAllocateDescriptorSets(device, &allocate_info, &slot.descriptor_set) != VK_SUCCESS) {
+				std::cerr << "Failed to allocate Vulkan instance scatter descriptor set\n";
+				return false;
+			}
+		}
+	}
+
+	records.assign(size(), 0);
+	dirty_flags.assign(capacity, 0);
+	dirty.clear();
+	dirty.reserve(capacity);
+
+	record_count = 0;
+	cleared = false;
+	last_dst_stages = 0;
+	next_slot = 0;
+	last_stats = {};
+
+	return true;
+}
+
+void veekay::InstanceBuffer::destroy() {
+	struct Resources {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+	};
+
+	std::vector<Resources> resources;
+	resources.push_back({device_buffer, device_memory});
+
+	for (const UploadSlot& slot : slots) {
+		resources.push_back({slot.buffer, slot.memory});
+	}
+
+	deferDestroy([resources = std::move(resources), pool = descriptor_pool] {
+		VkDevice device = app.vk_device;
+
+		vkDestroyDescriptorPool(device, pool, nullptr);
+
+		for (const Resources& resource : resources) {
+			vkDestroyBuffer(device, resource.buffer, nullptr);
+			freeMemory(resource.memory);
+		}
+	});
+
+	device_buffer = VK_NULL_HANDLE;
+	device_memory = VK_NULL_HANDLE;
+	descriptor_pool = VK_NULL_HANDLE;
+
+	slots.clear();
+	records.clear();
+	dirty_flags.clear();
+	dirty.clear();
+}
+
+void veekay::InstanceBuffer::write(uint32_t index, const void* record) {
+	record_count = std::max(record_count, index + 1);
+
+	uint8_t* destination = records.data() + size_t(index) * record_size;
+	if (std::memcmp(destination, record, record_size) == 0) {
+		return;
+	}
+
+	std::memcpy(destination, record, record_size);
+
+	if (!dirty_flags[index]) {
+		dirty_flags[index] = 1;
+		dirty.push_back(index);
+	}
+}
+
+bool veekay::InstanceBuffer::reserveSlot(UploadSlot& slot, VkDeviceSize bytes) {
+	if (slot.size >= bytes) {
+		return true;
+	}
+
+	releaseSlot(slot);
+
+	VkDeviceSize size = min_upload_size;
+	while (size < bytes) {
+		size *= 2;
+	}
+
+	if (!createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  MemoryCategory::staging, slot.buffer, slot.memory)) {
+		return false;
+	}
+
+	if (vkMapMemory(app.vk_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped) != VK_SUCCESS) {
+		std::cerr << "Failed to map Vulkan instance upload buffer\n";
+		return false;
+	}
+
+	slot.size = size;
+
+	if (slot.descriptor_set) {
+		VkDescriptorBufferInfo buffers[] = {
+			{slot.buffer, 0, VK_WHOLE_SIZE},
+			{device_buffer, 0, VK_WHOLE_SIZE},
+		};
+
+		VkWriteDescriptorSet write{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = slot.descriptor_set,
+			.dstBinding = 0,
+			.descriptorCount = 2,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = buffers,
+		};
+
+		vkUpdateDescriptorSets(app.vk_device, 1, &write, 0, nullptr);
+	}
+
+	return true;
+}
+
+// NOTE: GPU must be done with the slot
+void veekay::InstanceBuffer::releaseSlot(UploadSlot& slot) {
+	vkDestroyBuffer(app.vk_device, slot.buffer, nullptr);
+	freeMemory(slot.memory);
+
+	slot.buffer = VK_NULL_HANDLE;
+	slot.memory = VK_NULL_HANDLE;
+	slot.mapped = nullptr;
+	slot.size = 0;
+}
+
+bool veekay::InstanceBuffer::upload(VkCommandBuffer cmd, VkPipelineStageFlags dst_stages) {
+	const uint32_t count = static_cast<uint32_t>(dirty.size());
+	const VkDeviceSize bytes = VkDeviceSize(count) * (sizeof(uint32_t) + record_size);
+
+	last_stats = InstanceBufferStats{
+		.dirty_records = count,
+		.uploaded_bytes = bytes,
+		.full_bytes = VkDeviceSize(record_count) * record_size,
+	};
+
+	if (count == 0 && cleared) {
+		return true;
+	}
+
+	// NOTE: Slots recorded before the last submitted frame went into it or an
+	//       earlier one, waiting for it is never too early
+	const TimelinePoint last_frame = lastFrame();
+
+	for (UploadSlot& slot : slots) {
+		if (slot.busy && !slot.frame.value && last_frame.value > slot.recorded_after) {
+			slot.frame = last_frame;
+		}
+	}
+
+	UploadSlot* slot = nullptr;
+
+	if (count) {
+		slot = &slots[next_slot];
+
+		if (slot->busy) {
+			if (!slot->frame.value) {
+				std::cerr << "Instance buffer uploaded more than " << upload_slot_count << " times in one frame\n";
+				return false;
+			}
+
+			wait(slot->frame);
+			slot->busy = false;
+		}
+
+		if (!reserveSlot(*slot, bytes)) {
+			return false;
+		}
+
+		// NOTE: Indices first, packed records right after them
+		uint32_t* indices = static_cast<uint32_t*>(slot->mapped);
+		uint8_t* packed = reinterpret_cast<uint8_t*>(indices + count);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t index = dirty[i];
+
+			indices[i] = index;
+			std::memcpy(packed + size_t(i) * record_size, records.data() + size_t(index) * record_size, record_size);
+
+			dirty_flags[index] = 0;
+		}
+
+		dirty.clear();
+
+		slot->busy = true;
+		slot->recorded_after = last_frame.value;
+		slot->frame = {};
+
+		next_slot = (next_slot + 1) % upload_slot_count;
+	}
+
+	const VkPipelineStageFlags write_stage = scatter_pipeline ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+	                                                          : VK_PIPELINE_STAGE_TRANSFER_BIT;
+	const VkAccessFlags write_access = scatter_pipeline ? VK_ACCESS_SHADER_WRITE_BIT
+	                                                    : VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	// NOTE: Whatever was never written reads as zero
+	if (!cleared) {
+		vkCmdFillBuffer(cmd, device_buffer, 0, VK_WHOLE_SIZE, 0);
+		cleared = true;
+	}
+
+	if (slot) {
+		{ // NOTE: Readers of the previous upload and earlier writes finish first
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = write_access,
+			};
+
+			vkCmdPipelineBarrier(cmd, last_dst_stages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			                     write_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		if (scatter_pipeline) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scatter_pipeline);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, scatter_pipeline_layout,
+			                        0, 1, &slot->descriptor_set, 0, nullptr);
+
+			const uint32_t record_words = record_size / sizeof(uint32_t);
+			const uint32_t total_words = count * record_words;
+
+			for (uint32_t first = 0; first < total_words; first += max_dispatch_words) {
+				const ScatterConstants constants{
+					.record_count = count,
+					.record_words = record_words,
+					.first_word = first,
+				};
+
+				const uint32_t words = std::min(total_words - first, max_dispatch_words);
+
+				vkCmdPushConstants(cmd, scatter_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+				                   0, sizeof(constants), &constants);
+				vkCmdDispatch(cmd, (words + group_size - 1) / group_size, 1, 1);
+			}
+		} else {
+			const uint32_t* indices = static_cast<const uint32_t*>(slot->mapped);
+			const VkDeviceSize records_offset = VkDeviceSize(count) * sizeof(uint32_t);
+
+			std::pmr::vector<VkBufferCopy> regions(count, &frameArena());
+
+			for (uint32_t i = 0; i < count; ++i) {
+				regions[i] = VkBufferCopy{
+					.srcOffset = records_offset + VkDeviceSize(i) * record_size,
+					.dstOffset = VkDeviceSize(indices[i]) * record_size,
+					.size = record_size,
+				};
+			}
+
+			vkCmdCopyBuffer(cmd, slot->buffer, device_buffer, count, regions.data());
+		}
+	}
+
+	{ // NOTE: Make records visible to their readers
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		};
+
+		vkCmdPipelineBarrier(cmd, write_stage | VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stages,
+		                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	last_dst_stages = dst_stages;
+
+	return true;
+}
+
+void veekay::internal::shutdownInstanceBuffers() {
+	// NOTE: Layouts belong to the object cache
+	vkDestroyPipeline(app.vk_device, scatter_pipeline, nullptr);
+
+	scatter_pipeline = VK_NULL_HANDLE;
+	scatter_pipeline_layout = VK_NULL_HANDLE;
+	scatter_descriptor_layout = VK_NULL_HANDLE;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/scheduler.hpp>
+
+// NOTE: Library-private entry points, used by veekay::run to drive modules
+namespace veekay::internal {
+
+bool initScheduler();
+void shutdownScheduler();
+
+// NOTE: Submits frame command buffers on graphics queue, waiting on swapchain
+//       acquisition and points collected with waitInFrame. Signals present semaphore.
+//       Both semaphores are null in headless mode
+TimelinePoint submitFrame(const VkCommandBuffer* buffers, uint32_t buffer_count,
+                          VkSemaphore acquire_semaphore, VkSemaphore present_semaphore);
+
+// NOTE: Presents on graphics queue, holding its lock
+VkResult presentFrame(const VkPresentInfoKHR& info);
+
+// NOTE: Lock submit takes for the VkQueue behind a logical queue. Hold it around
+//       code that uses the VkQueue on its own, e.g. ImGui backend uploading textures
+std::unique_lock<std::mutex> lockQueue(Queue queue);
+
+// NOTE: Runs deferred destructions GPU is done with, never waits
+void collectDeletions();
+// NOTE: Runs every deferred destruction, device must be idle
+void flushDeletions();
+
+// NOTE: Loads VK_EXT_debug_utils entry points when the extension was enabled
+void initDebugLabels(VkInstance instance, bool available);
+
+// NOTE: Frame capture. layout is the one backbuffer is left in after the render graph
+bool initCapture(VkFormat format, VkExtent2D extent, VkImageLayout layout);
+// NOTE: Copies backbuffer into a free staging buffer if a capture is pending,
+//       record after the render graph
+void recordCapture(VkCommandBuffer cmd, VkImage image);
+// NOTE: Point of the submission the last recordCapture went into
+void submitCapture(TimelinePoint point);
+// NOTE: Hands out captures GPU has finished, never waits
+void pollCaptures();
+void shutdownCapture();
+
+// NOTE: Mesh streaming. memory_budget tells whether VK_EXT_memory_budget is enabled
+bool initStreaming(bool memory_budget);
+// NOTE: Takes finished uploads and evicts over budget, call before render
+void updateStreaming();
+// NOTE: Stops the loader, leaves buffers to deferred destruction
+void shutdownStreaming();
+
+// NOTE: Depth pyramid, available only when its shader was built with glslc.
+//       depth_image must be sampleable and outlive the pyramid
+bool depthPyramidAvailable();
+bool initDepthPyramid(VkImage depth_image, VkFormat depth_format, VkExtent2D extent);
+VkImage depthPyramidImage();
+// NOTE: Reduces depth into every level, the graph must have depth in shader read
+//       only layout and the pyramid in general layout
+void recordDepthPyramid(VkCommandBuffer cmd);
+void shutdownDepthPyramid();
+
+// NOTE: Destroys the scatter pipeline shared by instance buffers, after
+//       deferred destructions have run
+void shutdownInstanceBuffers();
+
+// NOTE: Destroys every cached object, device must be idle
+void shutdownObjectCache();
+
+// NOTE: Memory accounting. memory_budget tells whether VK_EXT_memory_budget is enabled
+void initMemory(bool memory_budget);
+// NOTE: Reports allocations never freed, call once everything is destroyed
+void shutdownMemory();
+
+// NOTE: Tracing. frame_count is the number of frames in flight, calibrated_timestamps
+//       tells whether VK_EXT_calibrated_timestamps is enabled
+bool initTracing(VkInstance instance, uint32_t frame_count, bool calibrated_timestamps);
+// NOTE: Collects GPU zones of the frame that last used this slot, which must be
+//       done, and resets its queries. Record right after the frame command buffer begins
+void beginTraceFrame(VkCommandBuffer cmd, uint32_t frame);
+// NOTE: Call right after the frame is submitted, dumps pending spikes
+void endTraceFrame();
+// NOTE: Device must be idle
+void shutdownTracing();
+
+// NOTE: Input logs hold time, focus and whether UI was rebuilt for every frame,
+//       UI frames also carry ImGui IO state and input events. Either path may be null.
+//       start_time goes into a recorded log and is replaced with a replayed one's
+bool initInputLog(const char* record_path, const char* replay_path, double& start_time);
+// NOTE: Reads the next logged frame, false once the log ends
+bool replayFrame(double& time, bool& focused, bool& ui);
+// NOTE: Sets up ImGui IO and queues input of the replayed frame, in place of
+//       the platform backend's NewFrame
+void replayInput();
+// NOTE: Appends a frame to the log being recorded, if any. On UI frames call
+//       right before ImGui::NewFrame, with the frame's input already queued
+void recordFrame(double time, bool focused, bool ui);
+void shutdownInputLog();
+
+// NOTE: Makes the calling thread's arena the frame arena, call from main thread
+void initArenas();
+// NOTE: Frame boundary: counts heap allocations of the frame that ended and
+//       resets the frame arena
+void beginArenaFrame();
+
+// NOTE: Worker pool behind veekay::async
+void initJobs();
+void waitAllJobs();
+void shutdownJobs();
+
+// NOTE: Swaps in pipelines rebuilt from edited shaders, call between frames
+void applyShaderReloads();
+void shutdownShaders();
+
+} // namespace veekay::internal
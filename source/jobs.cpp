@@ -0,0 +1,186 @@
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <veekay/jobs.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/arena.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+constexpr uint32_t max_job_workers = 8;
+
+struct Job {
+	veekay::JobFunc func;
+	std::vector<veekay::JobId> dependents;
+	// NOTE: Dependencies not done yet, job becomes ready when it drops to zero
+	uint32_t remaining;
+	bool done;
+};
+
+std::mutex job_mutex;
+std::condition_variable job_ready;
+std::condition_variable job_done;
+
+// NOTE: Job with id N lives at index N - first_job_id. Done jobs are dropped
+//       from the front, ids below first_job_id are all done. Deque keeps
+//       references to the rest stable
+std::deque<Job> jobs;
+veekay::JobId first_job_id = 1;
+std::deque<veekay::JobId> ready_jobs;
+uint32_t pending_jobs;
+
+std::vector<std::thread> job_workers;
+bool job_workers_quit;
+
+Job& jobOf(veekay::JobId id) {
+	return jobs[id - first_job_id];
+}
+
+bool jobDone(veekay::JobId id) {
+	return id < first_job_id || jobOf(id).done;
+}
+
+// NOTE: Forget finished jobs, so the queue does not keep every job ever started
+void reclaimJobs() {
+	while (!jobs.empty() && jobs.front().done) {
+		jobs.pop_front();
+		++first_job_id;
+	}
+}
+
+void jobWorkerMain() {
+	veekay::setThreadName("job worker");
+
+	std::unique_lock lock(job_mutex);
+
+	for (;;) {
+		job_ready.wait(lock, [] { return !ready_jobs.empty() || job_workers_quit; });
+
+		if (ready_jobs.empty()) {
+			break;
+		}
+
+		const veekay::JobId id = ready_jobs.front();
+		ready_jobs.pop_front();
+
+		veekay::JobFunc func = std::move(jobOf(id).func);
+
+		lock.unlock();
+		{
+			veekay::TraceZone zone("job");
+			func();
+		}
+
+		// NOTE: Whatever the job left in its arena dies with it
+		veekay::threadArena().reset();
+
+		lock.lock();
+
+		Job& job = jobOf(id);
+		job.done = true;
+		--pending_jobs;
+
+		for (veekay::JobId dependent : job.dependents) {
+			if (--jobOf(dependent).remaining == 0) {
+				ready_jobs.push_back(dependent);
+				job_ready.notify_one();
+			}
+		}
+
+		reclaimJobs();
+
+		job_done.notify_all();
+	}
+}
+
+} // namespace
+
+veekay::JobId veekay::async(JobFunc func, std::span<const JobId> dependencies) {
+	std::lock_guard lock(job_mutex);
+
+	jobs.push_back(Job{.func = std::move(func)});
+
+	const JobId id = first_job_id + static_cast<JobId>(jobs.size() - 1);
+	Job& job = jobOf(id);
+
+	for (JobId dependency : dependencies) {
+		if (!dependency || jobDone(dependency)) {
+			continue;
+		}
+
+		jobOf(dependency).dependents.push_back(id);
+		++job.remaining;
+	}
+
+	++pending_jobs;
+
+	if (job.remaining == 0) {
+		ready_jobs.push_back(id);
+		job_ready.notify_one();
+	}
+
+	return id;
+}
+
+bool veekay::isDone(JobId job) {
+	if (!job) {
+		return true;
+	}
+
+	std::lock_guard lock(job_mutex);
+	return jobDone(job);
+}
+
+void veekay::waitJob(JobId job) {
+	if (!job) {
+		return;
+	}
+
+	std::unique_lock lock(job_mutex);
+	job_done.wait(lock, [job] { return jobDone(job); });
+}
+
+void veekay::internal::initJobs() {
+	const uint32_t hardware_threads = std::thread::hardware_concurrency();
+
+	// NOTE: Main thread keeps working during init, leave a core for it
+	const uint32_t count = std::clamp(hardware_threads, 2u, max_job_workers + 1) - 1;
+
+	job_workers_quit = false;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		job_workers.emplace_back(jobWorkerMain);
+	}
+}
+
+void veekay::internal::waitAllJobs() {
+	std::unique_lock lock(job_mutex);
+	job_done.wait(lock, [] { return pending_jobs == 0; });
+}
+
+void veekay::internal::shutdownJobs() {
+	waitAllJobs();
+
+	{
+		std::lock_guard lock(job_mutex);
+		job_workers_quit = true;
+	}
+
+	job_ready.notify_all();
+
+	for (std::thread& worker : job_workers) {
+		worker.join();
+	}
+
+	job_workers.clear();
+
+	first_job_id += static_cast<veekay::JobId>(jobs.size());
+	jobs.clear();
+}
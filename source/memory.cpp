@@ -0,0 +1,237 @@
+#include <cstdint>
+#include <cstdio>
+#include <cfloat>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan/vulkan_core.h>
+
+#include <imgui.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/memory.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+constexpr double mebibyte = 1024.0 * 1024.0;
+
+constexpr const char* category_names[] = {
+	"geometry",
+	"render targets",
+	"staging",
+	"UI",
+	"other",
+};
+
+static_assert(std::size(category_names) == veekay::memory_category_count);
+
+struct Allocation {
+	VkDeviceSize size;
+	veekay::MemoryCategory category;
+	uint32_t heap;
+};
+
+VkPhysicalDeviceMemoryProperties memory_properties;
+bool memory_budget_available;
+
+std::mutex memory_mutex;
+std::unordered_map<VkDeviceMemory, Allocation> allocations;
+veekay::MemoryCategoryStats category_stats[veekay::memory_category_count];
+VkDeviceSize heap_bytes[VK_MAX_MEMORY_HEAPS];
+VkDeviceSize total_bytes;
+VkDeviceSize total_peak_bytes;
+
+} // namespace
+
+VkResult veekay::allocateMemory(const VkMemoryAllocateInfo& info, MemoryCategory category,
+                                VkDeviceMemory* memory) {
+	const VkResult result = vkAllocateMemory(app.vk_device, &info, nullptr, memory);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	const uint32_t heap = memory_properties.memoryTypes[info.memoryTypeIndex].heapIndex;
+
+	std::lock_guard lock(memory_mutex);
+
+	allocations.emplace(*memory, Allocation{
+		.size = info.allocationSize,
+		.category = category,
+		.heap = heap,
+	});
+
+	MemoryCategoryStats& stats = category_stats[static_cast<uint32_t>(category)];
+	stats.bytes += info.allocationSize;
+	stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes);
+	++stats.allocations;
+
+	heap_bytes[heap] += info.allocationSize;
+
+	total_bytes += info.allocationSize;
+	total_peak_bytes = std::max(total_peak_bytes, total_bytes);
+
+	return result;
+}
+
+void veekay::freeMemory(VkDeviceMemory memory) {
+	if (!memory) {
+		return;
+	}
+
+	{
+		std::lock_guard lock(memory_mutex);
+
+		auto it = allocations.find(memory);
+		if (it != allocations.end()) {
+			const Allocation& allocation = it->second;
+
+			MemoryCategoryStats& stats = category_stats[static_cast<uint32_t>(allocation.category)];
+			stats.bytes -= allocation.size;
+			--stats.allocations;
+
+			heap_bytes[allocation.heap] -= allocation.size;
+			total_bytes -= allocation.size;
+
+			allocations.erase(it);
+		}
+	}
+
+	vkFreeMemory(app.vk_device, memory, nullptr);
+}
+
+veekay::MemoryStats veekay::memoryStats() {
+	MemoryStats stats{};
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+
+	VkPhysicalDeviceMemoryProperties2 properties{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &budget,
+	};
+
+	if (memory_budget_available) {
+		vkGetPhysicalDeviceMemoryProperties2(app.vk_physical_device, &properties);
+	}
+
+	std::lock_guard lock(memory_mutex);
+
+	for (uint32_t i = 0; i < memory_category_count; ++i) {
+		stats.categories[i] = category_stats[i];
+		stats.allocations += category_stats[i].allocations;
+	}
+
+	stats.bytes = total_bytes;
+	stats.peak_bytes = total_peak_bytes;
+	stats.heap_count = memory_properties.memoryHeapCount;
+
+	for (uint32_t i = 0; i < stats.heap_count; ++i) {
+		stats.heaps[i] = MemoryHeapStats{
+			.size = memory_properties.memoryHeaps[i].size,
+			.flags = memory_properties.memoryHeaps[i].flags,
+			.tracked_bytes = heap_bytes[i],
+			.usage = memory_budget_available ? budget.heapUsage[i] : 0,
+			.budget = memory_budget_available ? budget.heapBudget[i] : 0,
+		};
+	}
+
+	return stats;
+}
+
+const char* veekay::memoryCategoryName(MemoryCategory category) {
+	return category_names[static_cast<uint32_t>(category)];
+}
+
+void veekay::showMemoryWindow(bool* open) {
+	const MemoryStats stats = memoryStats();
+
+	if (!ImGui::Begin("Memory", open)) {
+		ImGui::End();
+		return;
+	}
+
+	const ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
+
+	if (ImGui::BeginTable("categories", 4, flags)) {
+		ImGui::TableSetupColumn("Category");
+		ImGui::TableSetupColumn("Allocations");
+		ImGui::TableSetupColumn("MiB");
+		ImGui::TableSetupColumn("Peak MiB");
+		ImGui::TableHeadersRow();
+
+		auto row = [](const char* name, uint32_t allocations, VkDeviceSize bytes, VkDeviceSize peak_bytes) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", allocations);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f", bytes / mebibyte);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f", peak_bytes / mebibyte);
+		};
+
+		for (uint32_t i = 0; i < memory_category_count; ++i) {
+			const MemoryCategoryStats& category = stats.categories[i];
+			row(category_names[i], category.allocations, category.bytes, category.peak_bytes);
+		}
+
+		row("total", stats.allocations, stats.bytes, stats.peak_bytes);
+
+		ImGui::EndTable();
+	}
+
+	for (uint32_t i = 0; i < stats.heap_count; ++i) {
+		const MemoryHeapStats& heap = stats.heaps[i];
+
+		const bool device_local = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+		ImGui::SeparatorText(device_local ? "Device local heap" : "Host heap");
+		ImGui::Text("Heap %u, %.0f MiB, tracked %.2f MiB", i, heap.size / mebibyte, heap.tracked_bytes / mebibyte);
+
+		if (!heap.budget) {
+			ImGui::TextDisabled("Budget unknown without VK_EXT_memory_budget");
+			continue;
+		}
+
+		// NOTE: Usage covers the whole process, the rest is allocated
+		//       around veekay::allocateMemory, e.g. by ImGui backend
+		const VkDeviceSize untracked = heap.usage > heap.tracked_bytes ? heap.usage - heap.tracked_bytes : 0;
+
+		char label[64];
+		std::snprintf(label, sizeof(label), "%.1f of %.1f MiB", heap.usage / mebibyte, heap.budget / mebibyte);
+
+		ImGui::ProgressBar(static_cast<float>(double(heap.usage) / double(heap.budget)), ImVec2(-FLT_MIN, 0.0f), label);
+
+		ImGui::Text("Untracked %.2f MiB", untracked / mebibyte);
+	}
+
+	ImGui::End();
+}
+
+void veekay::internal::initMemory(bool memory_budget) {
+	vkGetPhysicalDeviceMemoryProperties(app.vk_physical_device, &memory_properties);
+	memory_budget_available = memory_budget;
+}
+
+void veekay::internal::shutdownMemory() {
+	std::lock_guard lock(memory_mutex);
+
+	// NOTE: Everything should be gone by now, anything left is a leak
+	for (uint32_t i = 0; i < memory_category_count; ++i) {
+		const MemoryCategoryStats& stats = category_stats[i];
+
+		if (stats.allocations) {
+			std::cerr << "Leaked " << stats.allocations << " Vulkan memory allocations ("
+			          << stats.bytes / mebibyte << " MiB) of category " << category_names[i] << '\n';
+		}
+	}
+
+	allocations.clear();
+}
@@ -0,0 +1,181 @@
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/meshlets.hpp>
+
+namespace {
+
+struct Vec3 {
+	float x, y, z;
+};
+
+Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+
+float dot(Vec3 a, Vec3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vec3 cross(Vec3 a, Vec3 b) {
+	return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+float length(Vec3 a) {
+	return sqrtf(dot(a, a));
+}
+
+Vec3 positionOf(const uint8_t* vertices, uint32_t stride, uint32_t index) {
+	Vec3 result;
+	memcpy(&result, vertices + size_t(index) * stride, sizeof(Vec3));
+	return result;
+}
+
+// NOTE: Fills bounds of the meshlet whose triangles are already in mesh.indices
+void computeBounds(veekay::Meshlet& meshlet, const std::vector<uint32_t>& indices,
+                   const uint8_t* vertices, uint32_t stride, float normal_sign) {
+	const uint32_t begin = meshlet.index_offset;
+	const uint32_t end = begin + meshlet.triangle_count * 3;
+
+	Vec3 min = positionOf(vertices, stride, indices[begin]);
+	Vec3 max = min;
+
+	for (uint32_t i = begin; i < end; ++i) {
+		const Vec3 p = positionOf(vertices, stride, indices[i]);
+
+		min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+		max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+	}
+
+	const Vec3 center = (min + max) * 0.5f;
+
+	float radius = 0.0f;
+	for (uint32_t i = begin; i < end; ++i) {
+		radius = std::max(radius, length(positionOf(vertices, stride, indices[i]) - center));
+	}
+
+	// NOTE: Cone axis is the average facing, cutoff comes from the normal
+	//       straying furthest from it
+	std::vector<Vec3> normals;
+	normals.reserve(meshlet.triangle_count);
+
+	Vec3 axis{};
+
+	for (uint32_t i = begin; i < end; i += 3) {
+		const Vec3 a = positionOf(vertices, stride, indices[i + 0]);
+		const Vec3 b = positionOf(vertices, stride, indices[i + 1]);
+		const Vec3 c = positionOf(vertices, stride, indices[i + 2]);
+
+		const Vec3 normal = cross(b - a, c - a);
+		const float area = length(normal);
+
+		// NOTE: Degenerate triangles are never visible, they do not widen the cone
+		if (area < 1e-12f) {
+			continue;
+		}
+
+		normals.push_back(normal * (normal_sign / area));
+		axis = axis + normals.back();
+	}
+
+	float cutoff = 1.0f;
+
+	const float axis_length = length(axis);
+	if (axis_length > 1e-6f) {
+		axis = axis * (1.0f / axis_length);
+
+		float min_dot = 1.0f;
+		for (const Vec3& normal : normals) {
+			min_dot = std::min(min_dot, dot(normal, axis));
+		}
+
+		// NOTE: Some normal is at 90 degrees or more, the meshlet is always partly visible
+		if (min_dot > 0.0f) {
+			cutoff = sqrtf(1.0f - min_dot * min_dot);
+		}
+	}
+
+	meshlet.sphere[0] = center.x;
+	meshlet.sphere[1] = center.y;
+	meshlet.sphere[2] = center.z;
+	meshlet.sphere[3] = radius;
+
+	meshlet.cone[0] = axis.x;
+	meshlet.cone[1] = axis.y;
+	meshlet.cone[2] = axis.z;
+	meshlet.cone[3] = cutoff;
+}
+
+} // namespace
+
+veekay::MeshletMesh veekay::buildMeshlets(const void* vertices, uint32_t vertex_stride,
+                                          uint32_t vertex_count, std::span<const uint32_t> indices,
+                                          VkFrontFace front_face) {
+	MeshletMesh result;
+	result.indices.reserve(indices.size());
+
+	const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+
+	// NOTE: Counter-clockwise front faces have normals along cross(b - a, c - a)
+	const float normal_sign = front_face == VK_FRONT_FACE_COUNTER_CLOCKWISE ? 1.0f : -1.0f;
+
+	// NOTE: Meshlet a vertex was last added to, tells whether it is already counted
+	std::vector<uint32_t> vertex_meshlet(vertex_count, UINT_MAX);
+
+	Meshlet current{};
+
+	auto flush = [&] {
+		if (current.triangle_count == 0) {
+			return;
+		}
+
+		computeBounds(current, result.indices, bytes, vertex_stride, normal_sign);
+		result.meshlets.push_back(current);
+
+		current = Meshlet{.index_offset = static_cast<uint32_t>(result.indices.size())};
+	};
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const uint32_t triangle[3] = {indices[i], indices[i + 1], indices[i + 2]};
+
+		const uint32_t meshlet_index = static_cast<uint32_t>(result.meshlets.size());
+
+		uint32_t new_vertices = 0;
+		for (uint32_t j = 0; j < 3; ++j) {
+			const bool repeated = (j > 0 && triangle[j] == triangle[0]) ||
+			                      (j > 1 && triangle[j] == triangle[1]);
+
+			if (vertex_meshlet[triangle[j]] != meshlet_index && !repeated) {
+				++new_vertices;
+			}
+		}
+
+		if (current.vertex_count + new_vertices > max_meshlet_vertices ||
+		    current.triangle_count + 1 > max_meshlet_triangles) {
+			flush();
+		}
+
+		const uint32_t target = static_cast<uint32_t>(result.meshlets.size());
+
+		for (uint32_t vertex : triangle) {
+			if (vertex_meshlet[vertex] != target) {
+				vertex_meshlet[vertex] = target;
+				++current.vertex_count;
+			}
+
+			result.indices.push_back(vertex);
+		}
+
+		++current.triangle_count;
+	}
+
+	flush();
+
+	return result;
+}
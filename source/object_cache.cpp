@@ -0,0 +1,401 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/object_cache.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+// NOTE: Everything a create info describes, appended field by field in a fixed
+//       order, so padding and pointers never end up in it. Objects are looked up
+//       by the whole key, equal hashes alone never make a hit
+typedef std::string Key;
+
+std::mutex cache_mutex;
+
+std::unordered_map<Key, VkDescriptorSetLayout> descriptor_set_layouts;
+std::unordered_map<Key, VkPipelineLayout> pipeline_layouts;
+std::unordered_map<Key, VkSampler> samplers;
+std::unordered_map<Key, VkPipeline> pipelines;
+
+veekay::ObjectCacheStats cache_stats;
+
+void addBytes(Key& key, const void* data, size_t size) {
+	key.append(static_cast<const char*>(data), size);
+}
+
+template <typename T>
+void addValue(Key& key, const T& value) {
+	addBytes(key, &value, sizeof(T));
+}
+
+template <typename... Fields>
+void addFields(Key& key, const Fields&... fields) {
+	(addValue(key, fields), ...);
+}
+
+template <typename T, typename Func>
+void addArray(Key& key, const T* items, uint32_t count, Func add_item) {
+	addValue(key, count);
+
+	if (items) {
+		for (uint32_t i = 0; i < count; ++i) {
+			add_item(key, items[i]);
+		}
+	}
+}
+
+void addSpecialization(Key& key, const VkSpecializationInfo* info) {
+	if (!info) {
+		addValue(key, 0u);
+		return;
+	}
+
+	addValue(key, 1u);
+
+	addArray(key, info->pMapEntries, info->mapEntryCount,
+	         [](Key& k, const VkSpecializationMapEntry& entry) {
+		addFields(k, entry.constantID, entry.offset, entry.size);
+	});
+
+	addValue(key, info->dataSize);
+	addBytes(key, info->pData, info->dataSize);
+}
+
+bool addStage(Key& key, const VkPipelineShaderStageCreateInfo& stage) {
+	if (stage.pNext) {
+		return false;
+	}
+
+	addFields(key, stage.flags, stage.stage, stage.module);
+	addBytes(key, stage.pName, strlen(stage.pName) + 1);
+	addSpecialization(key, stage.pSpecializationInfo);
+
+	return true;
+}
+
+bool makeKey(Key& key, const VkDescriptorSetLayoutCreateInfo& info) {
+	if (info.pNext) {
+		return false;
+	}
+
+	addValue(key, info.flags);
+
+	addArray(key, info.pBindings, info.bindingCount,
+	         [](Key& k, const VkDescriptorSetLayoutBinding& binding) {
+		addFields(k, binding.binding, binding.descriptorType,
+		          binding.descriptorCount, binding.stageFlags);
+
+		const uint32_t immutable = binding.pImmutableSamplers ? binding.descriptorCount : 0;
+
+		addArray(k, binding.pImmutableSamplers, immutable,
+		         [](Key& s, const VkSampler& sampler) { addValue(s, sampler); });
+	});
+
+	return true;
+}
+
+bool makeKey(Key& key, const VkPipelineLayoutCreateInfo& info) {
+	if (info.pNext) {
+		return false;
+	}
+
+	addValue(key, info.flags);
+
+	addArray(key, info.pSetLayouts, info.setLayoutCount,
+	         [](Key& k, const VkDescriptorSetLayout& layout) { addValue(k, layout); });
+
+	addArray(key, info.pPushConstantRanges, info.pushConstantRangeCount,
+	         [](Key& k, const VkPushConstantRange& range) {
+		addFields(k, range.stageFlags, range.offset, range.size);
+	});
+
+	return true;
+}
+
+bool makeKey(Key& key, const VkSamplerCreateInfo& info) {
+	if (info.pNext) {
+		return false;
+	}
+
+	addFields(key, info.flags, info.magFilter, info.minFilter, info.mipmapMode,
+	          info.addressModeU, info.addressModeV, info.addressModeW, info.mipLodBias,
+	          info.anisotropyEnable, info.maxAnisotropy, info.compareEnable, info.compareOp,
+	          info.minLod, info.maxLod, info.borderColor, info.unnormalizedCoordinates);
+	return true;
+}
+
+bool makeKey(Key& key, const VkGraphicsPipelineCreateInfo& info) {
+	if (info.pNext) {
+		return false;
+	}
+
+	// NOTE: Bind point first, graphics and compute pipelines share one map
+	addFields(key, VK_PIPELINE_BIND_POINT_GRAPHICS, info.flags, info.stageCount);
+
+	for (uint32_t i = 0; i < info.stageCount; ++i) {
+		if (!addStage(key, info.pStages[i])) {
+			return false;
+		}
+	}
+
+	// NOTE: Missing states add a zero marker, so they differ from any present one
+	auto add_state = [&key](const auto* state, auto add_fields) {
+		if (!state) {
+			addValue(key, 0u);
+			return true;
+		}
+
+		if (state->pNext) {
+			return false;
+		}
+
+		addValue(key, 1u);
+		add_fields(key, *state);
+		return true;
+	};
+
+	const bool added =
+		add_state(info.pVertexInputState, [](Key& k, const VkPipelineVertexInputStateCreateInfo& state) {
+			addValue(k, state.flags);
+
+			addArray(k, state.pVertexBindingDescriptions, state.vertexBindingDescriptionCount,
+			         [](Key& b, const VkVertexInputBindingDescription& binding) {
+				addFields(b, binding.binding, binding.stride, binding.inputRate);
+			});
+
+			addArray(k, state.pVertexAttributeDescriptions, state.vertexAttributeDescriptionCount,
+			         [](Key& a, const VkVertexInputAttributeDescription& attribute) {
+				addFields(a, attribute.location, attribute.binding, attribute.format, attribute.offset);
+			});
+		}) &&
+		add_state(info.pInputAssemblyState, [](Key& k, const VkPipelineInputAssemblyStateCreateInfo& state) {
+			addFields(k, state.flags, state.topology, state.primitiveRestartEnable);
+		}) &&
+		add_state(info.pTessellationState, [](Key& k, const VkPipelineTessellationStateCreateInfo& state) {
+			addFields(k, state.flags, state.patchControlPoints);
+		}) &&
+		add_state(info.pViewportState, [](Key& k, const VkPipelineViewportStateCreateInfo& state) {
+			addValue(k, state.flags);
+
+			// NOTE: Arrays are absent when viewport and scissor are dynamic
+			addArray(k, state.pViewports, state.viewportCount, [](Key& v, const VkViewport& viewport) {
+				addFields(v, viewport.x, viewport.y, viewport.width, viewport.height,
+				          viewport.minDepth, viewport.maxDepth);
+			});
+
+			addArray(k, state.pScissors, state.scissorCount, [](Key& s, const VkRect2D& scissor) {
+				addFields(s, scissor.offset.x, scissor.offset.y, scissor.extent.width, scissor.extent.height);
+			});
+		}) &&
+		add_state(info.pRasterizationState, [](Key& k, const VkPipelineRasterizationStateCreateInfo& state) {
+			addFields(k, state.flags, state.depthClampEnable, state.rasterizerDiscardEnable,
+			          state.polygonMode, state.cullMode, state.frontFace, state.depthBiasEnable,
+			          state.depthBiasConstantFactor, state.depthBiasClamp, state.depthBiasSlopeFactor,
+			          state.lineWidth);
+		}) &&
+		add_state(info.pMultisampleState, [](Key& k, const VkPipelineMultisampleStateCreateInfo& state) {
+			addFields(k, state.flags, state.rasterizationSamples, state.sampleShadingEnable,
+			          state.minSampleShading, state.alphaToCoverageEnable, state.alphaToOneEnable);
+
+			const uint32_t mask_words = state.pSampleMask ? (state.rasterizationSamples + 31) / 32 : 0;
+
+			addArray(k, state.pSampleMask, mask_words,
+			         [](Key& m, const VkSampleMask& mask) { addValue(m, mask); });
+		}) &&
+		add_state(info.pDepthStencilState, [](Key& k, const VkPipelineDepthStencilStateCreateInfo& state) {
+			auto add_stencil = [](Key& s, const VkStencilOpState& op) {
+				addFields(s, op.failOp, op.passOp, op.depthFailOp, op.compareOp,
+				          op.compareMask, op.writeMask, op.reference);
+			};
+
+			addFields(k, state.flags, state.depthTestEnable, state.depthWriteEnable,
+			          state.depthCompareOp, state.depthBoundsTestEnable, state.stencilTestEnable,
+			          state.minDepthBounds, state.maxDepthBounds);
+
+			add_stencil(k, state.front);
+			add_stencil(k, state.back);
+		}) &&
+		add_state(info.pColorBlendState, [](Key& k, const VkPipelineColorBlendStateCreateInfo& state) {
+			addFields(k, state.flags, state.logicOpEnable, state.logicOp, state.blendConstants);
+
+			addArray(k, state.pAttachments, state.attachmentCount,
+			         [](Key& a, const VkPipelineColorBlendAttachmentState& attachment) {
+				addFields(a, attachment.blendEnable,
+				          attachment.srcColorBlendFactor, attachment.dstColorBlendFactor,
+				          attachment.colorBlendOp,
+				          attachment.srcAlphaBlendFactor, attachment.dstAlphaBlendFactor,
+				          attachment.alphaBlendOp, attachment.colorWriteMask);
+			});
+		}) &&
+		add_state(info.pDynamicState, [](Key& k, const VkPipelineDynamicStateCreateInfo& state) {
+			addValue(k, state.flags);
+
+			addArray(k, state.pDynamicStates, state.dynamicStateCount,
+			         [](Key& d, const VkDynamicState& dynamic) { addValue(d, dynamic); });
+		});
+
+	if (!added) {
+		return false;
+	}
+
+	addFields(key, info.layout, info.renderPass, info.subpass,
+	          info.basePipelineHandle, info.basePipelineIndex);
+	return true;
+}
+
+bool makeKey(Key& key, const VkComputePipelineCreateInfo& info) {
+	if (info.pNext) {
+		return false;
+	}
+
+	addFields(key, VK_PIPELINE_BIND_POINT_COMPUTE, info.flags);
+
+	if (!addStage(key, info.stage)) {
+		return false;
+	}
+
+	addFields(key, info.layout, info.basePipelineHandle, info.basePipelineIndex);
+	return true;
+}
+
+// NOTE: Objects are created outside of the lock, pipelines may take a while
+//       and other threads should not wait for them. When two threads race for
+//       the same object, the loser destroys its copy
+template <typename Handle, typename Info, typename Create, typename Destroy>
+Handle lookup(std::unordered_map<Key, Handle>& objects, const Info& info, const char* kind,
+              Create create, Destroy destroy) {
+	Key key;
+	if (!makeKey(key, info)) {
+		std::cerr << "Object cache does not support pNext chains in " << kind << " create info\n";
+		return VK_NULL_HANDLE;
+	}
+
+	{
+		std::lock_guard lock(cache_mutex);
+
+		auto it = objects.find(key);
+		if (it != objects.end()) {
+			++cache_stats.reused;
+			return it->second;
+		}
+	}
+
+	Handle handle = VK_NULL_HANDLE;
+	if (create(&handle) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan " << kind << '\n';
+		return VK_NULL_HANDLE;
+	}
+
+	std::lock_guard lock(cache_mutex);
+
+	auto [it, inserted] = objects.try_emplace(std::move(key), handle);
+	if (inserted) {
+		++cache_stats.created;
+	} else {
+		destroy(handle);
+		++cache_stats.reused;
+	}
+
+	return it->second;
+}
+
+} // namespace
+
+VkDescriptorSetLayout veekay::cachedDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo& info) {
+	VkDevice device = veekay::app.vk_device;
+
+	return lookup(descriptor_set_layouts, info, "descriptor set layout",
+	              [&](VkDescriptorSetLayout* layout) {
+		return vkCreateDescriptorSetLayout(device, &info, nullptr, layout);
+	}, [&](VkDescriptorSetLayout layout) {
+		vkDestroyDescriptorSetLayout(device, layout, nullptr);
+	});
+}
+
+VkPipelineLayout veekay::cachedPipelineLayout(const VkPipelineLayoutCreateInfo& info) {
+	VkDevice device = veekay::app.vk_device;
+
+	return lookup(pipeline_layouts, info, "pipeline layout",
+	              [&](VkPipelineLayout* layout) {
+		return vkCreatePipelineLayout(device, &info, nullptr, layout);
+	}, [&](VkPipelineLayout layout) {
+		vkDestroyPipelineLayout(device, layout, nullptr);
+	});
+}
+
+VkSampler veekay::cachedSampler(const VkSamplerCreateInfo& info) {
+	VkDevice device = veekay::app.vk_device;
+
+	return lookup(samplers, info, "sampler",
+	              [&](VkSampler* sampler) {
+		return vkCreateSampler(device, &info, nullptr, sampler);
+	}, [&](VkSampler sampler) {
+		vkDestroySampler(device, sampler, nullptr);
+	});
+}
+
+VkPipeline veekay::cachedGraphicsPipeline(const VkGraphicsPipelineCreateInfo& info) {
+	VkDevice device = veekay::app.vk_device;
+
+	return lookup(pipelines, info, "graphics pipeline",
+	              [&](VkPipeline* pipeline) {
+		return vkCreateGraphicsPipelines(device, nullptr, 1, &info, nullptr, pipeline);
+	}, [&](VkPipeline pipeline) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	});
+}
+
+VkPipeline veekay::cachedComputePipeline(const VkComputePipelineCreateInfo& info) {
+	VkDevice device = veekay::app.vk_device;
+
+	return lookup(pipelines, info, "compute pipeline",
+	              [&](VkPipeline* pipeline) {
+		return vkCreateComputePipelines(device, nullptr, 1, &info, nullptr, pipeline);
+	}, [&](VkPipeline pipeline) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	});
+}
+
+veekay::ObjectCacheStats veekay::objectCacheStats() {
+	std::lock_guard lock(cache_mutex);
+	return cache_stats;
+}
+
+void veekay::internal::shutdownObjectCache() {
+	VkDevice device = veekay::app.vk_device;
+
+	std::lock_guard lock(cache_mutex);
+
+	// NOTE: Users first, then what they were built from
+	for (const auto& [key, pipeline] : pipelines) {
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+
+	for (const auto& [key, layout] : pipeline_layouts) {
+		vkDestroyPipelineLayout(device, layout, nullptr);
+	}
+
+	for (const auto& [key, layout] : descriptor_set_layouts) {
+		vkDestroyDescriptorSetLayout(device, layout, nullptr);
+	}
+
+	for (const auto& [key, sampler] : samplers) {
+		vkDestroySampler(device, sampler, nullptr);
+	}
+
+	pipelines.clear();
+	pipeline_layouts.clear();
+	descriptor_set_layouts.clear();
+	samplers.clear();
+	cache_stats = {};
+}
@@ -0,0 +1,174 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/pipeline_variants.hpp>
+#include <veekay/jobs.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/shaders.hpp>
+#include <veekay/scheduler.hpp>
+
+void veekay::PipelineVariants::init(VkShaderModule vertex_module, VkShaderModule fragment_module,
+                                    VariantFactory variant_factory, uint32_t features) {
+	vertex = vertex_module;
+	fragment = fragment_module;
+	factory = variant_factory;
+	feature_count = features;
+}
+
+void veekay::PipelineVariants::reload(std::span<const uint32_t> vertex_code,
+                                      std::span<const uint32_t> fragment_code) {
+	VkDevice device = veekay::app.vk_device;
+
+	VkShaderModule vertex_module = veekay::createShaderModule(vertex_code);
+	VkShaderModule fragment_module = veekay::createShaderModule(fragment_code);
+
+	if (!vertex_module || !fragment_module) {
+		std::cerr << "Failed to create shader modules for reloaded pipeline variants\n";
+
+		vkDestroyShaderModule(device, fragment_module, nullptr);
+		vkDestroyShaderModule(device, vertex_module, nullptr);
+
+		// NOTE: Variants of the old shaders would not match the reloaded
+		//       generic pipeline, keep returning fallback instead
+		vertex_module = VK_NULL_HANDLE;
+		fragment_module = VK_NULL_HANDLE;
+	}
+
+	std::lock_guard lock(mutex);
+
+	// NOTE: Frames in flight may still draw with them
+	for (const auto& entry : variants) {
+		if (VkPipeline pipeline = entry.second) {
+			veekay::deferDestroy([pipeline] {
+				vkDestroyPipeline(veekay::app.vk_device, pipeline, nullptr);
+			});
+		}
+	}
+
+	variants.clear();
+	++generation;
+
+	if (owns_modules) {
+		retired_modules.push_back(vertex);
+		retired_modules.push_back(fragment);
+	}
+
+	if (compiling == 0) {
+		for (VkShaderModule module : retired_modules) {
+			vkDestroyShaderModule(device, module, nullptr);
+		}
+
+		retired_modules.clear();
+	}
+
+	vertex = vertex_module;
+	fragment = fragment_module;
+	owns_modules = vertex_module != VK_NULL_HANDLE;
+}
+
+VkPipeline veekay::PipelineVariants::get(FeatureMask features, VkPipeline fallback) {
+	std::lock_guard lock(mutex);
+
+	if (!vertex) {
+		return fallback;
+	}
+
+	auto [it, inserted] = variants.try_emplace(features, VK_NULL_HANDLE);
+
+	if (inserted) {
+		++compiling;
+
+		// NOTE: Modules are captured, reload may replace them meanwhile
+		veekay::async([this, features, vertex_module = vertex, fragment_module = fragment,
+		               job_generation = generation] {
+			std::vector<VkSpecializationMapEntry> entries(feature_count + 1);
+			std::vector<VkBool32> values(feature_count + 1);
+
+			for (uint32_t i = 0; i <= feature_count; ++i) {
+				entries[i] = VkSpecializationMapEntry{
+					.constantID = i,
+					.offset = static_cast<uint32_t>(i * sizeof(VkBool32)),
+					.size = sizeof(VkBool32),
+				};
+
+				// NOTE: Constant 0 tells the shader it is specialized
+				values[i] = i == 0 ? VK_TRUE : (features >> (i - 1)) & 1;
+			}
+
+			VkSpecializationInfo specialization{
+				.mapEntryCount = feature_count + 1,
+				.pMapEntries = entries.data(),
+				.dataSize = values.size() * sizeof(VkBool32),
+				.pData = values.data(),
+			};
+
+			VkPipeline pipeline = factory(vertex_module, fragment_module, &specialization);
+			if (pipeline) {
+				veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipeline, "pipeline variant");
+			} else {
+				std::cerr << "Failed to create pipeline variant for features 0x" << std::hex
+				          << features << std::dec << '\n';
+			}
+
+			std::lock_guard lock(mutex);
+
+			if (job_generation == generation) {
+				variants[features] = pipeline;
+			} else if (pipeline) {
+				// NOTE: Built from shaders reload has replaced, never handed out
+				vkDestroyPipeline(veekay::app.vk_device, pipeline, nullptr);
+			}
+
+			if (--compiling == 0) {
+				for (VkShaderModule module : retired_modules) {
+					vkDestroyShaderModule(veekay::app.vk_device, module, nullptr);
+				}
+
+				retired_modules.clear();
+			}
+
+			compiled.notify_all();
+		});
+	}
+
+	return it->second ? it->second : fallback;
+}
+
+uint32_t veekay::PipelineVariants::readyCount() {
+	std::lock_guard lock(mutex);
+
+	uint32_t count = 0;
+	for (const auto& [features, pipeline] : variants) {
+		count += pipeline != VK_NULL_HANDLE;
+	}
+
+	return count;
+}
+
+void veekay::PipelineVariants::destroy() {
+	std::unique_lock lock(mutex);
+	compiled.wait(lock, [this] { return compiling == 0; });
+
+	for (const auto& [features, pipeline] : variants) {
+		vkDestroyPipeline(veekay::app.vk_device, pipeline, nullptr);
+	}
+
+	variants.clear();
+
+	for (VkShaderModule module : retired_modules) {
+		vkDestroyShaderModule(veekay::app.vk_device, module, nullptr);
+	}
+
+	retired_modules.clear();
+
+	// NOTE: Modules passed to init belong to the caller
+	if (owns_modules) {
+		vkDestroyShaderModule(veekay::app.vk_device, fragment, nullptr);
+		vkDestroyShaderModule(veekay::app.vk_device, vertex, nullptr);
+		owns_modules = false;
+	}
+}
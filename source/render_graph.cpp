@@ -0,0 +1,618 @@
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <algorithm>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/render_graph.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/memory.hpp>
+
+namespace {
+
+struct AccessInfo {
+	VkPipelineStageFlags stages;
+	VkAccessFlags read_access;
+	VkAccessFlags write_access;
+	VkImageLayout layout;
+	VkImageUsageFlags usage;
+};
+
+AccessInfo accessInfo(veekay::Access access) {
+	switch (access) {
+	case veekay::Access::color_attachment:
+		return {
+			.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.read_access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+			.write_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		};
+
+	case veekay::Access::depth_attachment:
+		return {
+			.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.read_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+			.write_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		};
+
+	case veekay::Access::sampled:
+		return {
+			.stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+			          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			.read_access = VK_ACCESS_SHADER_READ_BIT,
+			.write_access = 0,
+			.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+		};
+
+	case veekay::Access::storage:
+		return {
+			.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			.read_access = VK_ACCESS_SHADER_READ_BIT,
+			.write_access = VK_ACCESS_SHADER_WRITE_BIT,
+			.layout = VK_IMAGE_LAYOUT_GENERAL,
+			.usage = VK_IMAGE_USAGE_STORAGE_BIT,
+		};
+
+	case veekay::Access::transfer_src:
+		return {
+			.stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+			.read_access = VK_ACCESS_TRANSFER_READ_BIT,
+			.write_access = 0,
+			.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		};
+
+	case veekay::Access::transfer_dst:
+		return {
+			.stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+			.read_access = 0,
+			.write_access = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		};
+	}
+
+	return {};
+}
+
+// NOTE: Whoever uses an imported image after the graph expects it in its final
+//       layout, with writes made before already visible to that kind of access.
+//       Next frame the graph starts from no pending writes, so this is the only
+//       place they are made visible. Presentation waits on a semaphore instead
+VkAccessFlags finalAccess(VkImageLayout layout) {
+	switch (layout) {
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		return VK_ACCESS_SHADER_READ_BIT;
+
+	case VK_IMAGE_LAYOUT_GENERAL:
+		return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return VK_ACCESS_TRANSFER_READ_BIT;
+
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	default:
+		return 0;
+	}
+}
+
+// NOTE: What the GPU last did with a resource while walking passes
+struct ResourceState {
+	VkImageLayout layout;
+	VkPipelineStageFlags stages;
+	VkAccessFlags write_access;
+};
+
+} // namespace
+
+veekay::ResourceId veekay::RenderGraph::importImage(const char* name, VkImageAspectFlags aspect,
+                                                    VkImageLayout initial_layout,
+                                                    VkPipelineStageFlags initial_stage,
+                                                    VkImageLayout final_layout) {
+	resources.push_back(Resource{
+		.name = name,
+		.imported = true,
+		.desc = {.aspect = aspect},
+		.initial_layout = initial_layout,
+		.initial_stage = initial_stage,
+		.final_layout = final_layout,
+	});
+
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+veekay::ResourceId veekay::RenderGraph::createImage(const char* name, const ImageDesc& desc) {
+	resources.push_back(Resource{
+		.name = name,
+		.imported = false,
+		.desc = desc,
+		.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.final_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+	});
+
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+veekay::PassId veekay::RenderGraph::addPass(const char* name, PassFunc func) {
+	passes.push_back(Pass{
+		.name = name,
+		.func = std::move(func),
+	});
+
+	return static_cast<PassId>(passes.size() - 1);
+}
+
+void veekay::RenderGraph::read(PassId pass, ResourceId resource, Access access) {
+	addUse(pass, resource, access, false);
+}
+
+void veekay::RenderGraph::write(PassId pass, ResourceId resource, Access access) {
+	addUse(pass, resource, access, true);
+}
+
+void veekay::RenderGraph::addUse(PassId pass, ResourceId resource, Access access, bool writes) {
+	for (Use& use : passes[pass].uses) {
+		if (use.resource == resource) {
+			if (use.access != access) {
+				std::cerr << "Render graph pass " << passes[pass].name << " uses "
+				          << resources[resource].name << " in two different ways\n";
+			}
+
+			use.reads |= !writes;
+			use.writes |= writes;
+			return;
+		}
+	}
+
+	passes[pass].uses.push_back(Use{
+		.resource = resource,
+		.access = access,
+		.reads = !writes,
+		.writes = writes,
+	});
+}
+
+bool veekay::RenderGraph::compile() {
+	cull();
+
+	if (!allocate()) {
+		return false;
+	}
+
+	planBarriers();
+
+	return true;
+}
+
+void veekay::RenderGraph::cull() {
+	// NOTE: Walk backwards from graph outputs, a pass survives only
+	//       if something needed later is written by it
+	std::vector<bool> needed(resources.size());
+
+	for (size_t i = 0; i < resources.size(); ++i) {
+		needed[i] = resources[i].imported;
+	}
+
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass& pass = passes[i];
+
+		pass.active = false;
+
+		for (const Use& use : pass.uses) {
+			if (use.writes && needed[use.resource]) {
+				pass.active = true;
+				break;
+			}
+		}
+
+		if (!pass.active) {
+			continue;
+		}
+
+		for (const Use& use : pass.uses) {
+			if (use.reads) {
+				needed[use.resource] = true;
+			}
+		}
+	}
+
+	for (Resource& resource : resources) {
+		resource.first_pass = UINT32_MAX;
+		resource.last_pass = 0;
+	}
+
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		if (!passes[i].active) {
+			continue;
+		}
+
+		for (const Use& use : passes[i].uses) {
+			Resource& resource = resources[use.resource];
+			resource.first_pass = std::min(resource.first_pass, i);
+			resource.last_pass = std::max(resource.last_pass, i);
+		}
+	}
+}
+
+bool veekay::RenderGraph::allocate() {
+	VkDevice device = veekay::app.vk_device;
+
+	std::vector<VkMemoryRequirements> requirements(resources.size());
+	std::vector<ResourceId> transients;
+
+	for (ResourceId id = 0; id < resources.size(); ++id) {
+		Resource& resource = resources[id];
+
+		if (resource.imported || resource.first_pass > resource.last_pass) {
+			continue;
+		}
+
+		VkImageUsageFlags usage = resource.desc.usage;
+		for (const Pass& pass : passes) {
+			for (const Use& use : pass.uses) {
+				if (use.resource == id) {
+					usage |= accessInfo(use.access).usage;
+				}
+			}
+		}
+
+		VkImageCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = resource.desc.format,
+			.extent = {resource.desc.extent.width, resource.desc.extent.height, 1},
+			.mipLevels = 1,
+			.arrayLayers = std::max(resource.desc.layers, 1u),
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = usage,
+		};
+
+		if (vkCreateImage(device, &info, nullptr, &resource.image) != VK_SUCCESS) {
+			std::cerr << "Failed to create render graph image " << resource.name << '\n';
+			return false;
+		}
+
+		setObjectName(VK_OBJECT_TYPE_IMAGE, (uint64_t)resource.image, resource.name);
+
+		vkGetImageMemoryRequirements(device, resource.image, &requirements[id]);
+		transients.push_back(id);
+	}
+
+	// NOTE: Place biggest images first, then try to fit others into
+	//       blocks whose occupants are dead by the time they are needed
+	std::sort(transients.begin(), transients.end(), [&](ResourceId a, ResourceId b) {
+		return requirements[a].size > requirements[b].size;
+	});
+
+	for (ResourceId id : transients) {
+		Resource& resource = resources[id];
+		const VkMemoryRequirements& req = requirements[id];
+
+		uint32_t found = UINT32_MAX;
+
+		for (uint32_t b = 0; b < blocks.size() && found == UINT32_MAX; ++b) {
+			MemoryBlock& block = blocks[b];
+
+			if ((block.type_bits & req.memoryTypeBits) == 0) {
+				continue;
+			}
+
+			bool overlaps = false;
+			for (ResourceId other : block.occupants) {
+				const Resource& o = resources[other];
+				if (resource.first_pass <= o.last_pass && o.first_pass <= resource.last_pass) {
+					overlaps = true;
+					break;
+				}
+			}
+
+			if (!overlaps) {
+				found = b;
+			}
+		}
+
+		if (found == UINT32_MAX) {
+			blocks.push_back(MemoryBlock{
+				.memory = VK_NULL_HANDLE,
+				.size = 0,
+				.type_bits = req.memoryTypeBits,
+			});
+
+			found = static_cast<uint32_t>(blocks.size() - 1);
+		}
+
+		MemoryBlock& block = blocks[found];
+		block.size = std::max(block.size, req.size);
+		block.type_bits &= req.memoryTypeBits;
+		block.occupants.push_back(id);
+
+		resource.memory_block = found;
+	}
+
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(veekay::app.vk_physical_device, &properties);
+
+	for (MemoryBlock& block : blocks) {
+		uint32_t index = UINT_MAX;
+		for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+			const VkMemoryType& type = properties.memoryTypes[i];
+
+			if ((block.type_bits & (1 << i)) &&
+			    (type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+				index = i;
+				break;
+			}
+		}
+
+		if (index == UINT_MAX) {
+			std::cerr << "Failed to find required memory type for render graph images\n";
+			return false;
+		}
+
+		VkMemoryAllocateInfo info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = block.size,
+			.memoryTypeIndex = index,
+		};
+
+		if (allocateMemory(info, MemoryCategory::render_target, &block.memory) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate memory for render graph images\n";
+			return false;
+		}
+
+		for (ResourceId id : block.occupants) {
+			Resource& resource = resources[id];
+
+			if (vkBindImageMemory(device, resource.image, block.memory, 0) != VK_SUCCESS) {
+				std::cerr << "Failed to bind render graph image " << resource.name << " with device memory\n";
+				return false;
+			}
+
+			// NOTE: Views of combined depth/stencil images only see depth
+			VkImageAspectFlags view_aspect = resource.desc.aspect;
+			if (view_aspect & VK_IMAGE_ASPECT_DEPTH_BIT) {
+				view_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+			}
+
+			const uint32_t layers = std::max(resource.desc.layers, 1u);
+
+			VkImageViewCreateInfo view_info{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = resource.image,
+				.viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D,
+				.format = resource.desc.format,
+				.subresourceRange = {
+					.aspectMask = view_aspect,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = layers,
+				},
+			};
+
+			if (vkCreateImageView(device, &view_info, nullptr, &resource.view) != VK_SUCCESS) {
+				std::cerr << "Failed to create render graph image view " << resource.name << '\n';
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void veekay::RenderGraph::planBarriers() {
+	std::vector<ResourceState> states(resources.size());
+
+	{ // NOTE: What each resource was doing at the end of the previous frame
+		for (const Pass& pass : passes) {
+			if (!pass.active) {
+				continue;
+			}
+
+			for (const Use& use : pass.uses) {
+				const AccessInfo info = accessInfo(use.access);
+				ResourceState& state = states[use.resource];
+
+				if (use.writes) {
+					state.stages = info.stages;
+					state.write_access = info.write_access;
+				} else {
+					state.stages |= info.stages;
+				}
+			}
+		}
+
+		// NOTE: Aliased images must also wait for everyone else living in their memory
+		std::vector<ResourceState> block_states(blocks.size());
+		for (uint32_t b = 0; b < blocks.size(); ++b) {
+			for (ResourceId id : blocks[b].occupants) {
+				block_states[b].stages |= states[id].stages;
+				block_states[b].write_access |= states[id].write_access;
+			}
+		}
+
+		for (ResourceId id = 0; id < resources.size(); ++id) {
+			const Resource& resource = resources[id];
+
+			if (resource.imported) {
+				states[id] = ResourceState{
+					.layout = resource.initial_layout,
+					.stages = resource.initial_stage,
+					.write_access = 0,
+				};
+			} else if (resource.first_pass <= resource.last_pass) {
+				states[id] = block_states[resource.memory_block];
+				states[id].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+		}
+	}
+
+	auto add_barrier = [&](Barriers& barriers, ResourceId id,
+	                       VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access) {
+		const ResourceState& state = states[id];
+
+		barriers.images.push_back(VkImageMemoryBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = state.write_access,
+			.dstAccessMask = access,
+			.oldLayout = state.layout,
+			.newLayout = layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.subresourceRange = {
+				.aspectMask = resources[id].desc.aspect,
+				.baseMipLevel = 0,
+				.levelCount = VK_REMAINING_MIP_LEVELS,
+				.baseArrayLayer = 0,
+				.layerCount = VK_REMAINING_ARRAY_LAYERS,
+			},
+		});
+		barriers.resources.push_back(id);
+
+		barriers.src_stages |= state.stages ? state.stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		barriers.dst_stages |= stages;
+	};
+
+	for (Pass& pass : passes) {
+		pass.barriers = {};
+
+		if (!pass.active) {
+			continue;
+		}
+
+		for (const Use& use : pass.uses) {
+			ResourceState& state = states[use.resource];
+			const AccessInfo info = accessInfo(use.access);
+
+			// NOTE: Attachments are read when written too: depth tests, loads, blending
+			const bool attachment = use.access == Access::color_attachment ||
+			                        use.access == Access::depth_attachment;
+			const bool reads = use.reads || (use.writes && attachment);
+
+			const VkAccessFlags access = (reads ? info.read_access : 0) |
+			                             (use.writes ? info.write_access : 0);
+
+			// NOTE: Reads of an image already in the right layout only pile up stages,
+			//       anything else needs a barrier against what happened before
+			if (state.layout == info.layout && state.write_access == 0 && !use.writes) {
+				state.stages |= info.stages;
+				continue;
+			}
+
+			add_barrier(pass.barriers, use.resource, info.layout, info.stages, access);
+
+			state = ResourceState{
+				.layout = info.layout,
+				.stages = info.stages,
+				.write_access = use.writes ? info.write_access : 0,
+			};
+		}
+	}
+
+	final_barriers = {};
+
+	for (ResourceId id = 0; id < resources.size(); ++id) {
+		const Resource& resource = resources[id];
+
+		if (!resource.imported) {
+			continue;
+		}
+
+		const VkAccessFlags access = finalAccess(resource.final_layout);
+
+		// NOTE: All commands rather than bottom of pipe, so that commands recorded
+		//       after execute (e.g. frame capture, next frame's reads) are ordered
+		//       after the transition. Writes in the final layout still need one
+		if (states[id].layout != resource.final_layout || (states[id].write_access && access)) {
+			add_barrier(final_barriers, id, resource.final_layout,
+			            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, access);
+		}
+	}
+}
+
+void veekay::RenderGraph::record(VkCommandBuffer cmd, Barriers& barriers) {
+	if (barriers.images.empty()) {
+		return;
+	}
+
+	for (size_t i = 0; i < barriers.images.size(); ++i) {
+		barriers.images[i].image = resources[barriers.resources[i]].image;
+	}
+
+	vkCmdPipelineBarrier(cmd, barriers.src_stages, barriers.dst_stages, 0,
+	                     0, nullptr, 0, nullptr,
+	                     static_cast<uint32_t>(barriers.images.size()), barriers.images.data());
+}
+
+void veekay::RenderGraph::execute(VkCommandBuffer cmd) {
+	for (Pass& pass : passes) {
+		if (!pass.active) {
+			continue;
+		}
+
+		beginLabel(cmd, pass.name);
+		beginGpuZone(cmd, pass.name);
+		record(cmd, pass.barriers);
+		pass.func(cmd);
+		endGpuZone(cmd);
+		endLabel(cmd);
+	}
+
+	record(cmd, final_barriers);
+}
+
+void veekay::RenderGraph::destroy() {
+	VkDevice device = veekay::app.vk_device;
+
+	for (Resource& resource : resources) {
+		if (resource.imported) {
+			continue;
+		}
+
+		vkDestroyImageView(device, resource.view, nullptr);
+		vkDestroyImage(device, resource.image, nullptr);
+	}
+
+	for (MemoryBlock& block : blocks) {
+		freeMemory(block.memory);
+	}
+
+	resources.clear();
+	passes.clear();
+	blocks.clear();
+	final_barriers = {};
+}
+
+void veekay::RenderGraph::setImage(ResourceId resource, VkImage image, VkImageView view) {
+	resources[resource].image = image;
+	resources[resource].view = view;
+}
+
+VkImage veekay::RenderGraph::image(ResourceId resource) const {
+	return resources[resource].image;
+}
+
+VkImageView veekay::RenderGraph::view(ResourceId resource) const {
+	return resources[resource].view;
+}
+
+bool veekay::RenderGraph::isActive(PassId pass) const {
+	return passes[pass].active;
+}
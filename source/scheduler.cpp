@@ -0,0 +1,373 @@
+#include <cstdint>
+#include <iostream>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <mutex>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+struct QueueState {
+	VkQueue queue;
+	VkSemaphore timeline;
+	uint64_t last_value;
+	// NOTE: Logical queues may share one VkQueue, they share its lock too
+	std::mutex* mutex;
+};
+
+QueueState queues[veekay::queue_count];
+std::mutex queue_mutexes[veekay::queue_count];
+
+// NOTE: Waits collected for the next frame submission, 0 means "no wait"
+uint64_t frame_wait_values[veekay::queue_count];
+VkPipelineStageFlags frame_wait_stages[veekay::queue_count];
+
+uint64_t last_frame_value;
+
+struct Deletion {
+	// NOTE: Point per queue that must be reached, 0 means "no wait"
+	uint64_t values[veekay::queue_count];
+	// NOTE: Also wait for the frame being recorded, its graphics
+	//       value is only known once it is submitted
+	bool frame_pending;
+	std::function<void()> destroy;
+};
+
+std::mutex deletion_mutex;
+std::vector<Deletion> deletions;
+
+QueueState& stateOf(veekay::Queue queue) {
+	return queues[static_cast<uint32_t>(queue)];
+}
+
+// NOTE: Keep only the latest value per queue, timelines only go forward
+struct WaitList {
+	VkSemaphore semaphores[veekay::queue_count + 1];
+	uint64_t values[veekay::queue_count + 1];
+	VkPipelineStageFlags stages[veekay::queue_count + 1];
+	uint32_t count;
+
+	void add(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stage) {
+		for (uint32_t i = 0; i < count; ++i) {
+			if (semaphores[i] == semaphore) {
+				if (values[i] < value) values[i] = value;
+				stages[i] |= stage;
+				return;
+			}
+		}
+
+		semaphores[count] = semaphore;
+		values[count] = value;
+		stages[count] = stage;
+		++count;
+	}
+};
+
+} // namespace
+
+bool veekay::internal::initScheduler() {
+	VkDevice device = veekay::app.vk_device;
+
+	const VkQueue handles[veekay::queue_count] = {
+		veekay::app.vk_graphics_queue,
+		veekay::app.vk_compute_queue,
+		veekay::app.vk_transfer_queue,
+	};
+
+	VkSemaphoreTypeCreateInfo type_info{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+
+	VkSemaphoreCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &type_info,
+	};
+
+	for (uint32_t i = 0; i < veekay::queue_count; ++i) {
+		QueueState& state = queues[i];
+
+		state.queue = handles[i];
+		state.last_value = 0;
+		state.mutex = &queue_mutexes[i];
+
+		for (uint32_t j = 0; j < i; ++j) {
+			if (queues[j].queue == state.queue) {
+				state.mutex = queues[j].mutex;
+				break;
+			}
+		}
+
+		if (vkCreateSemaphore(device, &info, nullptr, &state.timeline) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan timeline semaphore\n";
+			return false;
+		}
+
+		frame_wait_values[i] = 0;
+		frame_wait_stages[i] = 0;
+	}
+
+	last_frame_value = 0;
+
+	return true;
+}
+
+void veekay::internal::shutdownScheduler() {
+	for (QueueState& state : queues) {
+		vkDestroySemaphore(veekay::app.vk_device, state.timeline, nullptr);
+		state.timeline = VK_NULL_HANDLE;
+	}
+}
+
+veekay::TimelinePoint veekay::submit(Queue queue, VkCommandBuffer cmd,
+                                     std::span<const TimelinePoint> waits,
+                                     VkPipelineStageFlags wait_stage) {
+	QueueState& state = stateOf(queue);
+
+	WaitList wait_list{};
+	for (const TimelinePoint& point : waits) {
+		wait_list.add(stateOf(point.queue).timeline, point.value, wait_stage);
+	}
+
+	std::lock_guard lock(*state.mutex);
+
+	const uint64_t signal_value = state.last_value + 1;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = wait_list.count,
+		.pWaitSemaphoreValues = wait_list.values,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &signal_value,
+	};
+
+	VkSubmitInfo info{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_info,
+		.waitSemaphoreCount = wait_list.count,
+		.pWaitSemaphores = wait_list.semaphores,
+		.pWaitDstStageMask = wait_list.stages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cmd,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &state.timeline,
+	};
+
+	if (vkQueueSubmit(state.queue, 1, &info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cerr << "Failed to submit Vulkan command buffer\n";
+		return {queue, state.last_value};
+	}
+
+	state.last_value = signal_value;
+
+	return {queue, signal_value};
+}
+
+void veekay::waitInFrame(TimelinePoint point, VkPipelineStageFlags wait_stage) {
+	const uint32_t index = static_cast<uint32_t>(point.queue);
+
+	if (frame_wait_values[index] < point.value) {
+		frame_wait_values[index] = point.value;
+	}
+
+	frame_wait_stages[index] |= wait_stage;
+}
+
+veekay::TimelinePoint veekay::lastFrame() {
+	return {Queue::graphics, last_frame_value};
+}
+
+veekay::TimelinePoint veekay::lastSubmitted(Queue queue) {
+	QueueState& state = stateOf(queue);
+
+	std::lock_guard lock(*state.mutex);
+	return {queue, state.last_value};
+}
+
+bool veekay::isComplete(TimelinePoint point) {
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(veekay::app.vk_device, stateOf(point.queue).timeline, &value);
+	return value >= point.value;
+}
+
+void veekay::wait(TimelinePoint point) {
+	if (point.value == 0) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo info{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &stateOf(point.queue).timeline,
+		.pValues = &point.value,
+	};
+
+	vkWaitSemaphores(veekay::app.vk_device, &info, UINT64_MAX);
+}
+
+void veekay::deferDestroy(std::function<void()> destroy) {
+	Deletion deletion{.frame_pending = true, .destroy = std::move(destroy)};
+
+	for (uint32_t i = 0; i < veekay::queue_count; ++i) {
+		deletion.values[i] = lastSubmitted(static_cast<Queue>(i)).value;
+	}
+
+	std::lock_guard lock(deletion_mutex);
+	deletions.push_back(std::move(deletion));
+}
+
+void veekay::deferDestroy(TimelinePoint point, std::function<void()> destroy) {
+	Deletion deletion{.destroy = std::move(destroy)};
+	deletion.values[static_cast<uint32_t>(point.queue)] = point.value;
+
+	std::lock_guard lock(deletion_mutex);
+	deletions.push_back(std::move(deletion));
+}
+
+void veekay::internal::collectDeletions() {
+	uint64_t reached[veekay::queue_count];
+
+	for (uint32_t i = 0; i < veekay::queue_count; ++i) {
+		reached[i] = 0;
+		vkGetSemaphoreCounterValue(veekay::app.vk_device, queues[i].timeline, &reached[i]);
+	}
+
+	std::vector<std::function<void()>> ready;
+
+	{
+		std::lock_guard lock(deletion_mutex);
+
+		size_t kept = 0;
+
+		for (Deletion& deletion : deletions) {
+			bool done = !deletion.frame_pending;
+
+			for (uint32_t i = 0; i < veekay::queue_count && done; ++i) {
+				done = deletion.values[i] <= reached[i];
+			}
+
+			if (done) {
+				ready.push_back(std::move(deletion.destroy));
+			} else {
+				deletions[kept++] = std::move(deletion);
+			}
+		}
+
+		deletions.resize(kept);
+	}
+
+	// NOTE: Outside the lock, destroy may defer more work
+	for (auto& destroy : ready) {
+		destroy();
+	}
+}
+
+void veekay::internal::flushDeletions() {
+	for (;;) {
+		std::vector<Deletion> pending;
+
+		{
+			std::lock_guard lock(deletion_mutex);
+			pending.swap(deletions);
+		}
+
+		if (pending.empty()) {
+			break;
+		}
+
+		for (Deletion& deletion : pending) {
+			deletion.destroy();
+		}
+	}
+}
+
+veekay::TimelinePoint veekay::internal::submitFrame(const VkCommandBuffer* buffers, uint32_t buffer_count,
+                                                    VkSemaphore acquire_semaphore,
+                                                    VkSemaphore present_semaphore) {
+	QueueState& state = stateOf(Queue::graphics);
+
+	WaitList wait_list{};
+
+	// NOTE: Binary semaphore, its value is ignored
+	if (acquire_semaphore) {
+		wait_list.add(acquire_semaphore, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+
+	for (uint32_t i = 0; i < veekay::queue_count; ++i) {
+		if (frame_wait_values[i] != 0) {
+			wait_list.add(queues[i].timeline, frame_wait_values[i], frame_wait_stages[i]);
+		}
+
+		frame_wait_values[i] = 0;
+		frame_wait_stages[i] = 0;
+	}
+
+	std::lock_guard lock(*state.mutex);
+
+	const uint64_t signal_value = state.last_value + 1;
+
+	// NOTE: Timeline goes first, present semaphore is left out when there is none
+	VkSemaphore signal_semaphores[] = {state.timeline, present_semaphore};
+	uint64_t signal_values[] = {signal_value, 0};
+	const uint32_t signal_count = present_semaphore ? 2 : 1;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = wait_list.count,
+		.pWaitSemaphoreValues = wait_list.values,
+		.signalSemaphoreValueCount = signal_count,
+		.pSignalSemaphoreValues = signal_values,
+	};
+
+	VkSubmitInfo info{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_info,
+		.waitSemaphoreCount = wait_list.count,
+		.pWaitSemaphores = wait_list.semaphores,
+		.pWaitDstStageMask = wait_list.stages,
+		.commandBufferCount = buffer_count,
+		.pCommandBuffers = buffers,
+		.signalSemaphoreCount = signal_count,
+		.pSignalSemaphores = signal_semaphores,
+	};
+
+	if (vkQueueSubmit(state.queue, 1, &info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cerr << "Failed to submit frame to Vulkan graphics queue\n";
+		return {Queue::graphics, state.last_value};
+	}
+
+	state.last_value = signal_value;
+	last_frame_value = signal_value;
+
+	{
+		std::lock_guard deletion_lock(deletion_mutex);
+
+		for (Deletion& deletion : deletions) {
+			if (deletion.frame_pending) {
+				deletion.values[static_cast<uint32_t>(Queue::graphics)] = signal_value;
+				deletion.frame_pending = false;
+			}
+		}
+	}
+
+	return {Queue::graphics, signal_value};
+}
+
+std::unique_lock<std::mutex> veekay::internal::lockQueue(Queue queue) {
+	return std::unique_lock(*stateOf(queue).mutex);
+}
+
+VkResult veekay::internal::presentFrame(const VkPresentInfoKHR& info) {
+	QueueState& state = stateOf(Queue::graphics);
+
+	std::lock_guard lock(*state.mutex);
+	return vkQueuePresentKHR(state.queue, &info);
+}
@@ -0,0 +1,639 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef VEEKAY_HAS_SHADERC
+#include <shaderc/shaderc.h>
+#endif
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/shaders.hpp>
+#include <veekay/trace.hpp>
+
+#include "hash.hpp"
+#include "internal.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+struct ShaderSource {
+	fs::path path;
+	fs::file_time_type write_time;
+	// NOTE: Last SPIR-V that compiled successfully, empty until first compiled
+	std::vector<uint32_t> code;
+	bool dirty;
+};
+
+struct WatchedProgram {
+	// NOTE: Vertex and fragment sources, or a single compute one
+	uint32_t source_ids[2];
+	uint32_t stage_count;
+	veekay::PipelineFactory factory;
+	veekay::ComputePipelineFactory compute_factory;
+	VkPipeline* target;
+	veekay::ReloadFunc reload;
+
+	// NOTE: Every pipeline built for this program keyed by SPIR-V hash
+	std::unordered_map<uint64_t, VkPipeline> cache;
+	// NOTE: Pipeline handed to watchShaders until watcher finds its key. Stays
+	//       here when sources were edited before that, nothing to key it by then
+	VkPipeline initial;
+	fs::file_time_type initial_write_times[2];
+	bool initial_checked;
+	VkPipeline pending;
+	// NOTE: SPIR-V of the pending pipeline, handed to reload
+	std::vector<uint32_t> pending_code[2];
+};
+
+std::mutex watcher_mutex;
+std::vector<ShaderSource> sources;
+std::vector<WatchedProgram> programs;
+
+std::thread watcher_thread;
+std::atomic<bool> watcher_quit;
+// NOTE: Programs are still registered, their pipelines just never reload
+bool hot_reload_disabled;
+
+#ifdef __linux__
+int inotify_fd = -1;
+std::unordered_map<int, fs::path> watched_directories;
+#endif
+
+#ifdef VEEKAY_HAS_SHADERC
+shaderc_compiler_t shader_compiler;
+#endif
+
+bool compileShader(const fs::path& path, std::vector<uint32_t>& code) {
+#ifdef VEEKAY_HAS_SHADERC
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open shader file: " << path.string() << '\n';
+		return false;
+	}
+
+	std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	const fs::path extension = path.extension();
+
+	shaderc_shader_kind kind = shaderc_glsl_infer_from_source;
+	if (extension == ".vert") {
+		kind = shaderc_vertex_shader;
+	} else if (extension == ".frag") {
+		kind = shaderc_fragment_shader;
+	} else if (extension == ".comp") {
+		kind = shaderc_compute_shader;
+	}
+
+	const std::string name = path.string();
+
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(
+		shader_compiler, source.data(), source.size(), kind, name.c_str(), "main", nullptr);
+
+	if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success) {
+		std::cerr << shaderc_result_get_error_message(result);
+		shaderc_result_release(result);
+		return false;
+	}
+
+	const size_t size = shaderc_result_get_length(result);
+
+	code.resize(size / sizeof(uint32_t));
+	memcpy(code.data(), shaderc_result_get_bytes(result), size);
+
+	shaderc_result_release(result);
+#else
+	// NOTE: No shaderc, shell out to glslc from Vulkan SDK
+	const fs::path output = fs::temp_directory_path() / (path.filename().string() + ".reload.spv");
+	const std::string command = "glslc \"" + path.string() + "\" -o \"" + output.string() + "\"";
+
+	if (std::system(command.c_str()) != 0) {
+		std::cerr << "Failed to compile shader: " << path.string() << '\n';
+		return false;
+	}
+
+	std::ifstream file(output, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open compiled shader: " << output.string() << '\n';
+		return false;
+	}
+
+	const size_t size = file.tellg();
+
+	code.resize(size / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), size);
+#endif
+
+	return true;
+}
+
+// NOTE: Blocks for a short while, marks sources that changed on disk as dirty
+void waitForChanges() {
+#ifdef __linux__
+	pollfd fd{.fd = inotify_fd, .events = POLLIN};
+
+	if (poll(&fd, 1, 100) <= 0) {
+		return;
+	}
+
+	// NOTE: Editors tend to write a file in several steps, let them finish
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	alignas(inotify_event) char buffer[4096];
+
+	std::lock_guard lock(watcher_mutex);
+
+	for (;;) {
+		const ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->len == 0) {
+				continue;
+			}
+
+			const fs::path changed = watched_directories[event->wd] / event->name;
+
+			for (ShaderSource& source : sources) {
+				if (source.path == changed) {
+					source.dirty = true;
+				}
+			}
+		}
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+	std::lock_guard lock(watcher_mutex);
+
+	for (ShaderSource& source : sources) {
+		std::error_code error;
+		const fs::file_time_type time = fs::last_write_time(source.path, error);
+
+		if (!error && time != source.write_time) {
+			source.write_time = time;
+			source.dirty = true;
+		}
+	}
+#endif
+}
+
+uint64_t hashCode(const std::vector<uint32_t>* code, uint32_t stage_count) {
+	uint64_t hash = veekay::internal::hash_seed;
+
+	for (uint32_t stage = 0; stage < stage_count; ++stage) {
+		hash = veekay::internal::hashBytes(code[stage].data(), code[stage].size() * sizeof(uint32_t), hash);
+	}
+
+	return hash;
+}
+
+// NOTE: Returns nullptr on failure, modules are destroyed either way
+VkPipeline buildPipeline(const WatchedProgram& program, const std::vector<uint32_t>* code) {
+	VkShaderModule modules[2]{};
+	bool created = true;
+
+	for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+		modules[stage] = veekay::createShaderModule(code[stage]);
+		created = created && modules[stage];
+	}
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	if (created) {
+		pipeline = program.stage_count == 1 ? program.compute_factory(modules[0])
+		                                    : program.factory(modules[0], modules[1]);
+	}
+
+	for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+		vkDestroyShaderModule(veekay::app.vk_device, modules[stage], nullptr);
+	}
+
+	return pipeline;
+}
+
+void rebuildChanged() {
+	std::vector<std::pair<uint32_t, fs::path>> changed;
+
+	{
+		std::lock_guard lock(watcher_mutex);
+
+		for (uint32_t i = 0; i < sources.size(); ++i) {
+			if (sources[i].dirty) {
+				sources[i].dirty = false;
+				changed.emplace_back(i, sources[i].path);
+			}
+		}
+	}
+
+	if (changed.empty()) {
+		return;
+	}
+
+	std::vector<bool> recompiled;
+
+	for (auto& [index, path] : changed) {
+		std::vector<uint32_t> code;
+
+		if (!compileShader(path, code)) {
+			continue;
+		}
+
+		std::lock_guard lock(watcher_mutex);
+
+		recompiled.resize(sources.size());
+		recompiled[index] = true;
+		sources[index].code = std::move(code);
+	}
+
+	struct Rebuild {
+		uint32_t program;
+		// NOTE: Copy of the program, factories and stages do not change
+		WatchedProgram info;
+		std::vector<uint32_t> code[2];
+		fs::path paths[2];
+	};
+
+	std::vector<Rebuild> rebuilds;
+
+	{
+		std::lock_guard lock(watcher_mutex);
+
+		for (uint32_t i = 0; i < programs.size(); ++i) {
+			const WatchedProgram& program = programs[i];
+
+			bool affected = false;
+			for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+				const uint32_t id = program.source_ids[stage];
+				affected = affected || (id < recompiled.size() && recompiled[id]);
+			}
+
+			if (!affected) {
+				continue;
+			}
+
+			Rebuild rebuild{
+				.program = i,
+				.info = {
+					.source_ids = {program.source_ids[0], program.source_ids[1]},
+					.stage_count = program.stage_count,
+					.factory = program.factory,
+					.compute_factory = program.compute_factory,
+				},
+			};
+
+			for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+				rebuild.code[stage] = sources[program.source_ids[stage]].code;
+				rebuild.paths[stage] = sources[program.source_ids[stage]].path;
+			}
+
+			rebuilds.push_back(std::move(rebuild));
+		}
+	}
+
+	for (Rebuild& rebuild : rebuilds) {
+		const uint32_t stage_count = rebuild.info.stage_count;
+
+		// NOTE: Other stage was never edited, compile it now to have both
+		bool compiled = true;
+		for (uint32_t stage = 0; stage < stage_count; ++stage) {
+			if (rebuild.code[stage].empty()) {
+				compileShader(rebuild.paths[stage], rebuild.code[stage]);
+			}
+
+			compiled = compiled && !rebuild.code[stage].empty();
+		}
+
+		if (!compiled) {
+			continue;
+		}
+
+		const uint64_t key = hashCode(rebuild.code, stage_count);
+
+		{
+			std::lock_guard lock(watcher_mutex);
+			WatchedProgram& program = programs[rebuild.program];
+
+			auto it = program.cache.find(key);
+			if (it != program.cache.end()) {
+				program.pending = it->second;
+				program.pending_code[0] = std::move(rebuild.code[0]);
+				program.pending_code[1] = std::move(rebuild.code[1]);
+				continue;
+			}
+		}
+
+		VkPipeline pipeline = buildPipeline(rebuild.info, rebuild.code);
+		if (!pipeline) {
+			std::cerr << "Failed to rebuild pipeline for " << rebuild.paths[0].string();
+			if (stage_count == 2) {
+				std::cerr << " and " << rebuild.paths[1].string();
+			}
+			std::cerr << '\n';
+			continue;
+		}
+
+		std::lock_guard lock(watcher_mutex);
+		WatchedProgram& program = programs[rebuild.program];
+
+		program.cache[key] = pipeline;
+		program.pending = pipeline;
+		program.pending_code[0] = std::move(rebuild.code[0]);
+		program.pending_code[1] = std::move(rebuild.code[1]);
+	}
+}
+
+// NOTE: Sources are assumed to be what the caller built its pipeline from, they
+//       are compiled by the same compiler later edits go through, so reverting
+//       to them gives the same key
+void keyInitialPipelines() {
+	struct Initial {
+		uint32_t program;
+		uint32_t stage_count;
+		uint32_t source_ids[2];
+		fs::path paths[2];
+		fs::file_time_type write_times[2];
+	};
+
+	std::vector<Initial> initials;
+
+	{
+		std::lock_guard lock(watcher_mutex);
+
+		for (uint32_t i = 0; i < programs.size(); ++i) {
+			WatchedProgram& program = programs[i];
+
+			if (!program.initial || program.initial_checked) {
+				continue;
+			}
+
+			program.initial_checked = true;
+
+			Initial initial{
+				.program = i,
+				.stage_count = program.stage_count,
+				.source_ids = {program.source_ids[0], program.source_ids[1]},
+				.write_times = {program.initial_write_times[0], program.initial_write_times[1]},
+			};
+
+			for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+				initial.paths[stage] = sources[program.source_ids[stage]].path;
+			}
+
+			initials.push_back(std::move(initial));
+		}
+	}
+
+	for (const Initial& initial : initials) {
+		std::vector<uint32_t> code[2];
+		bool unchanged = true;
+
+		for (uint32_t stage = 0; stage < initial.stage_count && unchanged; ++stage) {
+			std::error_code error;
+
+			unchanged = compileShader(initial.paths[stage], code[stage]) &&
+			            fs::last_write_time(initial.paths[stage], error) == initial.write_times[stage] &&
+			            !error;
+		}
+
+		if (!unchanged) {
+			continue;
+		}
+
+		const uint64_t key = hashCode(code, initial.stage_count);
+
+		std::lock_guard lock(watcher_mutex);
+		WatchedProgram& program = programs[initial.program];
+
+		if (program.cache.try_emplace(key, program.initial).second) {
+			program.initial = VK_NULL_HANDLE;
+		}
+
+		// NOTE: Spares compiling the other stage when only one is edited
+		for (uint32_t stage = 0; stage < initial.stage_count; ++stage) {
+			ShaderSource& source = sources[initial.source_ids[stage]];
+
+			if (source.code.empty() && !source.dirty) {
+				source.code = std::move(code[stage]);
+			}
+		}
+	}
+}
+
+void watcherMain() {
+	veekay::setThreadName("shader watcher");
+
+#ifdef VEEKAY_HAS_SHADERC
+	shader_compiler = shaderc_compiler_initialize();
+#endif
+
+	while (!watcher_quit) {
+		keyInitialPipelines();
+		waitForChanges();
+		rebuildChanged();
+	}
+
+#ifdef VEEKAY_HAS_SHADERC
+	shaderc_compiler_release(shader_compiler);
+#endif
+}
+
+uint32_t addSource(const char* path) {
+	std::error_code error;
+	fs::path normalized = fs::weakly_canonical(path, error);
+	if (error) {
+		normalized = fs::absolute(path);
+	}
+
+	for (uint32_t i = 0; i < sources.size(); ++i) {
+		if (sources[i].path == normalized) {
+			return i;
+		}
+	}
+
+	sources.push_back(ShaderSource{
+		.path = normalized,
+		.write_time = fs::last_write_time(normalized, error),
+	});
+
+#ifdef __linux__
+	if (inotify_fd < 0) {
+		return static_cast<uint32_t>(sources.size() - 1);
+	}
+
+	const fs::path directory = normalized.parent_path();
+
+	const int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0) {
+		std::cerr << "Failed to watch shader directory: " << directory.string() << '\n';
+	} else {
+		watched_directories[wd] = directory;
+	}
+#endif
+
+	return static_cast<uint32_t>(sources.size() - 1);
+}
+
+// NOTE: Call with watcher_mutex locked, before adding sources of the program
+void startWatcher() {
+	if (watcher_thread.joinable() || hot_reload_disabled) {
+		return;
+	}
+
+#ifdef __linux__
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0) {
+		std::cerr << "Failed to initialize inotify, shader hot-reload is disabled\n";
+		hot_reload_disabled = true;
+		return;
+	}
+#endif
+
+	watcher_quit = false;
+	watcher_thread = std::thread(watcherMain);
+}
+
+// NOTE: Call with watcher_mutex locked
+void addProgram(WatchedProgram&& program) {
+	for (uint32_t stage = 0; stage < program.stage_count; ++stage) {
+		std::error_code error;
+		program.initial_write_times[stage] =
+			fs::last_write_time(sources[program.source_ids[stage]].path, error);
+	}
+
+	programs.push_back(std::move(program));
+}
+
+} // namespace
+
+VkShaderModule veekay::createShaderModule(std::span<const uint32_t> code) {
+	VkShaderModuleCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = code.size_bytes(),
+		.pCode = code.data(),
+	};
+
+	VkShaderModule result;
+	if (vkCreateShaderModule(app.vk_device, &info, nullptr, &result) != VK_SUCCESS) {
+		return nullptr;
+	}
+
+	return result;
+}
+
+void veekay::watchShaders(const char* vertex_path, const char* fragment_path,
+                          PipelineFactory factory, VkPipeline* pipeline, ReloadFunc reload) {
+	std::lock_guard lock(watcher_mutex);
+	startWatcher();
+
+	addProgram(WatchedProgram{
+		.source_ids = {addSource(vertex_path), addSource(fragment_path)},
+		.stage_count = 2,
+		.factory = factory,
+		.target = pipeline,
+		.reload = reload,
+		.initial = *pipeline,
+	});
+}
+
+void veekay::watchComputeShader(const char* compute_path, ComputePipelineFactory factory,
+                                VkPipeline* pipeline) {
+	std::lock_guard lock(watcher_mutex);
+	startWatcher();
+
+	addProgram(WatchedProgram{
+		.source_ids = {addSource(compute_path)},
+		.stage_count = 1,
+		.compute_factory = factory,
+		.target = pipeline,
+		.initial = *pipeline,
+	});
+}
+
+void veekay::internal::applyShaderReloads() {
+	struct Reload {
+		veekay::ReloadFunc func;
+		std::vector<uint32_t> code[2];
+	};
+
+	std::vector<Reload> reloads;
+
+	{
+		std::lock_guard lock(watcher_mutex);
+
+		for (WatchedProgram& program : programs) {
+			if (!program.pending) {
+				continue;
+			}
+
+			*program.target = program.pending;
+			program.pending = VK_NULL_HANDLE;
+
+			if (program.reload) {
+				reloads.push_back(Reload{
+					.func = program.reload,
+					.code = {std::move(program.pending_code[0]), std::move(program.pending_code[1])},
+				});
+			}
+
+			program.pending_code[0].clear();
+			program.pending_code[1].clear();
+		}
+	}
+
+	// NOTE: Outside of the lock, callbacks may watch more shaders
+	for (Reload& reload : reloads) {
+		reload.func(reload.code[0], reload.code[1]);
+	}
+}
+
+void veekay::internal::shutdownShaders() {
+	if (watcher_thread.joinable()) {
+		watcher_quit = true;
+		watcher_thread.join();
+	}
+
+#ifdef __linux__
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+
+	watched_directories.clear();
+#endif
+
+	for (WatchedProgram& program : programs) {
+		for (auto& [key, pipeline] : program.cache) {
+			vkDestroyPipeline(veekay::app.vk_device, pipeline, nullptr);
+		}
+
+		vkDestroyPipeline(veekay::app.vk_device, program.initial, nullptr);
+	}
+
+	programs.clear();
+	sources.clear();
+	hot_reload_disabled = false;
+}
@@ -0,0 +1,626 @@
+#include <cstdint>
+#include <cstdio>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/streaming.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/memory.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+constexpr uint32_t mesh_file_magic = 0x534d4b56; // NOTE: "VKMS"
+constexpr uint32_t mesh_file_version = 1;
+
+// NOTE: Indices follow vertices at this alignment
+constexpr VkDeviceSize index_alignment = 16;
+
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_stride;
+	uint32_t vertex_count;
+	uint32_t index_count;
+};
+
+struct LodState {
+	std::string path;
+
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkDeviceSize index_offset;
+	uint32_t index_count;
+
+	bool resident;
+	bool loading;
+	// NOTE: Coarsest LOD of a mesh stays resident no matter the budget
+	bool pinned;
+	uint64_t last_used;
+};
+
+struct MeshState {
+	std::vector<LodState> lods;
+};
+
+struct LoadRequest {
+	veekay::StreamedMeshId mesh;
+	uint32_t lod;
+	std::string path;
+};
+
+struct LoadResult {
+	veekay::StreamedMeshId mesh;
+	uint32_t lod;
+	bool ok;
+
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkDeviceSize index_offset;
+	uint32_t index_count;
+	veekay::TimelinePoint point;
+};
+
+// NOTE: Main thread only
+std::vector<MeshState> meshes;
+uint64_t streaming_frame;
+VkDeviceSize resident_bytes;
+VkDeviceSize budget_override;
+VkDeviceSize current_budget;
+uint64_t eviction_count;
+
+bool memory_budget_available;
+VkPhysicalDeviceMemoryProperties memory_properties;
+
+// NOTE: Loader thread owns the command pool, everything else is shared under the mutex
+VkCommandPool loader_command_pool;
+std::thread loader_thread;
+std::mutex loader_mutex;
+std::condition_variable loader_condition;
+std::deque<LoadRequest> load_queue;
+std::vector<LoadResult> load_results;
+bool loader_quit;
+
+uint32_t findMemoryType(uint32_t type_bits, VkMemoryPropertyFlags flags) {
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		if ((type_bits & (1 << i)) &&
+		    (memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
+			return i;
+		}
+	}
+
+	return UINT_MAX;
+}
+
+bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags,
+                  veekay::MemoryCategory category,
+                  VkBuffer& buffer, VkDeviceMemory& memory, VkDeviceSize& allocated) {
+	VkDevice device = veekay::app.vk_device;
+
+	const uint32_t families[] = {
+		veekay::app.vk_graphics_queue_family,
+		veekay::app.vk_transfer_queue_family,
+	};
+
+	// NOTE: Written on transfer queue, read on graphics one
+	const bool concurrent = families[0] != families[1];
+
+	VkBufferCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = concurrent ? 2u : 0u,
+		.pQueueFamilyIndices = concurrent ? families : nullptr,
+	};
+
+	if (vkCreateBuffer(device, &info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan streaming buffer\n";
+		return false;
+	}
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+	uint32_t index = findMemoryType(requirements.memoryTypeBits, flags);
+
+	// NOTE: Integrated GPUs may have no device local type left, any memory will do
+	if (index == UINT_MAX && (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+		index = findMemoryType(requirements.memoryTypeBits, flags & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	if (index == UINT_MAX) {
+		std::cerr << "Failed to find memory type for streaming buffer\n";
+		vkDestroyBuffer(device, buffer, nullptr);
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocate_info{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = index,
+	};
+
+	if (veekay::allocateMemory(allocate_info, category, &memory) != VK_SUCCESS) {
+		std::cerr << "Failed to allocate Vulkan streaming buffer memory\n";
+		vkDestroyBuffer(device, buffer, nullptr);
+		return false;
+	}
+
+	vkBindBufferMemory(device, buffer, memory, 0);
+
+	allocated = requirements.size;
+
+	return true;
+}
+
+void destroyBuffer(VkBuffer buffer, VkDeviceMemory memory) {
+	vkDestroyBuffer(veekay::app.vk_device, buffer, nullptr);
+	veekay::freeMemory(memory);
+}
+
+// NOTE: Reads a LOD file straight into a staging buffer and copies it into
+//       device local memory on transfer queue. Runs on the loader thread
+bool loadLod(const LoadRequest& request, LoadResult& result) {
+	VkDevice device = veekay::app.vk_device;
+
+	FILE* file = std::fopen(request.path.c_str(), "rb");
+	if (!file) {
+		std::cerr << "Failed to open mesh file: " << request.path << '\n';
+		return false;
+	}
+
+	MeshFileHeader header;
+	if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+	    header.magic != mesh_file_magic || header.version != mesh_file_version) {
+		std::cerr << "Not a veekay mesh file: " << request.path << '\n';
+		std::fclose(file);
+		return false;
+	}
+
+	const VkDeviceSize vertex_bytes = VkDeviceSize(header.vertex_stride) * header.vertex_count;
+	const VkDeviceSize index_bytes = VkDeviceSize(header.index_count) * sizeof(uint32_t);
+	const VkDeviceSize index_offset = (vertex_bytes + index_alignment - 1) & ~(index_alignment - 1);
+	const VkDeviceSize size = index_offset + index_bytes;
+
+	VkBuffer staging;
+	VkDeviceMemory staging_memory;
+	VkDeviceSize staging_size;
+
+	if (!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                  veekay::MemoryCategory::staging,
+	                  staging, staging_memory, staging_size)) {
+		std::fclose(file);
+		return false;
+	}
+
+	bool complete = false;
+
+	void* mapped;
+	if (vkMapMemory(device, staging_memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS) {
+		uint8_t* bytes = static_cast<uint8_t*>(mapped);
+
+		complete = std::fread(bytes, 1, vertex_bytes, file) == vertex_bytes &&
+		           std::fread(bytes + index_offset, 1, index_bytes, file) == index_bytes;
+
+		vkUnmapMemory(device, staging_memory);
+	}
+
+	std::fclose(file);
+
+	if (!complete) {
+		std::cerr << "Truncated mesh file: " << request.path << '\n';
+		destroyBuffer(staging, staging_memory);
+		return false;
+	}
+
+	if (!createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+	                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+	                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	                  veekay::MemoryCategory::geometry,
+	                  result.buffer, result.memory, result.size)) {
+		destroyBuffer(staging, staging_memory);
+		return false;
+	}
+
+	veekay::setObjectName(VK_OBJECT_TYPE_BUFFER, (uint64_t)result.buffer, request.path.c_str());
+
+	VkCommandBuffer cmd;
+
+	{
+		VkCommandBufferAllocateInfo info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = loader_command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+
+		vkAllocateCommandBuffers(device, &info, &cmd);
+	}
+
+	{
+		VkCommandBufferBeginInfo info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+
+		vkBeginCommandBuffer(cmd, &info);
+
+		VkBufferCopy region{.size = size};
+		vkCmdCopyBuffer(cmd, staging, result.buffer, 1, &region);
+
+		vkEndCommandBuffer(cmd);
+	}
+
+	result.point = veekay::submit(veekay::Queue::transfer, cmd);
+
+	// NOTE: Only this thread is held up, frames go on meanwhile
+	veekay::wait(result.point);
+
+	vkFreeCommandBuffers(device, loader_command_pool, 1, &cmd);
+	destroyBuffer(staging, staging_memory);
+
+	result.index_offset = index_offset;
+	result.index_count = header.index_count;
+
+	return true;
+}
+
+void loaderMain() {
+	veekay::setThreadName("mesh loader");
+
+	std::unique_lock lock(loader_mutex);
+
+	for (;;) {
+		loader_condition.wait(lock, [] { return !load_queue.empty() || loader_quit; });
+
+		if (loader_quit) {
+			break;
+		}
+
+		LoadRequest request = std::move(load_queue.front());
+		load_queue.pop_front();
+
+		lock.unlock();
+
+		LoadResult result{.mesh = request.mesh, .lod = request.lod};
+		{
+			veekay::TraceZone zone("load lod");
+			result.ok = loadLod(request, result);
+		}
+
+		lock.lock();
+
+		load_results.push_back(result);
+	}
+}
+
+void queueLoad(veekay::StreamedMeshId mesh, uint32_t lod, bool urgent) {
+	LodState& state = meshes[mesh].lods[lod];
+	state.loading = true;
+
+	{
+		std::lock_guard lock(loader_mutex);
+
+		LoadRequest request{.mesh = mesh, .lod = lod, .path = state.path};
+
+		if (urgent) {
+			load_queue.push_front(std::move(request));
+		} else {
+			load_queue.push_back(std::move(request));
+		}
+	}
+
+	loader_condition.notify_one();
+}
+
+void evict(LodState& state) {
+	const VkBuffer buffer = state.buffer;
+	const VkDeviceMemory memory = state.memory;
+
+	// NOTE: Frames in flight may still draw it
+	veekay::deferDestroy([buffer, memory] { destroyBuffer(buffer, memory); });
+
+	resident_bytes -= state.size;
+
+	state.resident = false;
+	state.buffer = VK_NULL_HANDLE;
+	state.memory = VK_NULL_HANDLE;
+	state.size = 0;
+}
+
+VkDeviceSize queryBudget() {
+	if (budget_override) {
+		return budget_override;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+
+	VkPhysicalDeviceMemoryProperties2 properties{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = memory_budget_available ? &budget : nullptr,
+	};
+
+	vkGetPhysicalDeviceMemoryProperties2(veekay::app.vk_physical_device, &properties);
+
+	const VkPhysicalDeviceMemoryProperties& memory = properties.memoryProperties;
+
+	VkDeviceSize result = 0;
+
+	for (uint32_t i = 0; i < memory.memoryHeapCount; ++i) {
+		if (!(memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+			continue;
+		}
+
+		if (memory_budget_available) {
+			// NOTE: Usage reported for the heap already includes our own buffers
+			if (budget.heapBudget[i] > budget.heapUsage[i]) {
+				result += budget.heapBudget[i] - budget.heapUsage[i];
+			}
+		} else {
+			result += memory.memoryHeaps[i].size / 2;
+		}
+	}
+
+	if (memory_budget_available) {
+		result += resident_bytes;
+	}
+
+	return result;
+}
+
+} // namespace
+
+bool veekay::writeMeshFile(const char* path, const void* vertices, uint32_t vertex_stride,
+                           uint32_t vertex_count, std::span<const uint32_t> indices) {
+	FILE* file = std::fopen(path, "wb");
+	if (!file) {
+		std::cerr << "Failed to open mesh file for writing: " << path << '\n';
+		return false;
+	}
+
+	const MeshFileHeader header{
+		.magic = mesh_file_magic,
+		.version = mesh_file_version,
+		.vertex_stride = vertex_stride,
+		.vertex_count = vertex_count,
+		.index_count = static_cast<uint32_t>(indices.size()),
+	};
+
+	std::fwrite(&header, sizeof(header), 1, file);
+	std::fwrite(vertices, vertex_stride, vertex_count, file);
+	std::fwrite(indices.data(), sizeof(uint32_t), indices.size(), file);
+
+	std::fclose(file);
+
+	return true;
+}
+
+veekay::StreamedMeshId veekay::addStreamedMesh(std::span<const char* const> lod_paths) {
+	// NOTE: Applications that do not stream never pay for the thread
+	if (!loader_thread.joinable()) {
+		loader_quit = false;
+		loader_thread = std::thread(loaderMain);
+	}
+
+	const StreamedMeshId id = static_cast<StreamedMeshId>(meshes.size());
+
+	MeshState& mesh = meshes.emplace_back();
+
+	for (const char* path : lod_paths) {
+		mesh.lods.push_back(LodState{.path = path});
+	}
+
+	if (!mesh.lods.empty()) {
+		mesh.lods.back().pinned = true;
+		queueLoad(id, static_cast<uint32_t>(mesh.lods.size() - 1), true);
+	}
+
+	return id;
+}
+
+bool veekay::requestMesh(StreamedMeshId mesh, uint32_t lod, StreamedMesh& result) {
+	if (mesh >= meshes.size() || meshes[mesh].lods.empty()) {
+		return false;
+	}
+
+	std::vector<LodState>& lods = meshes[mesh].lods;
+	const uint32_t lod_count = static_cast<uint32_t>(lods.size());
+
+	lod = std::min(lod, lod_count - 1);
+
+	LodState& wanted = lods[lod];
+	wanted.last_used = streaming_frame;
+
+	// NOTE: Do not pull in more while over budget, eviction has to catch up first
+	if (!wanted.resident && !wanted.loading && resident_bytes < current_budget) {
+		queueLoad(mesh, lod, false);
+	}
+
+	// NOTE: Coarser LODs first, then finer ones
+	uint32_t found = UINT_MAX;
+
+	for (uint32_t i = lod; i < lod_count && found == UINT_MAX; ++i) {
+		if (lods[i].resident) found = i;
+	}
+
+	for (uint32_t i = lod; i-- > 0 && found == UINT_MAX;) {
+		if (lods[i].resident) found = i;
+	}
+
+	if (found == UINT_MAX) {
+		return false;
+	}
+
+	LodState& state = lods[found];
+	state.last_used = streaming_frame;
+
+	result = StreamedMesh{
+		.buffer = state.buffer,
+		.index_offset = state.index_offset,
+		.index_count = state.index_count,
+		.lod = found,
+	};
+
+	return true;
+}
+
+void veekay::setStreamingBudget(VkDeviceSize bytes) {
+	budget_override = bytes;
+}
+
+veekay::StreamingStats veekay::streamingStats() {
+	StreamingStats stats{
+		.resident_bytes = resident_bytes,
+		.budget_bytes = current_budget,
+		.evictions = eviction_count,
+	};
+
+	for (const MeshState& mesh : meshes) {
+		for (const LodState& lod : mesh.lods) {
+			stats.resident_lods += lod.resident;
+			stats.loading_lods += lod.loading;
+		}
+	}
+
+	return stats;
+}
+
+bool veekay::internal::initStreaming(bool memory_budget) {
+	memory_budget_available = memory_budget;
+	vkGetPhysicalDeviceMemoryProperties(veekay::app.vk_physical_device, &memory_properties);
+
+	VkCommandPoolCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = veekay::app.vk_transfer_queue_family,
+	};
+
+	if (vkCreateCommandPool(veekay::app.vk_device, &info, nullptr, &loader_command_pool) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan streaming command pool\n";
+		return false;
+	}
+
+	streaming_frame = 0;
+	current_budget = queryBudget();
+
+	return true;
+}
+
+void veekay::internal::updateStreaming() {
+	++streaming_frame;
+
+	std::vector<LoadResult> results;
+
+	{
+		std::lock_guard lock(loader_mutex);
+		results.swap(load_results);
+	}
+
+	for (const LoadResult& result : results) {
+		LodState& state = meshes[result.mesh].lods[result.lod];
+		state.loading = false;
+
+		if (!result.ok) {
+			continue;
+		}
+
+		state.buffer = result.buffer;
+		state.memory = result.memory;
+		state.size = result.size;
+		state.index_offset = result.index_offset;
+		state.index_count = result.index_count;
+		state.resident = true;
+		// NOTE: Count as just used, otherwise it could be evicted before the first draw
+		state.last_used = streaming_frame;
+
+		resident_bytes += result.size;
+
+		// NOTE: Upload has finished on host side already, this is the memory
+		//       dependency that makes transfer writes visible to vertex input
+		veekay::waitInFrame(result.point, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+
+	current_budget = queryBudget();
+
+	// NOTE: Least recently drawn first. LODs drawn last frame are still in use,
+	//       evicting them would only make them load again right away
+	while (resident_bytes > current_budget) {
+		LodState* victim = nullptr;
+
+		for (MeshState& mesh : meshes) {
+			for (LodState& lod : mesh.lods) {
+				if (!lod.resident || lod.pinned || lod.last_used + 1 >= streaming_frame) {
+					continue;
+				}
+
+				if (!victim || lod.last_used < victim->last_used) {
+					victim = &lod;
+				}
+			}
+		}
+
+		if (!victim) {
+			break;
+		}
+
+		evict(*victim);
+		++eviction_count;
+	}
+}
+
+void veekay::internal::shutdownStreaming() {
+	if (loader_thread.joinable()) {
+		{
+			std::lock_guard lock(loader_mutex);
+			loader_quit = true;
+		}
+
+		loader_condition.notify_all();
+		loader_thread.join();
+	}
+
+	// NOTE: Loader is gone and its uploads are complete, buffers may still be
+	//       drawn by frames in flight, deferred destruction handles them
+	for (LoadResult& result : load_results) {
+		if (result.ok) {
+			const VkBuffer buffer = result.buffer;
+			const VkDeviceMemory memory = result.memory;
+			veekay::deferDestroy([buffer, memory] { destroyBuffer(buffer, memory); });
+		}
+	}
+
+	for (MeshState& mesh : meshes) {
+		for (LodState& lod : mesh.lods) {
+			if (lod.resident) {
+				evict(lod);
+			}
+		}
+	}
+
+	load_results.clear();
+	load_queue.clear();
+	meshes.clear();
+
+	vkDestroyCommandPool(veekay::app.vk_device, loader_command_pool, nullptr);
+	loader_command_pool = VK_NULL_HANDLE;
+}
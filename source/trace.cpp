@@ -0,0 +1,603 @@
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <veekay/veekay.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/jobs.hpp>
+
+#include "internal.hpp"
+
+namespace {
+
+// NOTE: Zones kept per thread, older ones get overwritten
+constexpr uint64_t zone_capacity = 8192;
+constexpr uint32_t max_zone_depth = 64;
+
+// NOTE: Per frame in flight, every GPU zone takes two timestamp queries
+constexpr uint32_t max_gpu_zones = 128;
+constexpr uint32_t queries_per_frame = max_gpu_zones * 2;
+constexpr uint32_t no_query = UINT32_MAX;
+
+// NOTE: Device clock drifts away from the CPU one, calibrate again this often
+constexpr int64_t calibration_interval = 1'000'000'000;
+// NOTE: Samples are retried when the driver could not read both clocks closer
+//       than this, the closest one is kept if none gets there
+constexpr uint64_t calibration_max_deviation = 20'000;
+constexpr uint64_t calibration_reject_deviation = 1'000'000;
+constexpr int calibration_attempts = 4;
+// NOTE: Least time between two dumps made because of spikes
+constexpr int64_t spike_dump_interval = 1'000'000'000;
+
+int64_t now() {
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// NOTE: Dumps start counting time here
+const int64_t trace_origin = now();
+
+// NOTE: Fields are atomic since a dump may read a zone while its thread overwrites it
+struct ZoneEvent {
+	std::atomic<const char*> name;
+	std::atomic<int64_t> begin;
+	std::atomic<int64_t> end;
+};
+
+struct ZoneTrack {
+	uint32_t id;
+	std::atomic<const char*> name;
+
+	// NOTE: Only one thread writes a track. started moves before a zone is
+	//       written and finished after, dumps drop zones started may overwrite
+	std::atomic<uint64_t> started;
+	std::atomic<uint64_t> finished;
+	ZoneEvent events[zone_capacity];
+
+	// NOTE: Zones begun and not ended yet, touched by the owning thread only
+	const char* open_names[max_zone_depth];
+	int64_t open_begins[max_zone_depth];
+	uint32_t open_count;
+	// NOTE: Zones nested deeper than max_zone_depth, those are not recorded
+	uint32_t overflow_count;
+};
+
+struct CopiedZone {
+	const char* name;
+	int64_t begin;
+	int64_t end;
+	uint32_t track;
+};
+
+struct CopiedTrack {
+	uint32_t id;
+	const char* name;
+};
+
+// NOTE: Tracks outlive their threads, so zones of finished threads can still be dumped
+std::mutex track_mutex;
+std::vector<std::unique_ptr<ZoneTrack>> tracks;
+thread_local ZoneTrack* thread_track;
+
+struct GpuZone {
+	const char* name;
+	uint32_t begin_query;
+	uint32_t end_query;
+};
+
+struct GpuFrame {
+	std::vector<GpuZone> zones;
+	uint32_t query_count;
+	int64_t submit_time;
+	bool submitted;
+};
+
+VkQueryPool query_pool;
+std::vector<GpuFrame> gpu_frames;
+uint32_t gpu_frame;
+// NOTE: GPU zones are only recorded into this one
+VkCommandBuffer gpu_frame_cmd;
+// NOTE: Zones of gpu_frame not ended yet, no_query for ones over max_gpu_zones
+std::vector<uint32_t> open_gpu_zones;
+ZoneTrack* gpu_track;
+
+double timestamp_period;
+uint32_t timestamp_bits;
+
+// NOTE: Null without VK_EXT_calibrated_timestamps or a host time domain
+//       steady_clock reads from
+PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+uint64_t calibration_ticks;
+int64_t calibration_time;
+int64_t calibrated_at = -calibration_interval;
+// NOTE: Stays false until a sample is good enough
+bool calibrated;
+
+uint32_t frames_in_flight;
+uint64_t frame_index;
+int64_t last_frame_end;
+
+double spike_threshold;
+std::string spike_pattern;
+// NOTE: Frames left until a spike is dumped, zero when none is pending
+uint32_t spike_countdown;
+uint64_t spike_frame;
+int64_t last_spike_dump = -spike_dump_interval;
+
+ZoneTrack* createTrack(const char* name) {
+	std::lock_guard lock(track_mutex);
+
+	tracks.push_back(std::make_unique<ZoneTrack>());
+
+	ZoneTrack* track = tracks.back().get();
+	track->id = static_cast<uint32_t>(tracks.size());
+	track->name.store(name, std::memory_order_relaxed);
+
+	return track;
+}
+
+ZoneTrack& threadTrack() {
+	if (!thread_track) {
+		thread_track = createTrack(nullptr);
+	}
+
+	return *thread_track;
+}
+
+void pushZone(ZoneTrack& track, const char* name, int64_t begin, int64_t end) {
+	const uint64_t index = track.finished.load(std::memory_order_relaxed);
+
+	track.started.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	ZoneEvent& event = track.events[index % zone_capacity];
+	event.name.store(name, std::memory_order_relaxed);
+	event.begin.store(begin, std::memory_order_relaxed);
+	event.end.store(end, std::memory_order_relaxed);
+
+	track.finished.store(index + 1, std::memory_order_release);
+}
+
+void copyZones(const ZoneTrack& track, std::vector<CopiedZone>& zones) {
+	const uint64_t finished = track.finished.load(std::memory_order_acquire);
+	const uint64_t first = finished > zone_capacity ? finished - zone_capacity : 0;
+
+	const size_t base = zones.size();
+
+	for (uint64_t i = first; i < finished; ++i) {
+		const ZoneEvent& event = track.events[i % zone_capacity];
+
+		zones.push_back(CopiedZone{
+			.name = event.name.load(std::memory_order_relaxed),
+			.begin = event.begin.load(std::memory_order_relaxed),
+			.end = event.end.load(std::memory_order_relaxed),
+			.track = track.id,
+		});
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	// NOTE: Zone i shares its slot with zone i + zone_capacity, drop the ones
+	//       the owning thread may have overwritten while we were copying
+	const uint64_t started = track.started.load(std::memory_order_relaxed);
+	const uint64_t valid = started > zone_capacity ? started - zone_capacity : 0;
+
+	if (valid > first) {
+		const size_t stale = static_cast<size_t>(std::min(valid, finished) - first);
+		zones.erase(zones.begin() + base, zones.begin() + base + stale);
+	}
+}
+
+void writeString(FILE* file, const char* string) {
+	std::fputc('"', file);
+
+	for (const char* c = string; *c; ++c) {
+		if (*c == '"' || *c == '\\') {
+			std::fputc('\\', file);
+		}
+
+		if (static_cast<unsigned char>(*c) >= 0x20) {
+			std::fputc(*c, file);
+		}
+	}
+
+	std::fputc('"', file);
+}
+
+bool writeTrace(const std::string& path, const std::vector<CopiedTrack>& named_tracks,
+                const std::vector<CopiedZone>& zones) {
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cerr << "Failed to open trace file for writing: " << path << '\n';
+		return false;
+	}
+
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+
+	for (const CopiedTrack& track : named_tracks) {
+		std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+		             first ? "" : ",\n", track.id);
+		writeString(file, track.name);
+		std::fprintf(file, "}}");
+
+		first = false;
+	}
+
+	for (const CopiedZone& zone : zones) {
+		std::fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+		writeString(file, zone.name);
+
+		// NOTE: Chrome trace timestamps are microseconds
+		std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+		             zone.track, (zone.begin - trace_origin) / 1000.0, (zone.end - zone.begin) / 1000.0);
+
+		first = false;
+	}
+
+	std::fprintf(file, "\n]}\n");
+	std::fclose(file);
+
+	return true;
+}
+
+// NOTE: Both clocks are read by one call, the driver reports how far apart
+//       the reads were. Returns false when no sample was close enough
+bool calibrate() {
+	const VkCalibratedTimestampInfoEXT infos[2]{
+		{
+			.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+			.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+			.timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT,
+		},
+	};
+
+	uint64_t best_deviation = UINT64_MAX;
+	uint64_t best_timestamps[2];
+
+	for (int i = 0; i < calibration_attempts && best_deviation > calibration_max_deviation; ++i) {
+		uint64_t timestamps[2];
+		uint64_t deviation;
+
+		if (get_calibrated_timestamps(veekay::app.vk_device, 2, infos, timestamps, &deviation) != VK_SUCCESS) {
+			return false;
+		}
+
+		if (deviation < best_deviation) {
+			best_deviation = deviation;
+			best_timestamps[0] = timestamps[0];
+			best_timestamps[1] = timestamps[1];
+		}
+	}
+
+	if (best_deviation > calibration_reject_deviation) {
+		return false;
+	}
+
+	// NOTE: steady_clock is CLOCK_MONOTONIC here, its nanoseconds are ours
+	calibration_ticks = best_timestamps[0];
+	calibration_time = static_cast<int64_t>(best_timestamps[1]);
+	calibrated = true;
+
+	return true;
+}
+
+// NOTE: Only the low timestamp_bits bits are valid, the difference is sign
+//       extended from there, so ticks earlier than base work too
+int64_t gpuTime(uint64_t ticks, uint64_t base_ticks, int64_t base_time) {
+	const uint32_t unused_bits = 64 - timestamp_bits;
+	const int64_t delta = static_cast<int64_t>((ticks - base_ticks) << unused_bits) >> unused_bits;
+
+	return base_time + static_cast<int64_t>(static_cast<double>(delta) * timestamp_period);
+}
+
+void readGpuZones(uint32_t frame) {
+	const GpuFrame& gpu = gpu_frames[frame];
+
+	uint64_t timestamps[queries_per_frame];
+
+	VkResult result = vkGetQueryPoolResults(veekay::app.vk_device, query_pool,
+	                                        frame * queries_per_frame, gpu.query_count,
+	                                        sizeof(timestamps), timestamps, sizeof(uint64_t),
+	                                        VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+
+	uint64_t base_ticks = calibration_ticks;
+	int64_t base_time = calibration_time;
+
+	// NOTE: Work can not start before it was submitted, that is the best guess
+	if (!calibrated) {
+		base_ticks = timestamps[gpu.zones[0].begin_query];
+		base_time = gpu.submit_time;
+	}
+
+	for (const GpuZone& zone : gpu.zones) {
+		if (zone.end_query == no_query) {
+			continue;
+		}
+
+		pushZone(*gpu_track, zone.name,
+		         gpuTime(timestamps[zone.begin_query], base_ticks, base_time),
+		         gpuTime(timestamps[zone.end_query], base_ticks, base_time));
+	}
+}
+
+} // namespace
+
+void veekay::beginZone(const char* name) {
+	ZoneTrack& track = threadTrack();
+
+	if (track.open_count == max_zone_depth) {
+		++track.overflow_count;
+		return;
+	}
+
+	track.open_names[track.open_count] = name;
+	track.open_begins[track.open_count] = now();
+	++track.open_count;
+}
+
+void veekay::endZone() {
+	ZoneTrack& track = threadTrack();
+
+	if (track.overflow_count) {
+		--track.overflow_count;
+		return;
+	}
+
+	if (!track.open_count) {
+		return;
+	}
+
+	--track.open_count;
+	pushZone(track, track.open_names[track.open_count], track.open_begins[track.open_count], now());
+}
+
+void veekay::setThreadName(const char* name) {
+	threadTrack().name.store(name, std::memory_order_relaxed);
+}
+
+void veekay::beginGpuZone(VkCommandBuffer cmd, const char* name) {
+	if (!cmd || cmd != gpu_frame_cmd) {
+		return;
+	}
+
+	GpuFrame& frame = gpu_frames[gpu_frame];
+
+	if (frame.zones.size() == max_gpu_zones) {
+		open_gpu_zones.push_back(no_query);
+		return;
+	}
+
+	const uint32_t query = frame.query_count++;
+
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool,
+	                    gpu_frame * queries_per_frame + query);
+
+	open_gpu_zones.push_back(static_cast<uint32_t>(frame.zones.size()));
+	frame.zones.push_back(GpuZone{
+		.name = name,
+		.begin_query = query,
+		.end_query = no_query,
+	});
+}
+
+void veekay::endGpuZone(VkCommandBuffer cmd) {
+	if (!cmd || cmd != gpu_frame_cmd || open_gpu_zones.empty()) {
+		return;
+	}
+
+	const uint32_t zone = open_gpu_zones.back();
+	open_gpu_zones.pop_back();
+
+	if (zone == no_query) {
+		return;
+	}
+
+	GpuFrame& frame = gpu_frames[gpu_frame];
+
+	const uint32_t query = frame.query_count++;
+
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool,
+	                    gpu_frame * queries_per_frame + query);
+
+	frame.zones[zone].end_query = query;
+}
+
+void veekay::dumpTrace(const char* path) {
+	std::vector<CopiedTrack> named_tracks;
+	std::vector<CopiedZone> zones;
+
+	{
+		std::lock_guard lock(track_mutex);
+
+		for (const std::unique_ptr<ZoneTrack>& track : tracks) {
+			if (const char* name = track->name.load(std::memory_order_relaxed)) {
+				named_tracks.push_back(CopiedTrack{.id = track->id, .name = name});
+			}
+
+			copyZones(*track, zones);
+		}
+	}
+
+	// NOTE: Formatting takes a while with full buffers, keep it off the frame
+	veekay::async([path = std::string(path),
+	               named_tracks = std::move(named_tracks),
+	               zones = std::move(zones)] {
+		writeTrace(path, named_tracks, zones);
+	});
+}
+
+void veekay::dumpTraceOnSpike(double frame_milliseconds, const char* path_pattern) {
+	spike_threshold = frame_milliseconds;
+	spike_pattern = path_pattern ? path_pattern : "";
+	spike_countdown = 0;
+}
+
+bool veekay::internal::initTracing(VkInstance instance, uint32_t frame_count, bool calibrated_timestamps) {
+	setThreadName("main");
+
+	gpu_track = createTrack("GPU graphics queue");
+	frames_in_flight = frame_count;
+
+	VkPhysicalDevice physical_device = app.vk_physical_device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+
+	std::vector<VkQueueFamilyProperties> families(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+	timestamp_bits = families[app.vk_graphics_queue_family].timestampValidBits;
+	timestamp_period = properties.limits.timestampPeriod;
+
+	// NOTE: GPU zones become no-ops, CPU zones still work
+	if (!timestamp_bits) {
+		std::cerr << "Graphics queue does not support timestamps, tracing CPU zones only\n";
+		return true;
+	}
+
+	VkQueryPoolCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = frame_count * queries_per_frame,
+	};
+
+	if (vkCreateQueryPool(app.vk_device, &info, nullptr, &query_pool) != VK_SUCCESS) {
+		std::cerr << "Failed to create Vulkan timestamp query pool\n";
+		return false;
+	}
+
+	gpu_frames.resize(frame_count);
+	for (GpuFrame& frame : gpu_frames) {
+		frame.zones.reserve(max_gpu_zones);
+	}
+
+	open_gpu_zones.reserve(max_gpu_zones);
+
+	if (calibrated_timestamps) {
+		auto get_time_domains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+			vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+		get_calibrated_timestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+			vkGetDeviceProcAddr(app.vk_device, "vkGetCalibratedTimestampsEXT"));
+
+		bool device_domain = false;
+		bool host_domain = false;
+
+		if (get_time_domains && get_calibrated_timestamps) {
+			uint32_t domain_count = 0;
+			get_time_domains(physical_device, &domain_count, nullptr);
+
+			std::vector<VkTimeDomainEXT> domains(domain_count);
+			get_time_domains(physical_device, &domain_count, domains.data());
+
+			device_domain = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+#ifdef __linux__
+			host_domain = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) != domains.end();
+#endif
+		}
+
+		if (!device_domain || !host_domain) {
+			get_calibrated_timestamps = nullptr;
+		}
+	}
+
+	return true;
+}
+
+void veekay::internal::beginTraceFrame(VkCommandBuffer cmd, uint32_t frame) {
+	gpu_frame_cmd = VK_NULL_HANDLE;
+
+	if (!query_pool) {
+		return;
+	}
+
+	// NOTE: Rejected samples are retried next frame
+	if (get_calibrated_timestamps && now() - calibrated_at >= calibration_interval && calibrate()) {
+		calibrated_at = now();
+	}
+
+	GpuFrame& gpu = gpu_frames[frame];
+
+	// NOTE: Frame previously recorded into this slot is done by now
+	if (gpu.submitted && !gpu.zones.empty()) {
+		readGpuZones(frame);
+	}
+
+	gpu.zones.clear();
+	gpu.query_count = 0;
+	gpu.submitted = false;
+
+	open_gpu_zones.clear();
+
+	vkCmdResetQueryPool(cmd, query_pool, frame * queries_per_frame, queries_per_frame);
+
+	gpu_frame = frame;
+	gpu_frame_cmd = cmd;
+}
+
+void veekay::internal::endTraceFrame() {
+	const int64_t time = now();
+
+	if (gpu_frame_cmd) {
+		gpu_frames[gpu_frame].submit_time = time;
+		gpu_frames[gpu_frame].submitted = true;
+		gpu_frame_cmd = VK_NULL_HANDLE;
+	}
+
+	++frame_index;
+
+	const int64_t frame_time = last_frame_end ? time - last_frame_end : 0;
+	last_frame_end = time;
+
+	if (spike_countdown) {
+		if (--spike_countdown == 0) {
+			char path[512];
+			std::snprintf(path, sizeof(path), spike_pattern.c_str(), static_cast<uint32_t>(spike_frame));
+
+			std::cerr << "Frame " << spike_frame << " took longer than " << spike_threshold
+			          << " ms, writing trace to " << path << '\n';
+
+			dumpTrace(path);
+			last_spike_dump = time;
+		}
+
+		return;
+	}
+
+	if (spike_threshold > 0.0 && !spike_pattern.empty() &&
+	    frame_time > static_cast<int64_t>(spike_threshold * 1'000'000.0) &&
+	    time - last_spike_dump >= spike_dump_interval) {
+		spike_frame = frame_index;
+		spike_countdown = frames_in_flight;
+	}
+}
+
+void veekay::internal::shutdownTracing() {
+	vkDestroyQueryPool(app.vk_device, query_pool, nullptr);
+
+	query_pool = VK_NULL_HANDLE;
+	gpu_frames.clear();
+	gpu_frame_cmd = VK_NULL_HANDLE;
+	get_calibrated_timestamps = nullptr;
+	calibrated = false;
+	calibrated_at = -calibration_interval;
+}
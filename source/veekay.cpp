@@ -1,8 +1,14 @@
 #include <cstdint>
 #include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <vulkan/vulkan_core.h>
 
@@ -16,6 +22,17 @@
 #include <imgui_impl_vulkan.h>
 
 #include <veekay/veekay.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/render_graph.hpp>
+#include <veekay/jobs.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/depth_pyramid.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/memory.hpp>
+#include <veekay/arena.hpp>
+
+#include "hash.hpp"
+#include "internal.hpp"
 
 namespace {
 
@@ -25,6 +42,12 @@ constexpr char window_title[] = "Veekay";
 
 constexpr uint32_t max_frames_in_flight = 2;
 
+// NOTE: UI rebuild rate while the window is unfocused
+constexpr double unfocused_ui_interval = 0.1;
+
+constexpr double default_simulation_rate = 60.0;
+constexpr uint32_t default_max_simulation_steps = 5;
+
 GLFWwindow* window;
 
 VkInstance vk_instance;
@@ -37,6 +60,7 @@ VkSwapchainKHR vk_swapchain;
 VkFormat vk_swapchain_format;
 std::vector<VkImage> vk_swapchain_images;
 std::vector<VkImageView> vk_swapchain_image_views;
+std::vector<VkDeviceMemory> headless_memory;
 
 VkQueue vk_graphics_queue;
 uint32_t vk_graphics_queue_family;
@@ -44,59 +68,549 @@ uint32_t vk_graphics_queue_family;
 // NOTE: ImGui rendering objects
 VkDescriptorPool imgui_descriptor_pool;
 VkRenderPass imgui_render_pass;
-VkCommandPool imgui_command_pool;
-std::vector<VkCommandBuffer> imgui_command_buffers;
 std::vector<VkFramebuffer> imgui_framebuffers;
+veekay::JobId imgui_vulkan_job;
+bool imgui_vulkan_ready;
+
+// NOTE: UI overlay is recorded into a secondary command buffer per frame in
+//       flight and replayed as is while ImGui draw data stays the same
+VkCommandBuffer imgui_command_buffers[max_frames_in_flight];
+uint64_t imgui_recorded_hashes[max_frames_in_flight];
+uint64_t imgui_recorded_at[max_frames_in_flight];
+uint64_t imgui_record_count;
+uint64_t imgui_draw_hash;
 
 VkFormat vk_image_depth_format;
-VkImage vk_image_depth;
-VkDeviceMemory vk_image_depth_memory;
-VkImageView vk_image_depth_view;
 
 VkRenderPass vk_render_pass;
 std::vector<VkFramebuffer> vk_framebuffers;
 
+// NOTE: Frame is described as a graph: scene pass, then ImGui pass on top.
+//       The graph owns barriers, layout transitions and the depth buffer
+veekay::RenderGraph frame_graph;
+veekay::ResourceId frame_backbuffer;
+veekay::ResourceId frame_depth;
+// NOTE: With several views the scene pass renders into layers of an image of
+//       its own, composed into the backbuffer afterwards. Backbuffer otherwise
+veekay::ResourceId frame_scene_color;
+// NOTE: Built from depth after the scene pass, read by the next frame's scene pass
+veekay::ResourceId frame_depth_pyramid;
+uint32_t vk_current_image;
+
 std::vector<VkSemaphore> vk_render_semaphores;
 std::vector<VkSemaphore> vk_present_semaphores;
-std::vector<VkFence> vk_in_flight_fences;
+// NOTE: Graphics timeline point of each frame in flight, replaces per-frame fences
+veekay::TimelinePoint vk_frame_points[max_frames_in_flight];
 uint32_t vk_current_frame;
 
 VkCommandPool vk_command_pool;
 std::vector<VkCommandBuffer> vk_command_buffers;
 
+// NOTE: Simulation thread state, used only with threaded_simulation
+struct SimulationWorker {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	uint32_t steps;
+	uint32_t slot;
+	bool busy;
+	bool quit;
+};
+
+SimulationWorker simulation_worker;
+
+void simulationWorkerMain(const veekay::ApplicationInfo* app_info, double step) {
+	veekay::setThreadName("simulation");
+
+	std::unique_lock lock(simulation_worker.mutex);
+
+	for (;;) {
+		simulation_worker.condition.wait(lock, [] {
+			return simulation_worker.busy || simulation_worker.quit;
+		});
+
+		if (simulation_worker.quit) {
+			break;
+		}
+
+		const uint32_t steps = simulation_worker.steps;
+		const uint32_t slot = simulation_worker.slot;
+
+		lock.unlock();
+
+		{
+			veekay::TraceZone zone("simulate");
+
+			for (uint32_t i = 0; i < steps; ++i) {
+				app_info->simulate(step);
+			}
+
+			app_info->snapshot(slot);
+		}
+
+		lock.lock();
+		simulation_worker.busy = false;
+		simulation_worker.condition.notify_all();
+	}
+}
+
+void kickSimulation(uint32_t steps, uint32_t slot) {
+	{
+		std::lock_guard lock(simulation_worker.mutex);
+		simulation_worker.steps = steps;
+		simulation_worker.slot = slot;
+		simulation_worker.busy = true;
+	}
+
+	simulation_worker.condition.notify_all();
+}
+
+void waitSimulation() {
+	std::unique_lock lock(simulation_worker.mutex);
+	simulation_worker.condition.wait(lock, [] { return !simulation_worker.busy; });
+}
+
+// NOTE: Zero when textures have pending updates, those have to go through
+//       ImGui_ImplVulkan_RenderDrawData even if nothing else changed
+uint64_t hashDrawData(const ImDrawData* draw_data) {
+	using veekay::internal::hashBytes;
+	using veekay::internal::hashValue;
+
+	if (draw_data->Textures) {
+		for (const ImTextureData* texture : *draw_data->Textures) {
+			if (texture->Status != ImTextureStatus_OK) {
+				return 0;
+			}
+		}
+	}
+
+	uint64_t hash = hashValue(draw_data->DisplayPos);
+	hash = hashValue(draw_data->DisplaySize, hash);
+	hash = hashValue(draw_data->FramebufferScale, hash);
+
+	for (const ImDrawList* list : draw_data->CmdLists) {
+		hash = hashBytes(list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes(), hash);
+		hash = hashBytes(list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes(), hash);
+		// NOTE: ImDrawCmd zeroes its padding, hashing raw bytes is fine
+		hash = hashBytes(list->CmdBuffer.Data, list->CmdBuffer.size_in_bytes(), hash);
+	}
+
+	return hash ? hash : 1;
+}
+
+// NOTE: Re-records the frame's UI commands when draw data changed. ImGui backend
+//       rotates its vertex buffers on every RenderDrawData, a cached recording is
+//       also refreshed before the backend gets around to reusing its buffers
+void recordImGui(uint32_t frame, uint32_t buffer_count) {
+	const bool buffers_alive = imgui_record_count - imgui_recorded_at[frame] + max_frames_in_flight <= buffer_count;
+
+	if (imgui_draw_hash && imgui_recorded_hashes[frame] == imgui_draw_hash && buffers_alive) {
+		return;
+	}
+
+	VkCommandBuffer cmd = imgui_command_buffers[frame];
+
+	VkCommandBufferInheritanceInfo inheritance{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass = imgui_render_pass,
+		.subpass = 0,
+	};
+
+	VkCommandBufferBeginInfo info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &inheritance,
+	};
+
+	vkResetCommandBuffer(cmd, 0);
+	vkBeginCommandBuffer(cmd, &info);
+
+	{ // NOTE: Texture updates are submitted and waited for on graphics queue
+		auto lock = veekay::internal::lockQueue(veekay::Queue::graphics);
+		ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+	}
+
+	vkEndCommandBuffer(cmd);
+
+	++imgui_record_count;
+	imgui_recorded_at[frame] = imgui_record_count;
+	imgui_recorded_hashes[frame] = imgui_draw_hash;
+
+	// NOTE: Texture updates went through, other recordings may refer to
+	//       replaced textures. Drop them and start caching again
+	if (!imgui_draw_hash) {
+		for (uint64_t& hash : imgui_recorded_hashes) {
+			hash = 0;
+		}
+
+		imgui_draw_hash = hashDrawData(ImGui::GetDrawData());
+	}
+}
+
+bool validationEnabled(veekay::Validation validation) {
+	if (const char* value = std::getenv("VEEKAY_VALIDATION")) {
+		return std::strcmp(value, "0") != 0;
+	}
+
+	switch (validation) {
+	case veekay::Validation::enabled:
+		return true;
+
+	case veekay::Validation::disabled:
+		return false;
+
+	case veekay::Validation::automatic:
+		break;
+	}
+
+#ifdef NDEBUG
+	return false;
+#else
+	return true;
+#endif
+}
+
+// NOTE: Headless mode renders into plain images standing in for the swapchain
+// NOTE: Layout backbuffer is left in at the end of a frame. There is
+//       nothing to present in headless mode, only captures read it
+VkImageLayout backbufferLayout(bool headless) {
+	return headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+bool createHeadlessImages() {
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(vk_physical_device, &properties);
+
+	vk_swapchain_images.resize(max_frames_in_flight);
+	vk_swapchain_image_views.resize(max_frames_in_flight);
+	headless_memory.resize(max_frames_in_flight);
+
+	for (uint32_t i = 0; i < max_frames_in_flight; ++i) {
+		VkImageCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = vk_swapchain_format,
+			.extent = {window_default_width, window_default_height, 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+			         VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+			         VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		};
+
+		if (vkCreateImage(vk_device, &info, nullptr, &vk_swapchain_images[i]) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan headless image " << i << '\n';
+			return false;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(vk_device, vk_swapchain_images[i], &requirements);
+
+		uint32_t index = UINT_MAX;
+		for (uint32_t j = 0; j < properties.memoryTypeCount; ++j) {
+			if ((requirements.memoryTypeBits & (1 << j)) &&
+			    (properties.memoryTypes[j].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+				index = j;
+				break;
+			}
+		}
+
+		if (index == UINT_MAX) {
+			std::cerr << "Failed to find required memory type for headless images\n";
+			return false;
+		}
+
+		VkMemoryAllocateInfo allocate_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = requirements.size,
+			.memoryTypeIndex = index,
+		};
+
+		if (veekay::allocateMemory(allocate_info, veekay::MemoryCategory::render_target,
+		                           &headless_memory[i]) != VK_SUCCESS ||
+		    vkBindImageMemory(vk_device, vk_swapchain_images[i], headless_memory[i], 0) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate memory for headless image " << i << '\n';
+			return false;
+		}
+
+		VkImageViewCreateInfo view_info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = vk_swapchain_images[i],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = vk_swapchain_format,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.levelCount = 1,
+				.layerCount = 1,
+			},
+		};
+
+		if (vkCreateImageView(vk_device, &view_info, nullptr, &vk_swapchain_image_views[i]) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan headless image view " << i << '\n';
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// NOTE: Copies each layer of the multiview scene image into its column of the backbuffer
+void composeViews(VkCommandBuffer cmd) {
+	const uint32_t view_count = veekay::app.view_count;
+	const uint32_t view_width = veekay::app.view_width;
+
+	VkImage backbuffer = frame_graph.image(frame_backbuffer);
+
+	// NOTE: Columns left over from dividing window width are covered by no view
+	if (view_width * view_count != veekay::app.window_width) {
+		VkClearColorValue black{};
+
+		VkImageSubresourceRange range{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		};
+
+		vkCmdClearColorImage(cmd, backbuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		};
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		                     1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	std::pmr::vector<VkImageCopy> regions(view_count, &veekay::frameArena());
+
+	for (uint32_t i = 0; i < view_count; ++i) {
+		regions[i] = VkImageCopy{
+			.srcSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = 0,
+				.baseArrayLayer = i,
+				.layerCount = 1,
+			},
+			.srcOffset = {0, 0, 0},
+			.dstSubresource = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = 0,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+			.dstOffset = {static_cast<int32_t>(i * view_width), 0, 0},
+			.extent = {view_width, veekay::app.view_height, 1},
+		};
+	}
+
+	vkCmdCopyImage(cmd, frame_graph.image(frame_scene_color), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	               backbuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	               view_count, regions.data());
+}
+
+bool initImGuiVulkan() {
+	{
+		VkDescriptorPoolSize size = {
+			.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE,
+		};
+
+		VkDescriptorPoolCreateInfo info = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+			.maxSets = size.descriptorCount,
+			.poolSizeCount = 1,
+			.pPoolSizes = &size,
+		};
+
+		if (vkCreateDescriptorPool(vk_device, &info, 0, &imgui_descriptor_pool) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan descriptor pool for ImGui\n";
+			return false;
+		}
+	}
+
+	{
+		VkAttachmentDescription attachment{
+			.format = vk_swapchain_format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			// NOTE: Render graph transitions layouts and synchronizes passes
+			.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		};
+
+		VkAttachmentReference ref{
+			.attachment = 0,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		};
+
+		VkSubpassDescription subpass{
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &ref,
+		};
+
+		VkRenderPassCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.attachmentCount = 1,
+			.pAttachments = &attachment,
+			.subpassCount = 1,
+			.pSubpasses = &subpass,
+		};
+
+		if (vkCreateRenderPass(vk_device, &info, nullptr, &imgui_render_pass) != VK_SUCCESS) {
+			std::cerr << "Failed to create ImGui Vulkan render pass\n";
+			return false;
+		}
+
+		veekay::setObjectName(VK_OBJECT_TYPE_RENDER_PASS, (uint64_t)imgui_render_pass, "imgui");
+	}
+
+	{
+		VkFramebufferCreateInfo info{
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = imgui_render_pass,
+			.attachmentCount = 1,
+			.width = window_default_width,
+			.height = window_default_height,
+			.layers = 1,
+		};
+
+		const size_t count = vk_swapchain_images.size();
+
+		imgui_framebuffers.resize(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			info.pAttachments = &vk_swapchain_image_views[i];
+			if (vkCreateFramebuffer(vk_device, &info, nullptr, &imgui_framebuffers[i]) != VK_SUCCESS) {
+				std::cerr << "Failed to create Vulkan framebuffer " << i << '\n';
+				return false;
+			}
+		}
+	}
+
+	ImGui_ImplVulkan_InitInfo info{
+		.Instance = vk_instance,
+		.PhysicalDevice = vk_physical_device,
+		.Device = vk_device,
+		.QueueFamily = vk_graphics_queue_family,
+		.Queue = vk_graphics_queue,
+		.DescriptorPool = imgui_descriptor_pool,
+		.MinImageCount = static_cast<uint32_t>(vk_swapchain_images.size()),
+		.ImageCount = static_cast<uint32_t>(vk_swapchain_images.size()),
+		.RenderPass = imgui_render_pass,
+	};
+
+	{ // NOTE: Backend submits to the queue on its own, streaming may submit to
+		//       the same VkQueue from its loader thread when there is no transfer family
+		auto lock = veekay::internal::lockQueue(veekay::Queue::graphics);
+		ImGui_ImplVulkan_Init(&info);
+	}
+
+	return true;
+}
+
 } // namespace
 
 // NOTE: Global application state definition
 veekay::Application veekay::app;
 
 int veekay::run(const veekay::ApplicationInfo& app_info) {
+	using Clock = std::chrono::steady_clock;
+
+	const Clock::time_point start_time = Clock::now();
+
 	veekay::app.running = true;
-	
-	if (!glfwInit()) {
-		std::cerr << "Failed to initialize GLFW\n";
-		return 1;
+
+	veekay::internal::initJobs();
+	veekay::internal::initArenas();
+
+	// NOTE: Early returns below must not leave job workers running
+	struct JobsGuard {
+		~JobsGuard() { veekay::internal::shutdownJobs(); }
+	} jobs_guard;
+
+	const bool headless = app_info.headless;
+
+	bool depth_pyramid = app_info.depth_pyramid;
+	if (depth_pyramid && !veekay::internal::depthPyramidAvailable()) {
+		std::cerr << "Depth pyramid shader was not built, running without depth pyramid\n";
+		depth_pyramid = false;
 	}
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	const uint32_t view_count = app_info.view_count ? app_info.view_count : 1;
 
-	window = glfwCreateWindow(window_default_width, window_default_height,
-	                          window_title, nullptr, nullptr);
-	if (!window) {
-		std::cerr << "Failed to create GLFW window\n";
+	// NOTE: Layered depth of several views does not reduce into a single pyramid
+	if (depth_pyramid && view_count > 1) {
+		std::cerr << "Depth pyramid is unavailable with " << view_count << " views, running without it\n";
+		depth_pyramid = false;
+	}
+
+	if (view_count > window_default_width) {
+		std::cerr << "Window is too narrow for " << view_count << " views\n";
 		return 1;
 	}
 
+	if (!headless) {
+		if (!glfwInit()) {
+			std::cerr << "Failed to initialize GLFW\n";
+			return 1;
+		}
+
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+		window = glfwCreateWindow(window_default_width, window_default_height,
+		                          window_title, nullptr, nullptr);
+		if (!window) {
+			std::cerr << "Failed to create GLFW window\n";
+			return 1;
+		}
+	}
+
 	veekay::app.window_width = window_default_width;
 	veekay::app.window_height = window_default_height;
 
+	veekay::app.view_width = window_default_width / view_count;
+	veekay::app.view_height = window_default_height;
+	veekay::app.view_count = view_count;
+
 	{ // NOTE: Initialize Vulkan: grab device and create swapchain
 		vkb::InstanceBuilder instance_builder;
 
-		auto builder_result = instance_builder.require_api_version(1, 2, 0)
-		                                      .request_validation_layers()
-		                                      .use_default_debug_messenger()
-		                                      .build();
+		const bool validation = validationEnabled(app_info.validation);
+
+		instance_builder.require_api_version(1, 2, 0)
+		                .request_validation_layers(validation)
+		                .set_headless(headless);
+
+		if (validation) {
+			instance_builder.use_default_debug_messenger();
+		}
+
+		bool debug_utils = validation;
+
+#ifdef VEEKAY_DEBUG_LABELS
+		// NOTE: Labels are useful in captures even without validation
+		// NOTE: Default messenger already enables the extension with validation
+		auto system_info = vkb::SystemInfo::get_system_info();
+		if (!validation && system_info && system_info.value().debug_utils_available) {
+			instance_builder.enable_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			debug_utils = true;
+		}
+#endif
+
+		auto builder_result = instance_builder.build();
 		if (!builder_result) {
 			std::cerr << builder_result.error().message() << '\n';
 			return 1;
@@ -107,7 +621,9 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 		vk_instance = instance.instance;
 		vk_debug_messenger = instance.debug_messenger;
 
-		if (glfwCreateWindowSurface(vk_instance, window, nullptr, &vk_surface) != VK_SUCCESS) {
+		veekay::internal::initDebugLabels(vk_instance, debug_utils);
+
+		if (!headless && glfwCreateWindowSurface(vk_instance, window, nullptr, &vk_surface) != VK_SUCCESS) {
 			const char* message;
 			glfwGetError(&message);
 			std::cerr << message << '\n';
@@ -116,7 +632,25 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 
 		vkb::PhysicalDeviceSelector physical_device_selector(instance);
 
-		auto selector_result = physical_device_selector.set_surface(vk_surface)
+		// NOTE: Multiview is mandatory since Vulkan 1.1. It is always enabled
+		//       so that shaders may read gl_ViewIndex whatever the view count
+		VkPhysicalDeviceVulkan11Features features_11{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES,
+			.multiview = true,
+		};
+
+		// NOTE: Timeline semaphores drive all queue synchronization
+		VkPhysicalDeviceVulkan12Features features_12{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+			.timelineSemaphore = true,
+		};
+
+		if (!headless) {
+			physical_device_selector.set_surface(vk_surface);
+		}
+
+		auto selector_result = physical_device_selector.set_required_features_11(features_11)
+		                                               .set_required_features_12(features_12)
 		                                               .select();
 		if (!selector_result) {
 			std::cerr << selector_result.error().message() << '\n';
@@ -125,6 +659,32 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 
 		auto physical_device = selector_result.value();
 
+		{ // NOTE: Devices support at least 6 views, applications may ask for more
+			VkPhysicalDeviceVulkan11Properties properties_11{
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES,
+			};
+
+			VkPhysicalDeviceProperties2 properties{
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+				.pNext = &properties_11,
+			};
+
+			vkGetPhysicalDeviceProperties2(physical_device.physical_device, &properties);
+
+			if (view_count > properties_11.maxMultiviewViewCount) {
+				std::cerr << "Device renders at most " << properties_11.maxMultiviewViewCount
+				          << " views in one pass, " << view_count << " were requested\n";
+				return 1;
+			}
+		}
+
+		// NOTE: Lets mesh streaming follow what the driver says it can use
+		const bool memory_budget = physical_device.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		// NOTE: Lets traces put GPU zones on the CPU timeline precisely
+		const bool calibrated_timestamps =
+			physical_device.enable_extension_if_present(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
 		{
 			vkb::DeviceBuilder device_builder(physical_device);
 
@@ -140,188 +700,105 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 			vk_device = device.device;
 			vk_physical_device = device.physical_device;
 
+			veekay::app.vk_device = vk_device;
+			veekay::app.vk_physical_device = vk_physical_device;
+
+			veekay::internal::initMemory(memory_budget);
+
 			auto queue_type = vkb::QueueType::graphics;
 			
 			vk_graphics_queue = device.get_queue(queue_type).value();
 			vk_graphics_queue_family = device.get_queue_index(queue_type).value();
-		}
-
-		vkb::SwapchainBuilder swapchain_builder(vk_physical_device, vk_device, vk_surface);
-
-		vk_swapchain_format = VK_FORMAT_B8G8R8A8_UNORM;
-
-		VkSurfaceFormatKHR surface_format{
-			.format = vk_swapchain_format,
-			.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
-		};
-
-		auto swapchain_result = swapchain_builder.set_desired_format(surface_format)
-		                                         .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
-		                                         .set_desired_extent(window_default_width, window_default_height)
-		                                         .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-		                                         .build();
-
-		if (!swapchain_result) {
-			std::cerr << swapchain_result.error().message() << '\n';
-			return 1;
-		}
-
-		auto swapchain = swapchain_result.value();
-
-		vk_swapchain = swapchain.swapchain;
-		vk_swapchain_images = swapchain.get_images().value();
-		vk_swapchain_image_views = swapchain.get_image_views().value();
-
-		veekay::app.vk_device = vk_device;
-		veekay::app.vk_physical_device = vk_physical_device;
-	}
-
-	{ // NOTE: ImGui initialization
-		IMGUI_CHECKVERSION();
-		ImGui::CreateContext();
-		ImGuiIO& io = ImGui::GetIO(); (void)io;
-
-		ImGui::StyleColorsDark();
 
-		ImGui_ImplGlfw_InitForVulkan(window, true);
-
-		{
-			VkDescriptorPoolSize size = {
-				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE,
+			// NOTE: Prefer a family doing nothing but compute/transfer, then any
+			//       non-graphics one, and share graphics queue as a last resort
+			auto find_queue = [&](vkb::QueueType type, VkQueue& queue, uint32_t& family) {
+				auto dedicated = device.get_dedicated_queue_index(type);
+				auto index = dedicated ? dedicated : device.get_queue_index(type);
+
+				if (index) {
+					family = index.value();
+					vkGetDeviceQueue(vk_device, family, 0, &queue);
+				} else {
+					family = vk_graphics_queue_family;
+					queue = vk_graphics_queue;
+				}
 			};
 
-			VkDescriptorPoolCreateInfo info = {
-				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-				.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-				.maxSets = size.descriptorCount,
-				.poolSizeCount = 1,
-				.pPoolSizes = &size,
-			};
+			veekay::app.vk_graphics_queue = vk_graphics_queue;
+			veekay::app.vk_graphics_queue_family = vk_graphics_queue_family;
 
-			if (vkCreateDescriptorPool(vk_device, &info, 0, &imgui_descriptor_pool) != VK_SUCCESS) {
-				std::cerr << "Failed to create Vulkan descriptor pool for ImGui\n";
-				return 1;
-			}
+			find_queue(vkb::QueueType::compute,
+			           veekay::app.vk_compute_queue, veekay::app.vk_compute_queue_family);
+			find_queue(vkb::QueueType::transfer,
+			           veekay::app.vk_transfer_queue, veekay::app.vk_transfer_queue_family);
 		}
 
-		{
-			VkAttachmentDescription attachment{
-				.format = vk_swapchain_format,
-				.samples = VK_SAMPLE_COUNT_1_BIT,
-				.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
-				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-				.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-				.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-			};
+		vk_swapchain_format = VK_FORMAT_B8G8R8A8_UNORM;
 
-			VkAttachmentReference ref{
-				.attachment = 0,
-				.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			};
+		if (!headless) {
+			vkb::SwapchainBuilder swapchain_builder(vk_physical_device, vk_device, vk_surface);
 
-			VkSubpassDescription subpass{
-				.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-				.colorAttachmentCount = 1,
-				.pColorAttachments = &ref,
-			};
-
-			VkSubpassDependency dependency{
-				.srcSubpass = VK_SUBPASS_EXTERNAL,
-				.dstSubpass = 0,
-				.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-				.srcAccessMask = 0,
-				.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VkSurfaceFormatKHR surface_format{
+				.format = vk_swapchain_format,
+				.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
 			};
 
-			VkRenderPassCreateInfo info{
-				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-				.attachmentCount = 1,
-				.pAttachments = &attachment,
-				.subpassCount = 1,
-				.pSubpasses = &subpass,
-				.dependencyCount = 1,
-				.pDependencies = &dependency,
-			};
+			auto swapchain_result = swapchain_builder.set_desired_format(surface_format)
+			                                         .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+			                                         .set_desired_extent(window_default_width, window_default_height)
+			                                         .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+			                                                                VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+			                                         .build();
 
-			if (vkCreateRenderPass(vk_device, &info, nullptr, &imgui_render_pass) != VK_SUCCESS) {
-				std::cerr << "Failed to create ImGui Vulkan render pass\n";
+			if (!swapchain_result) {
+				std::cerr << swapchain_result.error().message() << '\n';
 				return 1;
 			}
-		}
 
-		{
-			VkFramebufferCreateInfo info{
-				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-				.renderPass = imgui_render_pass,
-				.attachmentCount = 1,
-				.width = window_default_width,
-				.height = window_default_height,
-				.layers = 1,
-			};
+			auto swapchain = swapchain_result.value();
 
-			const size_t count = vk_swapchain_images.size();
+			vk_swapchain = swapchain.swapchain;
+			vk_swapchain_images = swapchain.get_images().value();
+			vk_swapchain_image_views = swapchain.get_image_views().value();
+		} else if (!createHeadlessImages()) {
+			return 1;
+		}
 
-			imgui_framebuffers.resize(count);
+		if (!veekay::internal::initScheduler()) {
+			return 1;
+		}
 
-			for (size_t i = 0; i < count; ++i) {
-				info.pAttachments = &vk_swapchain_image_views[i];
-				if (vkCreateFramebuffer(vk_device, &info, nullptr, &imgui_framebuffers[i]) != VK_SUCCESS) {
-					std::cerr << "Failed to create Vulkan framebuffer " << i << '\n';
-					return 1;
-				}
-			}
+		if (!veekay::internal::initTracing(vk_instance, max_frames_in_flight, calibrated_timestamps)) {
+			return 1;
 		}
 
-		{
-			size_t count = imgui_framebuffers.size();
+		if (!veekay::internal::initCapture(vk_swapchain_format,
+		                                   {window_default_width, window_default_height},
+		                                   backbufferLayout(headless))) {
+			return 1;
+		}
 
-			imgui_command_buffers.resize(count);
+		if (!veekay::internal::initStreaming(memory_budget)) {
+			return 1;
+		}
+	}
 
-			{
-				VkCommandPoolCreateInfo info{
-					.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-					.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-					.queueFamilyIndex = vk_graphics_queue_family,
-				};
+	{ // NOTE: ImGui initialization
+		IMGUI_CHECKVERSION();
+		ImGui::CreateContext();
+		ImGuiIO& io = ImGui::GetIO(); (void)io;
 
-				if (vkCreateCommandPool(vk_device, &info, nullptr, &imgui_command_pool) != VK_SUCCESS) {
-					std::cerr << "Failed to create ImGui Vulkan command pool\n";
-					return 1;
-				}
-			}
+		ImGui::StyleColorsDark();
 
-			{
-				VkCommandBufferAllocateInfo info{
-					.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-					.commandPool = imgui_command_pool,
-					.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-					.commandBufferCount = static_cast<uint32_t>(imgui_command_buffers.size()),
-				};
-
-				if (vkAllocateCommandBuffers(vk_device, &info, imgui_command_buffers.data()) != VK_SUCCESS) {
-					std::cerr << "Failed to allocate ImGui Vulkan command buffers\n";
-					return 1;
-				}
-			}
+		if (!headless) {
+			// NOTE: Replayed runs take input from the log, never from the window
+			ImGui_ImplGlfw_InitForVulkan(window, !app_info.replay_input);
 		}
 
-		ImGui_ImplVulkan_InitInfo info{
-			.Instance = vk_instance,
-			.PhysicalDevice = vk_physical_device,
-			.Device = vk_device,
-			.QueueFamily = vk_graphics_queue_family,
-			.Queue = vk_graphics_queue,
-			.DescriptorPool = imgui_descriptor_pool,
-			.MinImageCount = static_cast<uint32_t>(vk_swapchain_images.size()),
-			.ImageCount = static_cast<uint32_t>(vk_swapchain_images.size()),
-			.RenderPass = imgui_render_pass,
-		};
-
-		ImGui_ImplVulkan_Init(&info);
+		// NOTE: Vulkan side of ImGui does not depend on anything created below,
+		//       set it up on a worker while the main thread carries on
+		imgui_vulkan_job = veekay::async([] { imgui_vulkan_ready = initImGuiVulkan(); });
 	}
 
 	{
@@ -333,94 +810,116 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 
 		vk_image_depth_format = VK_FORMAT_UNDEFINED;
 
+		// NOTE: Depth pyramid is built by sampling depth
+		VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		if (depth_pyramid) {
+			features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		}
+
 		for (const auto& f : candidates) {
 			VkFormatProperties properties;
 			vkGetPhysicalDeviceFormatProperties(vk_physical_device, f, &properties);
 
-			if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			if ((properties.optimalTilingFeatures & features) == features) {
 				vk_image_depth_format = f;
 				break;
 			}
 		}
 	}
 
-	{ // NOTE: Create depth buffer
-		VkImageCreateInfo info{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-			.imageType = VK_IMAGE_TYPE_2D,
-			.format = vk_image_depth_format,
-			.extent = {window_default_width, window_default_height, 1},
-			.mipLevels = 1,
-			.arrayLayers = 1,
-			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.tiling = VK_IMAGE_TILING_OPTIMAL,
-			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		};
+	{ // NOTE: Describe frame passes and the resources they touch
+		frame_backbuffer = frame_graph.importImage("backbuffer", VK_IMAGE_ASPECT_COLOR_BIT,
+		                                           VK_IMAGE_LAYOUT_UNDEFINED,
+		                                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		                                           backbufferLayout(headless));
 
-		if (vkCreateImage(vk_device, &info, nullptr, &vk_image_depth) != VK_SUCCESS) {
-			std::cerr << "Failed to create Vulkan depth image\n";
-			return 1;
+		VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vk_image_depth_format != VK_FORMAT_D32_SFLOAT) {
+			depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
 		}
-	}
 
-	{ // NOTE: Allocate depth buffer memory
-		VkMemoryRequirements requirements;
-		vkGetImageMemoryRequirements(vk_device, vk_image_depth, &requirements);
+		const VkExtent2D view_extent{veekay::app.view_width, veekay::app.view_height};
 
-		VkPhysicalDeviceMemoryProperties properties;
-		vkGetPhysicalDeviceMemoryProperties(vk_physical_device, &properties);
+		frame_depth = frame_graph.createImage("depth", {
+			.format = vk_image_depth_format,
+			.extent = view_extent,
+			.layers = view_count,
+			.aspect = depth_aspect,
+		});
 
-		uint32_t index = UINT_MAX;
-		for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
-			const VkMemoryType& type = properties.memoryTypes[i];
+		frame_scene_color = frame_backbuffer;
 
-			if ((requirements.memoryTypeBits & (1 << i)) &&
-			    (type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-				index = i;
-				break;
-			}
+		if (view_count > 1) {
+			frame_scene_color = frame_graph.createImage("views", {
+				.format = vk_swapchain_format,
+				.extent = view_extent,
+				.layers = view_count,
+				.aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+			});
 		}
 
-		if (index == UINT_MAX) {
-			std::cerr << "Failed to find required memory type for Vulkan depth image\n";
-			return 1;
+		veekay::PassId scene_pass = frame_graph.addPass("scene", [&app_info](VkCommandBuffer cmd) {
+			app_info.render(cmd, vk_framebuffers[vk_current_image]);
+		});
+
+		frame_graph.write(scene_pass, frame_scene_color, veekay::Access::color_attachment);
+		frame_graph.write(scene_pass, frame_depth, veekay::Access::depth_attachment);
+
+		if (depth_pyramid) {
+			// NOTE: Pyramid lives across frames, between them it stays ready for sampling
+			frame_depth_pyramid = frame_graph.importImage("depth pyramid", VK_IMAGE_ASPECT_COLOR_BIT,
+			                                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			                                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			                                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+			frame_graph.read(scene_pass, frame_depth_pyramid, veekay::Access::sampled);
+
+			veekay::PassId pyramid_pass = frame_graph.addPass("depth pyramid", [](VkCommandBuffer cmd) {
+				veekay::internal::recordDepthPyramid(cmd);
+			});
+
+			frame_graph.read(pyramid_pass, frame_depth, veekay::Access::sampled);
+			frame_graph.write(pyramid_pass, frame_depth_pyramid, veekay::Access::storage);
 		}
 
-		VkMemoryAllocateInfo info = {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.allocationSize = requirements.size,
-			.memoryTypeIndex = index,
-		};
+		if (view_count > 1) {
+			veekay::PassId compose_pass = frame_graph.addPass("compose views", composeViews);
 
-		if (vkAllocateMemory(vk_device, &info, nullptr, &vk_image_depth_memory) != VK_SUCCESS) {
-			std::cerr << "Failed to allocate memory for Vulkan depth image\n";
-			return 1;
+			frame_graph.read(compose_pass, frame_scene_color, veekay::Access::transfer_src);
+			frame_graph.write(compose_pass, frame_backbuffer, veekay::Access::transfer_dst);
 		}
 
-		if (vkBindImageMemory(vk_device, vk_image_depth, vk_image_depth_memory, 0) != VK_SUCCESS) {
-			std::cerr << "Failed to bind Vulkan depth image with device memory\n";
+		veekay::PassId imgui_pass = frame_graph.addPass("imgui", [](VkCommandBuffer cmd) {
+			VkRenderPassBeginInfo info{
+				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+				.renderPass = imgui_render_pass,
+				.framebuffer = imgui_framebuffers[vk_current_image],
+				.renderArea = {
+					.extent = {window_default_width, window_default_height},
+				},
+			};
+
+			vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(cmd, 1, &imgui_command_buffers[vk_current_frame]);
+			vkCmdEndRenderPass(cmd);
+		});
+
+		frame_graph.read(imgui_pass, frame_backbuffer, veekay::Access::color_attachment);
+		frame_graph.write(imgui_pass, frame_backbuffer, veekay::Access::color_attachment);
+
+		if (!frame_graph.compile()) {
+			std::cerr << "Failed to compile frame render graph\n";
 			return 1;
 		}
-	}
 
-	{ // NOTE: Create depth buffer view object
-		VkImageViewCreateInfo info = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-			.image = vk_image_depth,
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = vk_image_depth_format,
-			.subresourceRange = {
-				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			},
-		};
+		if (depth_pyramid) {
+			if (!veekay::internal::initDepthPyramid(frame_graph.image(frame_depth), vk_image_depth_format,
+			                                        {window_default_width, window_default_height})) {
+				return 1;
+			}
 
-		if (vkCreateImageView(vk_device, &info, nullptr, &vk_image_depth_view) != VK_SUCCESS) {
-			std::cerr << "Failed to create Vulkan depth image view\n";
-			return 1;
+			frame_graph.setImage(frame_depth_pyramid, veekay::internal::depthPyramidImage(),
+			                     veekay::depthPyramid().view);
 		}
 	}
 
@@ -436,18 +935,20 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			// NOTE: Render graph transitions layouts and synchronizes passes
+			.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 		};
 
 		VkAttachmentDescription depth_attachment{
 			.format = vk_image_depth_format,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			// NOTE: Depth is transient, only the depth pyramid reads it after the scene pass
+			.storeOp = depth_pyramid ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 		};
 
@@ -470,28 +971,27 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 
 		VkAttachmentDescription attachments[] = {color_attachment, depth_attachment};
 
-		VkSubpassDependency dependency{
-			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-			                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-			                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-			                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-			.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
+		// NOTE: Each draw of the subpass runs once per view, view i writes layer i
+		const uint32_t view_mask = UINT32_MAX >> (32 - view_count);
+
+		VkRenderPassMultiviewCreateInfo multiview{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+			.subpassCount = 1,
+			.pViewMasks = &view_mask,
+			// NOTE: Views see the same scene, implementations may share work between them
+			.correlationMaskCount = 1,
+			.pCorrelationMasks = &view_mask,
 		};
 
 		VkRenderPassCreateInfo info{
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.pNext = view_count > 1 ? &multiview : nullptr,
 
 			.attachmentCount = 2,
 			.pAttachments = attachments,
 
 			.subpassCount = 1,
 			.pSubpasses = &subpass,
-
-			.dependencyCount = 1,
-			.pDependencies = &dependency,
 		};
 
 		if (vkCreateRenderPass(vk_device, &info, nullptr, &vk_render_pass) != VK_SUCCESS) {
@@ -499,11 +999,13 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 			return 1;
 		}
 
+		veekay::setObjectName(VK_OBJECT_TYPE_RENDER_PASS, (uint64_t)vk_render_pass, "scene");
+
 		veekay::app.vk_render_pass = vk_render_pass;
 	}
 
 	{ // NOTE: Create framebuffer objects from swapchain images
-		VkImageView attachments[] = {VK_NULL_HANDLE, vk_image_depth_view};
+		VkImageView attachments[] = {VK_NULL_HANDLE, frame_graph.view(frame_depth)};
 
 		VkFramebufferCreateInfo info{
 			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
@@ -513,8 +1015,9 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 			.attachmentCount = 2,
 			.pAttachments = attachments,
 
-			.width = window_default_width,
-			.height = window_default_height,
+			// NOTE: Multiview framebuffers have one layer, views come from attachment layers
+			.width = veekay::app.view_width,
+			.height = veekay::app.view_height,
 			.layers = 1,
 		};
 
@@ -523,7 +1026,7 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 		vk_framebuffers.resize(count);
 
 		for (size_t i = 0; i < count; ++i) {
-			attachments[0] = vk_swapchain_image_views[i];
+			attachments[0] = view_count > 1 ? frame_graph.view(frame_scene_color) : vk_swapchain_image_views[i];
 			if (vkCreateFramebuffer(vk_device, &info, nullptr, &vk_framebuffers[i]) != VK_SUCCESS) {
 				std::cerr << "Failed to create Vulkan framebuffer " << i << '\n';
 				return 1;
@@ -532,11 +1035,6 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 	}
 
 	{ // NOTE: Create sync primitives
-		VkFenceCreateInfo fence_info{
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-		};
-
 		VkSemaphoreCreateInfo sem_info{
 			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
 		};
@@ -548,11 +1046,10 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 		}
 
 		vk_render_semaphores.resize(max_frames_in_flight);
-		vk_in_flight_fences.resize(max_frames_in_flight);
 
 		for (uint32_t i = 0; i < max_frames_in_flight; ++i) {
 			vkCreateSemaphore(vk_device, &sem_info, nullptr, &vk_render_semaphores[i]);
-			vkCreateFence(vk_device, &fence_info, nullptr, &vk_in_flight_fences[i]);
+			vk_frame_points[i] = {veekay::Queue::graphics, 0};
 		}
 	}
 
@@ -569,8 +1066,8 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 		}
 	}
 
-	{ // NOTE: Allocate command buffers
-		vk_command_buffers.resize(vk_framebuffers.size());
+	{ // NOTE: Allocate command buffers, one per frame in flight
+		vk_command_buffers.resize(max_frames_in_flight);
 		
 		VkCommandBufferAllocateInfo info{
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -583,88 +1080,247 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 			std::cerr << "Failed to allocate Vulkan command buffers\n";
 			return 1;
 		}
+
+		for (VkCommandBuffer cmd : vk_command_buffers) {
+			veekay::setObjectName(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)cmd, "frame");
+		}
+
+		info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		info.commandBufferCount = max_frames_in_flight;
+
+		if (vkAllocateCommandBuffers(vk_device, &info, imgui_command_buffers) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate Vulkan command buffers for ImGui\n";
+			return 1;
+		}
+
+		for (VkCommandBuffer cmd : imgui_command_buffers) {
+			veekay::setObjectName(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)cmd, "imgui");
+		}
 	}
 
+	// NOTE: init may hand slow work (pipelines, meshes) to veekay::async
+	//       and start rendering before it finishes
 	app_info.init();
 
-	while (veekay::app.running && !glfwWindowShouldClose(window)) {
-		glfwPollEvents();
-		double time = glfwGetTime();
+	veekay::waitJob(imgui_vulkan_job);
+	if (!imgui_vulkan_ready) {
+		return 1;
+	}
 
-		ImGui_ImplVulkan_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
+	const Clock::time_point init_end_time = Clock::now();
+	bool first_frame_presented = false;
 
-		app_info.update(time);
+	const double simulation_step = 1.0 / (app_info.simulation_rate > 0.0 ?
+	                                      app_info.simulation_rate :
+	                                      default_simulation_rate);
+	const uint32_t max_simulation_steps = app_info.max_simulation_steps ?
+	                                      app_info.max_simulation_steps :
+	                                      default_max_simulation_steps;
 
-		ImGui::Render();
+	bool threaded_simulation = app_info.threaded_simulation;
+	if (threaded_simulation && (!app_info.simulate || !app_info.snapshot)) {
+		std::cerr << "Threaded simulation needs both simulate and snapshot, running it on the main thread\n";
+		threaded_simulation = false;
+	}
 
-		// NOTE: Wait until the previous frame finishes
-		vkWaitForFences(vk_device, 1, &vk_in_flight_fences[vk_current_frame], true, UINT64_MAX);
-		vkResetFences(vk_device, 1, &vk_in_flight_fences[vk_current_frame]);
+	// NOTE: Render reads one slot while the simulation thread fills the other
+	uint32_t snapshot_write_slot = 0;
+	double snapshot_alpha[veekay::snapshot_slot_count] = {};
 
-		// NOTE: Get current swapchain framebuffer index
-		uint32_t swapchain_image_index = 0;
-		vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX,
-		                      vk_render_semaphores[vk_current_frame],
-		                      nullptr, &swapchain_image_index);
+	if (app_info.snapshot) {
+		// NOTE: Make every slot valid before the first frame is rendered
+		for (uint32_t i = 0; i < veekay::snapshot_slot_count; ++i) {
+			app_info.snapshot(i);
+		}
+	}
+
+	if (threaded_simulation) {
+		snapshot_write_slot = 1;
+		simulation_worker.thread = std::thread(simulationWorkerMain, &app_info, simulation_step);
+	}
+
+	double simulation_accumulator = 0.0;
+	double previous_time = headless ? 0.0 : glfwGetTime();
+
+	// NOTE: Logs keep the time a run started at, replays start from the same one
+	const bool replay = app_info.replay_input;
+	if (!veekay::internal::initInputLog(app_info.record_input, app_info.replay_input, previous_time)) {
+		return 1;
+	}
+	double ui_time = -unfocused_ui_interval;
+	uint64_t frame_index = 0;
 
-		VkCommandBuffer cmd = vk_command_buffers[swapchain_image_index];
+	while (veekay::app.running && (headless || !glfwWindowShouldClose(window))) {
+		if (app_info.max_frames && frame_index == app_info.max_frames) {
+			break;
+		}
+
+		veekay::TraceZone frame_zone("frame");
 
-		app_info.render(cmd, vk_framebuffers[swapchain_image_index]);
+		// NOTE: Frame boundary, the previous frame's transient data is gone from here on
+		veekay::internal::beginArenaFrame();
 
-		VkCommandBuffer imgui_cmd = imgui_command_buffers[swapchain_image_index];
-		{ // NOTE: Draw ImGui
-			vkResetCommandBuffer(imgui_cmd, 0);
+		if (!headless) {
+			glfwPollEvents();
+		}
 
-			{
-				VkCommandBufferBeginInfo info{
-					.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-					.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-				};
+		double time;
+		bool focused;
+		bool ui;
 
-				vkBeginCommandBuffer(imgui_cmd, &info);
+		if (replay) {
+			if (!veekay::internal::replayFrame(time, focused, ui)) {
+				break;
 			}
+		} else {
+			// NOTE: Headless time is virtual, every frame is exactly one simulation step.
+			//       Runs are reproducible and go as fast as GPU allows
+			time = headless ? frame_index * simulation_step : glfwGetTime();
+
+			// NOTE: Unfocused window rebuilds UI at a low rate, in between
+			//       last draw data and its recorded commands are reused
+			focused = headless || glfwGetWindowAttrib(window, GLFW_FOCUSED);
+			ui = focused || time - ui_time >= unfocused_ui_interval;
+		}
+
+		++frame_index;
+
+		veekay::internal::applyShaderReloads();
+		veekay::internal::pollCaptures();
+		veekay::internal::collectDeletions();
+		veekay::internal::updateStreaming();
 
-			{
-				VkRenderPassBeginInfo info{
-					.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-					.renderPass = imgui_render_pass,
-					.framebuffer = imgui_framebuffers[swapchain_image_index],
-					.renderArea = {
-						.extent = {window_default_width, window_default_height},
-					},
-				};
-
-				vkCmdBeginRenderPass(imgui_cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+		if (ui) {
+			veekay::TraceZone zone("update");
+
+			ui_time = time;
+
+			ImGui_ImplVulkan_NewFrame();
+
+			if (replay) {
+				veekay::internal::replayInput();
+			} else if (headless) {
+				ImGuiIO& io = ImGui::GetIO();
+				io.DisplaySize = ImVec2(float(window_default_width), float(window_default_height));
+				io.DeltaTime = float(simulation_step);
+			} else {
+				ImGui_ImplGlfw_NewFrame();
 			}
 
-			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), imgui_cmd);
+			veekay::internal::recordFrame(time, focused, true);
+
+			ImGui::NewFrame();
 
-			vkCmdEndRenderPass(imgui_cmd);
-			vkEndCommandBuffer(imgui_cmd);
+			app_info.update(time);
+
+			ImGui::Render();
+
+			imgui_draw_hash = hashDrawData(ImGui::GetDrawData());
+		} else {
+			veekay::internal::recordFrame(time, focused, false);
 		}
 
-		{ // NOTE: Submit commands to graphics queue
-			VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		{ // NOTE: Advance simulation in fixed steps, render rate does not affect it
+			simulation_accumulator += headless && !replay ? simulation_step : time - previous_time;
+			previous_time = time;
 
-			VkCommandBuffer buffers[] = { cmd, imgui_cmd };
+			uint32_t steps = 0;
+			while (simulation_accumulator >= simulation_step && steps < max_simulation_steps) {
+				simulation_accumulator -= simulation_step;
+				++steps;
+			}
 
-			VkSubmitInfo info{
-				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-				.waitSemaphoreCount = 1,
-				.pWaitSemaphores = &vk_render_semaphores[vk_current_frame],
-				.pWaitDstStageMask = &wait_stage,
-				.commandBufferCount = 2,
-				.pCommandBuffers = buffers,
-				.signalSemaphoreCount = 1,
-				.pSignalSemaphores = &vk_present_semaphores[swapchain_image_index],
+			// NOTE: We could not keep up, drop the backlog instead of spiralling
+			if (simulation_accumulator >= simulation_step) {
+				simulation_accumulator = 0.0;
+			}
+
+			const double alpha = simulation_accumulator / simulation_step;
+
+			if (threaded_simulation) {
+				// NOTE: Simulate next frame while this one is recorded and submitted,
+				//       render reads what the previous kick produced
+				kickSimulation(steps, snapshot_write_slot);
+				snapshot_alpha[snapshot_write_slot] = alpha;
+
+				const uint32_t read_slot = (snapshot_write_slot + 1) % veekay::snapshot_slot_count;
+
+				veekay::app.render_snapshot = read_slot;
+				veekay::app.simulation_alpha = snapshot_alpha[read_slot];
+			} else {
+				veekay::TraceZone zone("simulate");
+
+				if (app_info.simulate) {
+					for (uint32_t i = 0; i < steps; ++i) {
+						app_info.simulate(simulation_step);
+					}
+				}
+
+				if (app_info.snapshot) {
+					app_info.snapshot(0);
+				}
+
+				veekay::app.render_snapshot = 0;
+				veekay::app.simulation_alpha = alpha;
+			}
+		}
+
+		{ // NOTE: Wait until the frame previously using this slot finishes
+			veekay::TraceZone zone("wait frame");
+			veekay::wait(vk_frame_points[vk_current_frame]);
+		}
+
+		// NOTE: Get current swapchain framebuffer index, headless images
+		//       go one per frame in flight
+		uint32_t swapchain_image_index = vk_current_frame;
+		if (!headless) {
+			veekay::TraceZone zone("acquire");
+			vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX,
+			                      vk_render_semaphores[vk_current_frame],
+			                      nullptr, &swapchain_image_index);
+		}
+
+		VkCommandBuffer cmd = vk_command_buffers[vk_current_frame];
+
+		vk_current_image = swapchain_image_index;
+		frame_graph.setImage(frame_backbuffer,
+		                     vk_swapchain_images[swapchain_image_index],
+		                     vk_swapchain_image_views[swapchain_image_index]);
+
+		{ // NOTE: Record frame passes
+			veekay::TraceZone zone("record");
+
+			recordImGui(vk_current_frame, static_cast<uint32_t>(vk_swapchain_images.size()));
+
+			vkResetCommandBuffer(cmd, 0);
+
+			VkCommandBufferBeginInfo info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 			};
 
-			vkQueueSubmit(vk_graphics_queue, 1, &info, vk_in_flight_fences[vk_current_frame]);
+			vkBeginCommandBuffer(cmd, &info);
+			veekay::internal::beginTraceFrame(cmd, vk_current_frame);
+			frame_graph.execute(cmd);
+			veekay::internal::recordCapture(cmd, vk_swapchain_images[swapchain_image_index]);
+			vkEndCommandBuffer(cmd);
+		}
+
+		{ // NOTE: Submit commands to graphics queue
+			veekay::TraceZone zone("submit");
+
+			vk_frame_points[vk_current_frame] = veekay::internal::submitFrame(
+				&cmd, 1,
+				headless ? VK_NULL_HANDLE : vk_render_semaphores[vk_current_frame],
+				headless ? VK_NULL_HANDLE : vk_present_semaphores[swapchain_image_index]);
+
+			veekay::internal::submitCapture(vk_frame_points[vk_current_frame]);
+			veekay::internal::endTraceFrame();
 		}
 
-		{ // NOTE: Present renderer frame
+		if (!headless) { // NOTE: Present renderer frame
+			veekay::TraceZone zone("present");
+
 			VkPresentInfoKHR info{
 				.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 				.waitSemaphoreCount = 1,
@@ -674,16 +1330,75 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 				.pImageIndices = &swapchain_image_index,
 			};
 
-			vkQueuePresentKHR(vk_graphics_queue, &info);
+			veekay::internal::presentFrame(info);
+		}
+
+		if (!first_frame_presented) {
+			first_frame_presented = true;
+
+			typedef std::chrono::duration<double, std::milli> Milliseconds;
+			const Milliseconds init_time = init_end_time - start_time;
+			const Milliseconds first_frame_time = Clock::now() - start_time;
+
+			std::cout << "Time to first frame: " << first_frame_time.count() << " ms"
+			          << " (initialization " << init_time.count() << " ms)\n";
+		}
+
+		vk_current_frame = (vk_current_frame + 1) % max_frames_in_flight;
 
-			vk_current_frame = (vk_current_frame + 1) % max_frames_in_flight;
+		if (threaded_simulation) {
+			// NOTE: update of the next frame may touch simulated state, let the thread finish
+			veekay::TraceZone zone("wait simulation");
+			waitSimulation();
+			snapshot_write_slot = (snapshot_write_slot + 1) % veekay::snapshot_slot_count;
 		}
 	}
 
+	if (headless) {
+		const std::chrono::duration<double> elapsed = Clock::now() - init_end_time;
+
+		std::cout << "Rendered " << frame_index << " headless frames in " << elapsed.count()
+		          << " s (" << frame_index / elapsed.count() << " fps)\n";
+	}
+
+	if (threaded_simulation) {
+		{
+			std::lock_guard lock(simulation_worker.mutex);
+			simulation_worker.quit = true;
+		}
+
+		simulation_worker.condition.notify_all();
+		simulation_worker.thread.join();
+	}
+
+	// NOTE: Jobs started by init may still be running if the window closed early
+	veekay::internal::shutdownJobs();
+
+	// NOTE: Loader thread submits on transfer queue, stop it before waiting for idle
+	veekay::internal::shutdownStreaming();
+
 	vkDeviceWaitIdle(vk_device);
 
+	// NOTE: Hand out remaining captures while application state is still alive
+	veekay::internal::shutdownCapture();
+
 	app_info.shutdown();
 
+	veekay::internal::shutdownShaders();
+
+	// NOTE: Device is idle, whatever is still deferred can go now
+	veekay::internal::flushDeletions();
+
+	if (depth_pyramid) {
+		veekay::internal::shutdownDepthPyramid();
+	}
+
+	veekay::internal::shutdownInstanceBuffers();
+
+	veekay::internal::shutdownObjectCache();
+	veekay::internal::shutdownTracing();
+	veekay::internal::shutdownInputLog();
+
 	vkDestroyCommandPool(vk_device, vk_command_pool, nullptr);
 
 	for (size_t i = 0, e = vk_swapchain_images.size(); i != e; ++i) {
@@ -692,16 +1407,14 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 
 	for (size_t i = 0; i < max_frames_in_flight; ++i) {
 		vkDestroySemaphore(vk_device, vk_render_semaphores[i], nullptr);
-		vkDestroyFence(vk_device, vk_in_flight_fences[i], nullptr);
 	}
+
+	veekay::internal::shutdownScheduler();
 	
 	vkDestroyRenderPass(vk_device, vk_render_pass, nullptr);
 
-	vkDestroyImageView(vk_device, vk_image_depth_view, nullptr);
-	vkFreeMemory(vk_device, vk_image_depth_memory, nullptr);
-	vkDestroyImage(vk_device, vk_image_depth, nullptr);
+	frame_graph.destroy();
 
-	vkDestroyCommandPool(vk_device, imgui_command_pool, nullptr);
 	vkDestroyRenderPass(vk_device, imgui_render_pass, nullptr);
 
 	for (size_t i = 0, e = vk_framebuffers.size(); i != e; ++i) {
@@ -710,20 +1423,38 @@ int veekay::run(const veekay::ApplicationInfo& app_info) {
 		vkDestroyImageView(vk_device, vk_swapchain_image_views[i], nullptr);
 	}
 
+	for (size_t i = 0, e = headless_memory.size(); i != e; ++i) {
+		vkDestroyImage(vk_device, vk_swapchain_images[i], nullptr);
+		veekay::freeMemory(headless_memory[i]);
+	}
+
 	ImGui_ImplVulkan_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
+	if (!headless) {
+		ImGui_ImplGlfw_Shutdown();
+	}
 	ImGui::DestroyContext();
 
 	vkDestroyDescriptorPool(vk_device, imgui_descriptor_pool, nullptr);
 	
-	vkDestroySwapchainKHR(vk_device, vk_swapchain, nullptr);
+	if (!headless) {
+		vkDestroySwapchainKHR(vk_device, vk_swapchain, nullptr);
+	}
+
+	veekay::internal::shutdownMemory();
+
 	vkDestroyDevice(vk_device, nullptr);
-	vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+
+	if (!headless) {
+		vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+	}
+
 	vkb::destroy_debug_utils_messenger(vk_instance, vk_debug_messenger);
 	vkDestroyInstance(vk_instance, nullptr);
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (!headless) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 	
 	return 0;
 }
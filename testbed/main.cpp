@@ -1,16 +1,44 @@
 #include <cstdint>
 #include <climits>
 #include <vector>
+#include <string>
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <chrono>
+#include <cstdlib>
 #include <cstring> // Для memcpy
+#include <algorithm>
+#include <filesystem>
 
 #include <veekay/veekay.hpp>
+#include <veekay/shaders.hpp>
+#include <veekay/jobs.hpp>
+#include <veekay/debug.hpp>
+#include <veekay/capture.hpp>
+#include <veekay/scheduler.hpp>
+#include <veekay/streaming.hpp>
+#include <veekay/meshlets.hpp>
+#include <veekay/depth_pyramid.hpp>
+#include <veekay/draw_queue.hpp>
+#include <veekay/pipeline_variants.hpp>
+#include <veekay/object_cache.hpp>
+#include <veekay/trace.hpp>
+#include <veekay/memory.hpp>
+#include <veekay/arena.hpp>
+#include <veekay/instance_buffer.hpp>
 
 #include <imgui.h>
 #include <vulkan/vulkan_core.h>
 
+#ifdef TESTBED_EMBEDDED_SHADERS
+// SPIR-V, вшитый в исполняемый файл при сборке (compile_shader ... EMBED)
+#include <shader.vert.h>
+#include <shader.frag.h>
+#include <cull.comp.h>
+#include <procedural.vert.h>
+#endif
+
 
 /*
 Цилиндр с ортографической проекцией. Сгенерировать цилиндр (~50
@@ -63,10 +91,26 @@ struct Vertex {
 
 struct ShaderConstants {
 	Matrix projection;
-	Matrix transform;
 	Vector color;
+	uint32_t features;
+	// NOTE: Used instead of projection by the second view of a multiview pass
+	Matrix second_projection;
+	// NOTE: Cylinder built by procedural.vert, unused by shader.vert
+	float radius;
+	float height;
+	uint32_t segments;
+	// NOTE: Transform of the draw is read from the instance buffer at this index
+	uint32_t instance;
+};
+
+// Возможности шейдера: бит маски и константа специализации constant_id = бит + 1
+enum ShaderFeature : uint32_t {
+	SHADER_FEATURE_LIGHTING = 1 << 0,
+	SHADER_FEATURE_GRADIENT = 1 << 1,
 };
 
+constexpr uint32_t SHADER_FEATURE_COUNT = 2;
+
 struct VulkanBuffer {
 	VkBuffer buffer;
 	VkDeviceMemory memory;
@@ -83,7 +127,16 @@ constexpr float ORTHO_FAR = 10.0f;
 
 enum class ProjectionType { PERSPECTIVE, ORTHOGRAPHIC };
 ProjectionType current_projection = ProjectionType::ORTHOGRAPHIC; // По умолчанию ортографическая
+// TESTBED_SIDE_BY_SIDE=1: обе проекции сразу, слева ортографическая, справа
+// перспективная. Сцена рисуется один раз в два вида через multiview
+bool side_by_side = false;
 constexpr int CYLINDER_SEGMENTS = 100;
+constexpr float CYLINDER_RADIUS = 0.5f;
+constexpr float CYLINDER_HEIGHT = 2.0f;
+// Подробный цилиндр для проверки нагрузки на вершинный конвейер
+constexpr int DENSE_CYLINDER_SEGMENTS = 4096;
+// Расстояние между цилиндрами в сетке экземпляров
+constexpr float INSTANCE_SPACING = 1.0f;
 
 // Глобальные переменные для трансформаций и анимации
 Vector model_position = {0.0f, 0.0f, -5.0f};
@@ -96,7 +149,7 @@ float trajectory_scale = 2.0f; // Масштаб для траектории "в
 float ortho_scale = 5.0f;
 
 
-float animation_speed = 0.2f;
+float animation_speed = 1.0f;
 
 float current_time = 0.0f; // Текущее "время" для параметризации траектории
 bool animation_paused = false;
@@ -106,6 +159,21 @@ float spin_speed_multiplier = 0.05f;
 
 float cylinder_tilt = 0.3f;
 
+// Состояние на предыдущем шаге симуляции, для интерполяции при отрисовке
+Vector previous_position = model_position;
+float previous_rotation = model_rotation;
+
+// Снимок симуляции для отрисовки: симуляция идёт в отдельном потоке,
+// поэтому render читает только отсюда
+struct ModelSnapshot {
+	Vector previous_position;
+	Vector position;
+	float previous_rotation;
+	float rotation;
+};
+
+ModelSnapshot snapshots[veekay::snapshot_slot_count];
+
 // Vulkan Buffers and Modules
 VkShaderModule vertex_shader_module;
 VkShaderModule fragment_shader_module;
@@ -113,9 +181,150 @@ VkShaderModule fragment_shader_module;
 VkPipelineLayout pipeline_layout;
 VkPipeline pipeline;
 
-VulkanBuffer vertex_buffer;
-VulkanBuffer index_buffer;
-uint32_t index_count = 0;
+// Процедурный цилиндр: вершинный шейдер строит его по gl_VertexIndex,
+// буферов вершин и индексов нет вовсе
+VkShaderModule procedural_shader_module;
+VkPipeline procedural_pipeline;
+bool procedural_geometry = false;
+// Радиус и число сегментов разные у соседних экземпляров
+bool procedural_variation = false;
+
+// Под каждый набор возможностей собирается свой конвейер без ветвлений,
+// пока он компилируется, рисует общий pipeline с проверками в шейдере
+veekay::PipelineVariants pipeline_variants;
+bool specialized_pipelines = true;
+bool lighting = false;
+bool height_gradient = false;
+
+struct Mesh {
+	VulkanBuffer vertex_buffer;
+	VulkanBuffer index_buffer;
+	uint32_t index_count;
+};
+
+Mesh cylinder_mesh;
+Mesh dense_cylinder_mesh;
+
+bool high_detail = false;
+constexpr int MAX_INSTANCE_COUNT = 1024;
+int instance_count = 1;
+// Экземпляры с этого номера стоят на месте: их матрицы не меняются
+// и не загружаются на GPU заново
+int moving_instance_count = MAX_INSTANCE_COUNT;
+int cylinder_segments = CYLINDER_SEGMENTS;
+
+// Уровни детализации для потоковой загрузки, от подробного к грубому
+constexpr int STREAMED_LOD_SEGMENTS[] = {4096, 1024, 256, 64, 16};
+constexpr int STREAMED_LOD_COUNT = sizeof(STREAMED_LOD_SEGMENTS) / sizeof(STREAMED_LOD_SEGMENTS[0]);
+
+veekay::StreamedMeshId streamed_cylinder;
+bool streamed_geometry = false;
+int streamed_lod = 0;
+int streaming_budget_kb = 0;
+
+// Кластерное отсечение подробного цилиндра: меш разбит на мешлеты,
+// compute-шейдер отбрасывает невидимые и повёрнутые спиной
+constexpr uint32_t CULLED_INSTANCE_COUNT = 16;
+
+struct CullConstants {
+	Matrix projection;
+	Matrix transform;
+	uint32_t meshlet_count;
+	uint32_t draw_index;
+	float pyramid_size[2];
+	uint32_t occlusion;
+};
+
+bool cluster_culling = false;
+// Мешлеты, закрытые тем, что было нарисовано в прошлом кадре, тоже отбрасываются
+bool occlusion_culling = false;
+uint32_t meshlet_count = 0;
+
+VulkanBuffer meshlet_buffer;
+VulkanBuffer meshlet_index_buffer;
+VulkanBuffer culled_index_buffer;
+VulkanBuffer draw_buffer;
+
+VkShaderModule cull_shader_module;
+VkDescriptorSetLayout cull_descriptor_layout;
+VkDescriptorPool cull_descriptor_pool;
+VkDescriptorSet cull_descriptor_set;
+VkPipelineLayout cull_pipeline_layout;
+VkPipeline cull_pipeline;
+
+Matrix frame_projection;
+Matrix frame_second_projection;
+std::vector<Matrix> instance_transforms;
+
+// Матрицы экземпляров лежат на GPU, за кадр загружаются только изменившиеся,
+// вершинный шейдер читает свою по номеру экземпляра
+veekay::InstanceBuffer instance_buffer;
+VkDescriptorSetLayout instance_descriptor_layout;
+VkDescriptorPool instance_descriptor_pool;
+VkDescriptorSet instance_descriptor_set;
+
+// Экземпляры отправляются в очередь, она сортирует их по состоянию
+// и убирает повторные привязки конвейера и буферов
+veekay::DrawQueue draw_queue;
+
+bool recording_frames = false;
+bool trace_spikes = false;
+bool show_memory = false;
+
+veekay::JobId pipeline_job;
+veekay::JobId mesh_job;
+bool scene_ready = false;
+
+// --- ЭТАЛОННЫЕ ИЗОБРАЖЕНИЯ ---
+// TESTBED_GOLDEN=<каталог>: без окна прогоняет набор сцен, сравнивает каждую
+// с <каталог>/<сцена>.ppm и замеряет время кадра против <каталог>/timings.txt.
+// TESTBED_GOLDEN_UPDATE=1 вместо сравнения перезаписывает эталоны и замеры.
+// Эталоны лежат в testbed/golden и сняты на lavapipe, ctest запускает
+// сравнение с ними (тест testbed_golden), цель golden_update их переснимает:
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json TESTBED_GOLDEN=golden ./testbed
+struct GoldenScene {
+	const char* name;
+	ProjectionType projection;
+	bool high_detail;
+	int instance_count;
+};
+
+constexpr GoldenScene golden_scenes[] = {
+	{"orthographic", ProjectionType::ORTHOGRAPHIC, false, 1},
+	{"perspective", ProjectionType::PERSPECTIVE, false, 1},
+	{"dense", ProjectionType::PERSPECTIVE, true, 1},
+	{"instances", ProjectionType::ORTHOGRAPHIC, false, 100},
+};
+
+constexpr uint32_t golden_scene_count = sizeof(golden_scenes) / sizeof(golden_scenes[0]);
+
+// Первые кадры сцены не замеряем: кэши и конвейер драйвера ещё прогреваются
+constexpr uint32_t golden_warmup_frames = 10;
+constexpr uint32_t golden_timed_frames = 50;
+
+// Допуск на канал: драйверы по-разному растеризуют края треугольников
+constexpr uint32_t golden_tolerance = 8;
+// Доля пикселей, которым разрешено выйти за допуск
+constexpr double golden_max_differing = 0.001;
+// Во сколько раз сцена может замедлиться относительно эталонного замера
+constexpr double golden_max_slowdown = 2.0;
+
+const char* golden_dir = nullptr;
+bool golden_update = false;
+bool golden_failed = false;
+
+uint32_t golden_scene = 0;
+uint32_t golden_frame = 0;
+uint32_t golden_pending = 0;
+std::chrono::steady_clock::time_point golden_start;
+
+double golden_timings[golden_scene_count];
+double golden_baseline[golden_scene_count];
+
+// Выделения памяти в куче за замеряемые кадры. Считаются только в сборке
+// с VEEKAY_COUNT_ALLOCATIONS, тогда установившийся кадр обязан обходиться без них
+uint64_t golden_allocation_start;
+uint64_t golden_allocations[golden_scene_count];
 
 // --- ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ ---
 
@@ -153,10 +362,10 @@ Matrix orthographic(float scale, float aspect_ratio, float near_z, float far_z)
 
 
 // Выбирает проекцию: ортографическая или перспективная
-Matrix projection(float fov, float aspect_ratio, float near, float far) {
+Matrix projection(ProjectionType type, float fov, float aspect_ratio, float near, float far) {
 	Matrix result{};
 
-    if (current_projection == ProjectionType::ORTHOGRAPHIC) {
+    if (type == ProjectionType::ORTHOGRAPHIC) {
 		return orthographic(ortho_scale, aspect_ratio, ORTHO_NEAR, ORTHO_FAR); 
 	}
     
@@ -239,7 +448,8 @@ VkShaderModule loadShaderModule(const char* path) {
 		return nullptr;
 	}
 	size_t size = file.tellg();
-	std::vector<uint32_t> buffer(size / sizeof(uint32_t));
+	// Буфер нужен только до создания модуля
+	std::pmr::vector<uint32_t> buffer(size / sizeof(uint32_t), &veekay::threadArena());
 	file.seekg(0);
 	file.read(reinterpret_cast<char*>(buffer.data()), size);
 	file.close();
@@ -259,7 +469,53 @@ VkShaderModule loadShaderModule(const char* path) {
 	return result;
 }
 
-VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage) {
+#ifdef TESTBED_EMBEDDED_SHADERS
+// Сравнение времени создания шейдерных модулей: чтение .spv с диска
+// против вшитых массивов. Запуск: TESTBED_SHADER_BENCHMARK=1 ./testbed
+void benchmarkShaderLoading() {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int iterations = 100;
+
+	VkDevice& device = veekay::app.vk_device;
+
+	auto measure = [&](auto create) {
+		const auto start = Clock::now();
+
+		for (int i = 0; i < iterations; ++i) {
+			VkShaderModule vertex = create(0);
+			VkShaderModule fragment = create(1);
+
+			vkDestroyShaderModule(device, fragment, nullptr);
+			vkDestroyShaderModule(device, vertex, nullptr);
+		}
+
+		const std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+		return elapsed.count() / iterations;
+	};
+
+	const double from_file = measure([](int stage) {
+		return loadShaderModule(stage == 0 ? TESTBED_SHADER_DIR "/shader.vert.spv"
+		                                   : TESTBED_SHADER_DIR "/shader.frag.spv");
+	});
+
+	const double embedded = measure([](int stage) {
+		return stage == 0 ? veekay::createShaderModule(shader_vert_spv)
+		                  : veekay::createShaderModule(shader_frag_spv);
+	});
+
+	std::cout << "Shader modules, average of " << iterations << " runs:\n"
+	          << "  from .spv files: " << from_file << " us\n"
+	          << "  embedded SPIR-V: " << embedded << " us\n";
+}
+#endif
+
+// Буферы, которые пишет только GPU, лучше держать в DEVICE_LOCAL памяти:
+// на дискретной карте иначе каждое чтение идёт через PCIe
+VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage,
+                          veekay::MemoryCategory category,
+                          VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
 	VkDevice& device = veekay::app.vk_device;
 	VkPhysicalDevice& physical_device = veekay::app.vk_physical_device;
 	
@@ -286,9 +542,6 @@ VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage) {
 		VkPhysicalDeviceMemoryProperties properties;
 		vkGetPhysicalDeviceMemoryProperties(physical_device, &properties);
 
-		const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-		                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
 		uint32_t index = UINT_MAX;
 		for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
 			const VkMemoryType& type = properties.memoryTypes[i];
@@ -311,7 +564,7 @@ VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage) {
 			.memoryTypeIndex = index,
 		};
 
-		if (vkAllocateMemory(device, &info, nullptr, &result.memory) != VK_SUCCESS) {
+		if (veekay::allocateMemory(info, category, &result.memory) != VK_SUCCESS) {
 			std::cerr << "Failed to allocate Vulkan buffer memory\n";
 			return {};
 		}
@@ -321,12 +574,15 @@ VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage) {
 			return {};
 		}
 
-		void* device_data;
-		vkMapMemory(device, result.memory, 0, requirements.size, 0, &device_data);
+		// Буферы, которые заполняет GPU, создаются без начальных данных
+		if (data) {
+			void* device_data;
+			vkMapMemory(device, result.memory, 0, requirements.size, 0, &device_data);
 
-		memcpy(device_data, data, size);
+			memcpy(device_data, data, size);
 
-		vkUnmapMemory(device, result.memory);
+			vkUnmapMemory(device, result.memory);
+		}
 	}
 
 	return result;
@@ -335,7 +591,7 @@ VulkanBuffer createBuffer(size_t size, void *data, VkBufferUsageFlags usage) {
 void destroyBuffer(const VulkanBuffer& buffer) {
 	VkDevice& device = veekay::app.vk_device;
 
-	vkFreeMemory(device, buffer.memory, nullptr);
+	veekay::freeMemory(buffer.memory);
 	vkDestroyBuffer(device, buffer.buffer, nullptr);
 }
 
@@ -347,10 +603,14 @@ void destroyBuffer(const VulkanBuffer& buffer) {
     - height - высота (вдоль Y)
     - segments - количество полигональных сегментов
 */
-void generateCylinder(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float radius, float height, int segments) {
+void generateCylinder(std::pmr::vector<Vertex>& vertices, std::pmr::vector<uint32_t>& indices, float radius, float height, int segments) {
 	vertices.clear();
 	indices.clear();
 
+	// Размеры известны заранее, вектор не растёт и не бросает старые копии в арене
+	vertices.reserve(segments * 2);
+	indices.reserve(segments * 6);
+
 	/*
 		Вершины
 		параметрическое уравнение окружности для
@@ -391,153 +651,466 @@ void generateCylinder(std::vector<Vertex>& vertices, std::vector<uint32_t>& indi
 	}
 }
 
-void initialize() {
-	VkDevice& device = veekay::app.vk_device;
+// Собирает графический конвейер из шейдерных модулей. Вызывается и при
+// горячей перезагрузке шейдеров, и для вариантов из фоновых потоков,
+// поэтому только читает состояние. procedural: вершинный шейдер без атрибутов
+VkPipeline createGraphicsPipeline(VkShaderModule vertex, VkShaderModule fragment,
+                                  const VkSpecializationInfo* specialization, bool procedural) {
+	VkPipelineShaderStageCreateInfo stage_infos[2];
+
+	// NOTE: Vertex shader stage
+	stage_infos[0] = VkPipelineShaderStageCreateInfo{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = vertex,
+		.pName = "main",
+		.pSpecializationInfo = specialization,
+	};
 
-	{ // NOTE: Build graphics pipeline
+	// NOTE: Fragment shader stage
+	stage_infos[1] = VkPipelineShaderStageCreateInfo{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = fragment,
+		.pName = "main",
+		.pSpecializationInfo = specialization,
+	};
 
-		// вершинный шейдер (расположение модели в пространстве)
-		vertex_shader_module = loadShaderModule("./shaders/shader.vert.spv");
-		if (!vertex_shader_module) {
-			std::cerr << "Failed to load Vulkan vertex shader from file\n";
-			veekay::app.running = false;
-			return;
-		}
+	// NOTE: How many bytes does a vertex take?
+	VkVertexInputBindingDescription buffer_binding{
+		.binding = 0,
+		.stride = sizeof(Vertex),
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
 
-		// фрагментный шейдер (раскраска)
-		fragment_shader_module = loadShaderModule("./shaders/shader.frag.spv");
-		if (!fragment_shader_module) {
-			std::cerr << "Failed to load Vulkan fragment shader from file\n";
-			veekay::app.running = false;
-			return;
-		}
+	// NOTE: Declare vertex attributes
+	VkVertexInputAttributeDescription attributes[] = {
+		{
+			.location = 0, // NOTE: First attribute
+			.binding = 0, // NOTE: First vertex buffer
+			.format = VK_FORMAT_R32G32B32_SFLOAT, // NOTE: 3-component vector of floats
+			.offset = offsetof(Vertex, position), // NOTE: Offset of "position" field in a Vertex struct
+		},
+	};
 
-		VkPipelineShaderStageCreateInfo stage_infos[2];
+	// NOTE: Bring
+	VkPipelineVertexInputStateCreateInfo input_state_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = procedural ? 0u : 1u,
+		.pVertexBindingDescriptions = &buffer_binding,
+		.vertexAttributeDescriptionCount = procedural ? 0u : uint32_t(sizeof(attributes) / sizeof(attributes[0])),
+		.pVertexAttributeDescriptions = attributes,
+	};
 
-		// NOTE: Vertex shader stage
-		stage_infos[0] = VkPipelineShaderStageCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = vertex_shader_module,
-			.pName = "main",
-		};
+	// NOTE: Every three vertices make up a triangle,
+	// so our vertex buffer contains a "list of triangles"
+	VkPipelineInputAssemblyStateCreateInfo assembly_state_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+	};
+
+	// NOTE: Declare clockwise triangle order as front-facing
+	// Discard triangles that are facing away
+	// Fill triangles, don't draw lines instaed
+	VkPipelineRasterizationStateCreateInfo raster_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = VK_CULL_MODE_BACK_BIT, // только лицевая сторона
+		// .cullMode = VK_CULL_MODE_NONE,
+		.frontFace = VK_FRONT_FACE_CLOCKWISE, // это считаем лицом (вершины по часовой стрелке)
+		.lineWidth = 1.0f,
+	};
+
+	// NOTE: Use 1 sample per pixel
+	VkPipelineMultisampleStateCreateInfo sample_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		.sampleShadingEnable = false,
+		.minSampleShading = 1.0f,
+	};
+
+	// в какую часть окна отрисовывать финальное изображение
+	// преобразуем координаты
+	VkViewport viewport{
+		.x = 0.0f,
+		.y = 0.0f,
+		.width = static_cast<float>(veekay::app.view_width),
+		.height = static_cast<float>(veekay::app.view_height),
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	};
+
+	// отсекаем ненужные пиксели
+	VkRect2D scissor{
+		.offset = {0, 0},
+		.extent = {veekay::app.view_width, veekay::app.view_height},
+	};
+
+	// NOTE: Let rasterizer draw on the entire window
+	VkPipelineViewportStateCreateInfo viewport_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+
+		.viewportCount = 1,
+		.pViewports = &viewport,
+
+		.scissorCount = 1,
+		.pScissors = &scissor,
+	};
+
+	// NOTE: Let rasterizer perform depth-testing and overwrite depth values on condition pass
+	VkPipelineDepthStencilStateCreateInfo depth_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = true,
+		.depthWriteEnable = true,
+		.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+	};
+
+	// NOTE: Let fragment shader write all the color channels
+	VkPipelineColorBlendAttachmentState attachment_info{
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+		                  VK_COLOR_COMPONENT_G_BIT |
+		                  VK_COLOR_COMPONENT_B_BIT |
+		                  VK_COLOR_COMPONENT_A_BIT,
+	};
 
-		// NOTE: Fragment shader stage
-		stage_infos[1] = VkPipelineShaderStageCreateInfo{
+	// NOTE: Let rasterizer just copy resulting pixels onto a buffer, don't blend
+	VkPipelineColorBlendStateCreateInfo blend_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+
+		.logicOpEnable = false,
+		.logicOp = VK_LOGIC_OP_COPY,
+
+		.attachmentCount = 1,
+		.pAttachments = &attachment_info
+	};
+
+	VkGraphicsPipelineCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = 2,
+		.pStages = stage_infos,
+		.pVertexInputState = &input_state_info,
+		.pInputAssemblyState = &assembly_state_info,
+		.pViewportState = &viewport_info,
+		.pRasterizationState = &raster_info,
+		.pMultisampleState = &sample_info,
+		.pDepthStencilState = &depth_info,
+		.pColorBlendState = &blend_info,
+		.layout = pipeline_layout,
+		.renderPass = veekay::app.vk_render_pass,
+	};
+
+	VkPipeline result;
+
+	// NOTE: Create graphics pipeline
+	if (vkCreateGraphicsPipelines(veekay::app.vk_device, nullptr,
+	                              1, &info, nullptr, &result) != VK_SUCCESS) {
+		return VK_NULL_HANDLE;
+	}
+
+	return result;
+}
+
+VkPipeline createSpecializedPipeline(VkShaderModule vertex, VkShaderModule fragment,
+                                     const VkSpecializationInfo* specialization) {
+	return createGraphicsPipeline(vertex, fragment, specialization, false);
+}
+
+// Общий конвейер: константы специализации по умолчанию, возможности
+// проверяются в шейдере по маске из push-констант
+VkPipeline createPipeline(VkShaderModule vertex, VkShaderModule fragment) {
+	return createSpecializedPipeline(vertex, fragment, nullptr);
+}
+
+// Процедурный цилиндр рисуется общим конвейером, без вариантов
+VkPipeline createProceduralPipeline(VkShaderModule vertex, VkShaderModule fragment) {
+	return createGraphicsPipeline(vertex, fragment, nullptr, true);
+}
+
+// Отдельно от кэша объектов: конвейером владеет veekay, он следит за cull.comp
+VkPipeline createCullPipeline(VkShaderModule compute) {
+	VkComputePipelineCreateInfo info{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = fragment_shader_module,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = compute,
 			.pName = "main",
-		};
+		},
+		.layout = cull_pipeline_layout,
+	};
 
-		// NOTE: How many bytes does a vertex take?
-		VkVertexInputBindingDescription buffer_binding{
-			.binding = 0,
-			.stride = sizeof(Vertex),
-			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-		};
+	VkPipeline result;
 
-		// NOTE: Declare vertex attributes
-		VkVertexInputAttributeDescription attributes[] = {
-			{
-				.location = 0, // NOTE: First attribute
-				.binding = 0, // NOTE: First vertex buffer
-				.format = VK_FORMAT_R32G32B32_SFLOAT, // NOTE: 3-component vector of floats
-				.offset = offsetof(Vertex, position), // NOTE: Offset of "position" field in a Vertex struct
-			},
-		};
+	if (vkCreateComputePipelines(veekay::app.vk_device, nullptr,
+	                             1, &info, nullptr, &result) != VK_SUCCESS) {
+		return VK_NULL_HANDLE;
+	}
 
-		// NOTE: Bring
-		VkPipelineVertexInputStateCreateInfo input_state_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.vertexBindingDescriptionCount = 1,
-			.pVertexBindingDescriptions = &buffer_binding,
-			.vertexAttributeDescriptionCount = sizeof(attributes) / sizeof(attributes[0]),
-			.pVertexAttributeDescriptions = attributes,
-		};
+	return result;
+}
 
-		// NOTE: Every three vertices make up a triangle,
-		// so our vertex buffer contains a "list of triangles"
-		VkPipelineInputAssemblyStateCreateInfo assembly_state_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-			.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		};
+// Вызывается при подмене общего конвейера перезагруженным
+void reloadVariants(std::span<const uint32_t> vertex, std::span<const uint32_t> fragment) {
+	pipeline_variants.reload(vertex, fragment);
+}
 
-		// NOTE: Declare clockwise triangle order as front-facing
-		// Discard triangles that are facing away
-		// Fill triangles, don't draw lines instaed
-		VkPipelineRasterizationStateCreateInfo raster_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-			.polygonMode = VK_POLYGON_MODE_FILL,
-			.cullMode = VK_CULL_MODE_BACK_BIT, // только лицевая сторона
-			// .cullMode = VK_CULL_MODE_NONE,
-			.frontFace = VK_FRONT_FACE_CLOCKWISE, // это считаем лицом (вершины по часовой стрелке)
-			.lineWidth = 1.0f,
-		};
+// Шейдерные модули и конвейер собираются в фоне, пока идут первые кадры
+void buildPipeline() {
+#ifdef TESTBED_EMBEDDED_SHADERS
+	// вершинный шейдер (расположение модели в пространстве)
+	vertex_shader_module = veekay::createShaderModule(shader_vert_spv);
+
+	// фрагментный шейдер (раскраска)
+	fragment_shader_module = veekay::createShaderModule(shader_frag_spv);
+#else
+	// NOTE: No glslc at build time, fall back to precompiled files
+	vertex_shader_module = loadShaderModule(TESTBED_SHADER_DIR "/shader.vert.spv");
+	fragment_shader_module = loadShaderModule(TESTBED_SHADER_DIR "/shader.frag.spv");
+#endif
 
-		// NOTE: Use 1 sample per pixel
-		VkPipelineMultisampleStateCreateInfo sample_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-			.sampleShadingEnable = false,
-			.minSampleShading = 1.0f,
-		};
+	if (!vertex_shader_module) {
+		std::cerr << "Failed to create Vulkan vertex shader module\n";
+		return;
+	}
 
-		// в какую часть окна отрисовывать финальное изображение
-		// преобразуем координаты
-		VkViewport viewport{
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = static_cast<float>(veekay::app.window_width),
-			.height = static_cast<float>(veekay::app.window_height),
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		};
+	if (!fragment_shader_module) {
+		std::cerr << "Failed to create Vulkan fragment shader module\n";
+		return;
+	}
 
-		// отсекаем ненужные пиксели
-		VkRect2D scissor{
-			.offset = {0, 0},
-			.extent = {veekay::app.window_width, veekay::app.window_height},
-		};
+	pipeline = createPipeline(vertex_shader_module, fragment_shader_module);
+	if (!pipeline) {
+		std::cerr << "Failed to create Vulkan pipeline\n";
+		return;
+	}
 
-		// NOTE: Let rasterizer draw on the entire window
-		VkPipelineViewportStateCreateInfo viewport_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+	veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipeline, "cylinder");
 
-			.viewportCount = 1,
-			.pViewports = &viewport,
+	pipeline_variants.init(vertex_shader_module, fragment_shader_module,
+	                       createSpecializedPipeline, SHADER_FEATURE_COUNT);
 
-			.scissorCount = 1,
-			.pScissors = &scissor,
-		};
+	// Правки shader.vert/shader.frag подхватываются без перезапуска,
+	// варианты пересобираются из новых шейдеров
+	veekay::watchShaders(TESTBED_SHADER_DIR "/shader.vert", TESTBED_SHADER_DIR "/shader.frag",
+	                     createPipeline, &pipeline, reloadVariants);
 
-		// NOTE: Let rasterizer perform depth-testing and overwrite depth values on condition pass
-		VkPipelineDepthStencilStateCreateInfo depth_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-			.depthTestEnable = true,
-			.depthWriteEnable = true,
-			.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
-		};
+#ifdef TESTBED_EMBEDDED_SHADERS
+	procedural_shader_module = veekay::createShaderModule(procedural_vert_spv);
+#else
+	procedural_shader_module = loadShaderModule(TESTBED_SHADER_DIR "/procedural.vert.spv");
+#endif
+
+	// Без процедурного конвейера цилиндр просто остаётся на буферах
+	if (procedural_shader_module) {
+		procedural_pipeline = createProceduralPipeline(procedural_shader_module, fragment_shader_module);
+	}
+
+	if (procedural_pipeline) {
+		veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)procedural_pipeline, "procedural cylinder");
+
+		veekay::watchShaders(TESTBED_SHADER_DIR "/procedural.vert", TESTBED_SHADER_DIR "/shader.frag",
+		                     createProceduralPipeline, &procedural_pipeline);
+	} else {
+		std::cerr << "Failed to create Vulkan procedural cylinder pipeline\n";
+	}
+
+#ifdef TESTBED_EMBEDDED_SHADERS
+	cull_shader_module = veekay::createShaderModule(cull_comp_spv);
+#else
+	cull_shader_module = loadShaderModule(TESTBED_SHADER_DIR "/cull.comp.spv");
+#endif
+
+	if (!cull_shader_module) {
+		std::cerr << "Failed to create Vulkan cluster culling shader module\n";
+		return;
+	}
+
+	cull_pipeline = createCullPipeline(cull_shader_module);
+	if (!cull_pipeline) {
+		std::cerr << "Failed to create Vulkan cluster culling pipeline\n";
+		return;
+	}
+
+	veekay::setObjectName(VK_OBJECT_TYPE_PIPELINE, (uint64_t)cull_pipeline, "cluster culling");
+
+	veekay::watchComputeShader(TESTBED_SHADER_DIR "/cull.comp", createCullPipeline, &cull_pipeline);
+}
+
+Mesh createCylinderMesh(int segments, const char* name) {
+	// Временные данные: живут в арене потока, после задачи или кадра сбрасываются
+	std::pmr::vector<Vertex> vertices(&veekay::threadArena());
+	std::pmr::vector<uint32_t> indices(&veekay::threadArena());
+
+	generateCylinder(vertices, indices, CYLINDER_RADIUS, CYLINDER_HEIGHT, segments);
 
-		// NOTE: Let fragment shader write all the color channels
-		VkPipelineColorBlendAttachmentState attachment_info{
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-			                  VK_COLOR_COMPONENT_G_BIT |
-			                  VK_COLOR_COMPONENT_B_BIT |
-			                  VK_COLOR_COMPONENT_A_BIT,
+	Mesh result{.index_count = (uint32_t)indices.size()};
+
+	// Создание буфера вершин
+	result.vertex_buffer = createBuffer(vertices.size() * sizeof(Vertex),
+	                                    vertices.data(),
+	                                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                                    veekay::MemoryCategory::geometry);
+
+	// Создание буфера индексов
+	result.index_buffer = createBuffer(indices.size() * sizeof(uint32_t),
+	                                   indices.data(),
+	                                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	                                   veekay::MemoryCategory::geometry);
+
+	const std::string vertices_name = std::string(name) + " vertices";
+	const std::string indices_name = std::string(name) + " indices";
+
+	veekay::setObjectName(VK_OBJECT_TYPE_BUFFER, (uint64_t)result.vertex_buffer.buffer, vertices_name.c_str());
+	veekay::setObjectName(VK_OBJECT_TYPE_BUFFER, (uint64_t)result.index_buffer.buffer, indices_name.c_str());
+
+	return result;
+}
+
+// Мешлеты подробного цилиндра и буферы, в которые пишет отсечение
+void buildMeshlets() {
+	// Временные данные: живут в арене потока, после задачи или кадра сбрасываются
+	std::pmr::vector<Vertex> vertices(&veekay::threadArena());
+	std::pmr::vector<uint32_t> indices(&veekay::threadArena());
+
+	// Те же вершины, что и в dense_cylinder_mesh, меняется только порядок треугольников
+	generateCylinder(vertices, indices, CYLINDER_RADIUS, CYLINDER_HEIGHT, DENSE_CYLINDER_SEGMENTS);
+
+	// Лицевая сторона та же, что и в конвейере (VK_FRONT_FACE_CLOCKWISE)
+	const veekay::MeshletMesh meshlets = veekay::buildMeshlets(
+		vertices.data(), sizeof(Vertex), (uint32_t)vertices.size(), indices, VK_FRONT_FACE_CLOCKWISE);
+
+	meshlet_count = (uint32_t)meshlets.meshlets.size();
+
+	meshlet_buffer = createBuffer(meshlets.meshlets.size() * sizeof(veekay::Meshlet),
+	                              (void*)meshlets.meshlets.data(),
+	                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                              veekay::MemoryCategory::geometry);
+
+	meshlet_index_buffer = createBuffer(meshlets.indices.size() * sizeof(uint32_t),
+	                                    (void*)meshlets.indices.data(),
+	                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                                    veekay::MemoryCategory::geometry);
+
+	culled_index_buffer = createBuffer(CULLED_INSTANCE_COUNT * indices.size() * sizeof(uint32_t), nullptr,
+	                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	                                   veekay::MemoryCategory::geometry, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	draw_buffer = createBuffer(CULLED_INSTANCE_COUNT * sizeof(VkDrawIndexedIndirectCommand), nullptr,
+	                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+	                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                           veekay::MemoryCategory::other, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkDescriptorBufferInfo buffer_infos[] = {
+		{.buffer = meshlet_buffer.buffer, .range = VK_WHOLE_SIZE},
+		{.buffer = meshlet_index_buffer.buffer, .range = VK_WHOLE_SIZE},
+		{.buffer = culled_index_buffer.buffer, .range = VK_WHOLE_SIZE},
+		{.buffer = draw_buffer.buffer, .range = VK_WHOLE_SIZE},
+	};
+
+	VkWriteDescriptorSet writes[5];
+
+	for (uint32_t i = 0; i < 4; ++i) {
+		writes[i] = VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = cull_descriptor_set,
+			.dstBinding = i,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &buffer_infos[i],
 		};
+	}
 
-		// NOTE: Let rasterizer just copy resulting pixels onto a buffer, don't blend
-		VkPipelineColorBlendStateCreateInfo blend_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+	const veekay::DepthPyramid& pyramid = veekay::depthPyramid();
 
-			.logicOpEnable = false,
-			.logicOp = VK_LOGIC_OP_COPY,
+	VkDescriptorImageInfo pyramid_info{
+		.sampler = pyramid.sampler,
+		.imageView = pyramid.view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	};
+
+	writes[4] = VkWriteDescriptorSet{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = cull_descriptor_set,
+		.dstBinding = 4,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = &pyramid_info,
+	};
+
+	// NOTE: Without a depth pyramid culling stays off, binding 4 is never used
+	vkUpdateDescriptorSets(veekay::app.vk_device, pyramid.view ? 5 : 4, writes, 0, nullptr);
+}
+
+// Генерация цилиндров и загрузка буферов, тоже в фоне
+void buildMesh() {
+	cylinder_mesh = createCylinderMesh(CYLINDER_SEGMENTS, "cylinder");
+	dense_cylinder_mesh = createCylinderMesh(DENSE_CYLINDER_SEGMENTS, "dense cylinder");
+
+	buildMeshlets();
+}
+
+// Уровни детализации пишутся на диск, дальше их подгружает veekay по запросу
+void writeCylinderLods() {
+	// Временные данные: живут в арене потока, после задачи или кадра сбрасываются
+	std::pmr::vector<Vertex> vertices(&veekay::threadArena());
+	std::pmr::vector<uint32_t> indices(&veekay::threadArena());
+
+	std::vector<std::string> paths;
+
+	for (int i = 0; i < STREAMED_LOD_COUNT; ++i) {
+		const std::filesystem::path path = std::filesystem::temp_directory_path() /
+			("veekay_cylinder_lod" + std::to_string(i) + ".mesh");
 
-			.attachmentCount = 1,
-			.pAttachments = &attachment_info
+		generateCylinder(vertices, indices, CYLINDER_RADIUS, CYLINDER_HEIGHT, STREAMED_LOD_SEGMENTS[i]);
+
+		if (!veekay::writeMeshFile(path.string().c_str(), vertices.data(), sizeof(Vertex),
+		                           (uint32_t)vertices.size(), indices)) {
+			return;
+		}
+
+		paths.push_back(path.string());
+	}
+
+	const char* lod_paths[STREAMED_LOD_COUNT];
+	for (int i = 0; i < STREAMED_LOD_COUNT; ++i) {
+		lod_paths[i] = paths[i].c_str();
+	}
+
+	streamed_cylinder = veekay::addStreamedMesh(lod_paths);
+}
+
+void initialize() {
+	VkDevice& device = veekay::app.vk_device;
+
+#ifdef TESTBED_EMBEDDED_SHADERS
+	if (std::getenv("TESTBED_SHADER_BENCHMARK")) {
+		benchmarkShaderLoading();
+	}
+#endif
+
+	{ // NOTE: Build graphics pipeline layout, pipeline itself is built by a job
+		// NOTE: Instance transforms, read by vertex shaders
+		VkDescriptorSetLayoutBinding binding{
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
 		};
 
+		VkDescriptorSetLayoutCreateInfo set_layout_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 1,
+			.pBindings = &binding,
+		};
+
+		instance_descriptor_layout = veekay::cachedDescriptorSetLayout(set_layout_info);
+		if (!instance_descriptor_layout) {
+			std::cerr << "Failed to create Vulkan descriptor set layout\n";
+			veekay::app.running = false;
+			return;
+		}
+
 		// NOTE: Declare constant memory region visible to vertex and fragment shaders
 		// Способ передачи маленьких данных с CPU на GPU
 		VkPushConstantRange push_constants{
@@ -546,90 +1119,379 @@ void initialize() {
 			.size = sizeof(ShaderConstants),
 		};
 
-		// NOTE: Declare external data sources, only push constants this time
+		// NOTE: Declare external data sources, instance buffer and push constants
 		VkPipelineLayoutCreateInfo layout_info{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &instance_descriptor_layout,
 			.pushConstantRangeCount = 1,
 			.pPushConstantRanges = &push_constants,
 		};
 
-		// NOTE: Create pipeline layout
-		if (vkCreatePipelineLayout(device, &layout_info,
-		                           nullptr, &pipeline_layout) != VK_SUCCESS) {
+		// NOTE: Create pipeline layout, or share an identical one
+		pipeline_layout = veekay::cachedPipelineLayout(layout_info);
+		if (!pipeline_layout) {
 			std::cerr << "Failed to create Vulkan pipeline layout\n";
 			veekay::app.running = false;
 			return;
 		}
-		
-		VkGraphicsPipelineCreateInfo info{
-			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-			.stageCount = 2,
-			.pStages = stage_infos,
-			.pVertexInputState = &input_state_info,
-			.pInputAssemblyState = &assembly_state_info,
-			.pViewportState = &viewport_info,
-			.pRasterizationState = &raster_info,
-			.pMultisampleState = &sample_info,
-			.pDepthStencilState = &depth_info,
-			.pColorBlendState = &blend_info,
-			.layout = pipeline_layout,
-			.renderPass = veekay::app.vk_render_pass,
+	}
+
+	{ // NOTE: Instance buffer and the descriptor set drawing reads it through
+		if (!instance_buffer.create(sizeof(Matrix), MAX_INSTANCE_COUNT, "instance transforms")) {
+			std::cerr << "Failed to create instance buffer\n";
+			veekay::app.running = false;
+			return;
+		}
+
+		VkDescriptorPoolSize pool_size{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1};
+
+		VkDescriptorPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = 1,
+			.poolSizeCount = 1,
+			.pPoolSizes = &pool_size,
+		};
+
+		if (vkCreateDescriptorPool(device, &pool_info, nullptr, &instance_descriptor_pool) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan descriptor pool\n";
+			veekay::app.running = false;
+			return;
+		}
+
+		VkDescriptorSetAllocateInfo set_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = instance_descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &instance_descriptor_layout,
 		};
 
-		// NOTE: Create graphics pipeline
-		if (vkCreateGraphicsPipelines(device, nullptr,
-		                              1, &info, nullptr, &pipeline) != VK_SUCCESS) {
-			std::cerr << "Failed to create Vulkan pipeline\n";
+		if (vkAllocateDescriptorSets(device, &set_info, &instance_descriptor_set) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate Vulkan descriptor set\n";
 			veekay::app.running = false;
 			return;
 		}
+
+		VkDescriptorBufferInfo buffer_info{
+			.buffer = instance_buffer.buffer(),
+			.offset = 0,
+			.range = instance_buffer.size(),
+		};
+
+		VkWriteDescriptorSet write{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = instance_descriptor_set,
+			.dstBinding = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &buffer_info,
+		};
+
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
 	}
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	{ // NOTE: Layouts of cluster culling, its pipeline is built by a job too
+		VkDescriptorSetLayoutBinding bindings[5];
 
-	// Генерация цилиндра: радиус 0.5, высота 2.0, ~100 сегментов
-	generateCylinder(vertices, indices, 0.5f, 2.0f, CYLINDER_SEGMENTS);
-	index_count = (uint32_t)indices.size();
+		for (uint32_t i = 0; i < 4; ++i) {
+			bindings[i] = VkDescriptorSetLayoutBinding{
+				.binding = i,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			};
+		}
 
-	// Создание буфера вершин
-	vertex_buffer = createBuffer(vertices.size() * sizeof(Vertex),
-	                             vertices.data(),
-	                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		bindings[4] = VkDescriptorSetLayoutBinding{
+			.binding = 4,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		};
 
-	// Создание буфера индексов
-	index_buffer = createBuffer(indices.size() * sizeof(uint32_t),
-	                            indices.data(),
-	                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		VkDescriptorSetLayoutCreateInfo layout_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = 5,
+			.pBindings = bindings,
+		};
+
+		cull_descriptor_layout = veekay::cachedDescriptorSetLayout(layout_info);
+		if (!cull_descriptor_layout) {
+			std::cerr << "Failed to create Vulkan descriptor set layout\n";
+			veekay::app.running = false;
+			return;
+		}
+
+		VkDescriptorPoolSize pool_sizes[] = {
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+		};
+
+		VkDescriptorPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets = 1,
+			.poolSizeCount = 2,
+			.pPoolSizes = pool_sizes,
+		};
+
+		if (vkCreateDescriptorPool(device, &pool_info, nullptr, &cull_descriptor_pool) != VK_SUCCESS) {
+			std::cerr << "Failed to create Vulkan descriptor pool\n";
+			veekay::app.running = false;
+			return;
+		}
+
+		VkDescriptorSetAllocateInfo set_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = cull_descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &cull_descriptor_layout,
+		};
+
+		if (vkAllocateDescriptorSets(device, &set_info, &cull_descriptor_set) != VK_SUCCESS) {
+			std::cerr << "Failed to allocate Vulkan descriptor set\n";
+			veekay::app.running = false;
+			return;
+		}
+
+		VkPushConstantRange push_constants{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.size = sizeof(CullConstants),
+		};
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &cull_descriptor_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constants,
+		};
+
+		cull_pipeline_layout = veekay::cachedPipelineLayout(pipeline_layout_info);
+		if (!cull_pipeline_layout) {
+			std::cerr << "Failed to create Vulkan pipeline layout\n";
+			veekay::app.running = false;
+			return;
+		}
+	}
+
+	// Конвейер и меш не зависят друг от друга, собираем параллельно.
+	// Пока они не готовы, кадры рисуются без цилиндра (только UI)
+	pipeline_job = veekay::async(buildPipeline);
+	mesh_job = veekay::async(buildMesh);
+
+	writeCylinderLods();
 }
 
 void shutdown() {
 	VkDevice& device = veekay::app.vk_device;
 
 	// NOTE: Destroy resources here, do not cause leaks in your program!
-	destroyBuffer(index_buffer);
-	destroyBuffer(vertex_buffer);
+	destroyBuffer(draw_buffer);
+	destroyBuffer(culled_index_buffer);
+	destroyBuffer(meshlet_index_buffer);
+	destroyBuffer(meshlet_buffer);
+
+	// NOTE: Layouts belong to veekay's object cache, culling pipeline is
+	//       owned by veekay since it is watched for shader changes
+	vkDestroyDescriptorPool(device, cull_descriptor_pool, nullptr);
+	vkDestroyShaderModule(device, cull_shader_module, nullptr);
+
+	instance_buffer.destroy();
+	vkDestroyDescriptorPool(device, instance_descriptor_pool, nullptr);
+
+	destroyBuffer(dense_cylinder_mesh.index_buffer);
+	destroyBuffer(dense_cylinder_mesh.vertex_buffer);
+	destroyBuffer(cylinder_mesh.index_buffer);
+	destroyBuffer(cylinder_mesh.vertex_buffer);
 
-	vkDestroyPipeline(device, pipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+	pipeline_variants.destroy();
+
+	// NOTE: pipeline is owned by veekay since it is watched for shader changes,
+	//       its layout is cached
+	vkDestroyShaderModule(device, procedural_shader_module, nullptr);
 	vkDestroyShaderModule(device, fragment_shader_module, nullptr);
 	vkDestroyShaderModule(device, vertex_shader_module, nullptr);
 }
 
-void update(double time) {
+void loadGoldenTimings() {
+	const std::string path = std::string(golden_dir) + "/timings.txt";
+
+	std::ifstream file(path);
+
+	// Без замеров медленный кадр прошёл бы незамеченным
+	if (!file.is_open()) {
+		std::cerr << "Missing golden timings " << path << ", run with TESTBED_GOLDEN_UPDATE=1\n";
+		golden_failed = true;
+		return;
+	}
+
+	std::string name;
+	double milliseconds;
+
+	while (file >> name >> milliseconds) {
+		for (uint32_t i = 0; i < golden_scene_count; ++i) {
+			if (name == golden_scenes[i].name) {
+				golden_baseline[i] = milliseconds;
+			}
+		}
+	}
+}
+
+void saveGoldenTimings() {
+	const std::string path = std::string(golden_dir) + "/timings.txt";
+
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "Failed to write golden timings: " << path << '\n';
+		golden_failed = true;
+		return;
+	}
+
+	for (uint32_t i = 0; i < golden_scene_count; ++i) {
+		file << golden_scenes[i].name << ' ' << golden_timings[i] << '\n';
+	}
+}
+
+// Вызывается, когда снимок сцены скопирован с GPU
+void checkGolden(uint32_t scene, const uint8_t* pixels, uint32_t width, uint32_t height) {
+	const char* name = golden_scenes[scene].name;
+	const std::string path = std::string(golden_dir) + "/" + name + ".ppm";
+
+	if (golden_update) {
+		if (!veekay::writeImage(path.c_str(), veekay::ImageFormat::ppm, pixels, width, height)) {
+			golden_failed = true;
+		}
+
+		std::cout << "UPDATE " << name << ": " << golden_timings[scene] << " ms/frame\n";
+	} else {
+		std::vector<uint8_t> golden;
+		uint32_t golden_width, golden_height;
+
+		bool passed = false;
+
+		if (!veekay::readImage(path.c_str(), golden, golden_width, golden_height)) {
+			std::cerr << "Missing golden image " << path << ", run with TESTBED_GOLDEN_UPDATE=1\n";
+		} else if (golden_width != width || golden_height != height) {
+			std::cerr << "Golden image " << path << " is " << golden_width << 'x' << golden_height
+			          << ", frame is " << width << 'x' << height << '\n';
+		} else {
+			const veekay::ImageDifference difference =
+				veekay::compareImages(pixels, golden.data(), width, height, golden_tolerance);
+
+			const double differing = double(difference.differing_pixels) / (double(width) * height);
+
+			passed = differing <= golden_max_differing;
+
+			std::cout << (passed ? "PASS " : "FAIL ") << name
+			          << ": max error " << difference.max_error
+			          << ", mean error " << difference.mean_error
+			          << ", " << difference.differing_pixels << " pixels differ\n";
+
+			if (!passed) {
+				const std::string failed_path = std::string(golden_dir) + "/" + name + ".failed.ppm";
+				veekay::writeImage(failed_path.c_str(), veekay::ImageFormat::ppm, pixels, width, height);
+			}
+		}
+
+		const double baseline = golden_baseline[scene];
+		const bool slow = baseline > 0.0 && golden_timings[scene] > baseline * golden_max_slowdown;
+
+		std::cout << (slow ? "SLOW " : "TIME ") << name << ": " << golden_timings[scene]
+		          << " ms/frame, baseline " << baseline << " ms/frame\n";
+
+#ifdef VEEKAY_COUNT_ALLOCATIONS
+		const bool allocating = golden_allocations[scene] != 0;
+
+		std::cout << (allocating ? "HEAP " : "ZERO ") << name << ": "
+		          << golden_allocations[scene] << " heap allocations in timed frames\n";
+#else
+		const bool allocating = false;
+#endif
+
+		if (!passed || slow || allocating) {
+			golden_failed = true;
+		}
+	}
+
+	--golden_pending;
+
+	if (golden_scene == golden_scene_count && golden_pending == 0) {
+		if (golden_update) {
+			saveGoldenTimings();
+		}
+
+		veekay::app.running = false;
+	}
+}
+
+// Прогон сцен по очереди: выставить параметры, прогреть, замерить, снять кадр
+void updateGolden() {
+	if (!scene_ready || golden_scene == golden_scene_count) {
+		return;
+	}
+
+	const GoldenScene& scene = golden_scenes[golden_scene];
+
+	if (golden_frame == 0) {
+		current_projection = scene.projection;
+		high_detail = scene.high_detail;
+		instance_count = scene.instance_count;
+	}
+
+	++golden_frame;
+
+	if (golden_frame == golden_warmup_frames) {
+		golden_start = std::chrono::steady_clock::now();
+		golden_allocation_start = veekay::heapAllocationCount();
+	}
+
+	if (golden_frame == golden_warmup_frames + golden_timed_frames) {
+		const std::chrono::duration<double, std::milli> elapsed =
+			std::chrono::steady_clock::now() - golden_start;
+
+		golden_timings[golden_scene] = elapsed.count() / golden_timed_frames;
+		golden_allocations[golden_scene] = veekay::heapAllocationCount() - golden_allocation_start;
+
+		// Снимается кадр, который запишется после этого update
+		veekay::captureFrame([scene = golden_scene](const uint8_t* pixels, uint32_t width, uint32_t height) {
+			checkGolden(scene, pixels, width, height);
+		});
+
+		++golden_pending;
+		++golden_scene;
+		golden_frame = 0;
+	}
+}
+
+void update(double) {
+	if (golden_dir) {
+		// Без интерфейса: эталоны не должны зависеть от окна настроек
+		updateGolden();
+		return;
+	}
+
+	if (show_memory) {
+		veekay::showMemoryWindow(&show_memory);
+	}
+
 	ImGui::Begin("Controls:");
 	
 	// 1. Управление проекцией
 	ImGui::Text("Projection:");
-	if (ImGui::RadioButton("Orthographic", current_projection == ProjectionType::ORTHOGRAPHIC)) {
-		current_projection = ProjectionType::ORTHOGRAPHIC;
-	}
-	ImGui::SameLine();
-	if (ImGui::RadioButton("Perspective", current_projection == ProjectionType::PERSPECTIVE)) {
-		current_projection = ProjectionType::PERSPECTIVE;
+	if (side_by_side) {
+		// Обе проекции на экране, выбирать нечего
+		ImGui::Text("Orthographic | Perspective");
+	} else {
+		if (ImGui::RadioButton("Orthographic", current_projection == ProjectionType::ORTHOGRAPHIC)) {
+			current_projection = ProjectionType::ORTHOGRAPHIC;
+		}
+		ImGui::SameLine();
+		if (ImGui::RadioButton("Perspective", current_projection == ProjectionType::PERSPECTIVE)) {
+			current_projection = ProjectionType::PERSPECTIVE;
+		}
 	}
 	
-	if (current_projection == ProjectionType::ORTHOGRAPHIC) {
+	if (side_by_side || current_projection == ProjectionType::ORTHOGRAPHIC) {
 		ImGui::SliderFloat("Ortho Scale (Half height)", &ortho_scale, 0.5f, 20.0f);
         ImGui::Text("Ortho Z-bounds: [%0.1f, %0.1f]", ORTHO_NEAR, ORTHO_FAR);
 	}
@@ -671,11 +1533,124 @@ void update(double time) {
     }
 
 	ImGui::ColorEdit3("Color", reinterpret_cast<float*>(&model_color));
+
+	ImGui::Checkbox("Lighting", &lighting);
+	ImGui::SameLine();
+	ImGui::Checkbox("Height gradient", &height_gradient);
+	ImGui::Checkbox("Specialized pipelines", &specialized_pipelines);
+	if (specialized_pipelines) {
+		ImGui::SameLine();
+		ImGui::Text("%u variants ready", pipeline_variants.readyCount());
+	}
+
+	// Меш пересобирается на лету, старые буферы освобождаются, когда GPU
+	// закончит кадры с ними, без vkDeviceWaitIdle
+	if (ImGui::SliderInt("Segments", &cylinder_segments, 3, 512) && scene_ready) {
+		const Mesh old_mesh = cylinder_mesh;
+
+		cylinder_mesh = createCylinderMesh(cylinder_segments, "cylinder");
+
+		veekay::deferDestroy([old_mesh] {
+			destroyBuffer(old_mesh.index_buffer);
+			destroyBuffer(old_mesh.vertex_buffer);
+		});
+	}
+
+	ImGui::Checkbox("High detail", &high_detail);
+	if (high_detail) {
+		ImGui::SameLine();
+		ImGui::Checkbox("Cluster culling", &cluster_culling);
+		if (cluster_culling) {
+			ImGui::SameLine();
+			ImGui::Checkbox("Occlusion culling", &occlusion_culling);
+		}
+		ImGui::Text("%u meshlets, culled for first %u instances", meshlet_count, CULLED_INSTANCE_COUNT);
+	}
+
+	// Потоковая загрузка: пока нужный уровень грузится, рисуется более грубый
+	ImGui::Checkbox("Streamed LODs", &streamed_geometry);
+	if (streamed_geometry) {
+		ImGui::SliderInt("LOD", &streamed_lod, 0, STREAMED_LOD_COUNT - 1);
+
+		if (ImGui::SliderInt("Budget (KiB, 0 = driver)", &streaming_budget_kb, 0, 1024)) {
+			veekay::setStreamingBudget(VkDeviceSize(streaming_budget_kb) * 1024);
+		}
+
+		const veekay::StreamingStats stats = veekay::streamingStats();
+		ImGui::Text("Resident: %u LODs, %.1f KiB of %.1f MiB, loading %u, evicted %llu",
+		            stats.resident_lods, stats.resident_bytes / 1024.0,
+		            stats.budget_bytes / (1024.0 * 1024.0), stats.loading_lods,
+		            (unsigned long long)stats.evictions);
+	}
+	// Геометрия из gl_VertexIndex: сегменты меняются без пересборки буферов
+	ImGui::Checkbox("Procedural (no vertex buffers)", &procedural_geometry);
+	if (procedural_geometry) {
+		ImGui::SameLine();
+		ImGui::Checkbox("Vary per instance", &procedural_variation);
+	}
+	ImGui::SliderInt("Instances", &instance_count, 1, MAX_INSTANCE_COUNT);
+	ImGui::SliderInt("Moving instances", &moving_instance_count, 0, MAX_INSTANCE_COUNT);
+
+	// Загружаются только изменившиеся матрицы, остальные уже лежат на GPU
+	const veekay::InstanceBufferStats& instance_stats = instance_buffer.stats();
+	ImGui::Text("Instance upload: %u changed, %.1f of %.1f KiB",
+	            instance_stats.dirty_records, instance_stats.uploaded_bytes / 1024.0,
+	            instance_stats.full_bytes / 1024.0);
+
+	const veekay::DrawQueueStats& draw_stats = draw_queue.stats();
+	ImGui::Text("Draws: %u, binds: %u of %u (pipeline %u, vertex %u, index %u)",
+	            draw_stats.draws, draw_stats.recorded_binds, draw_stats.submitted_binds,
+	            draw_stats.pipeline_binds, draw_stats.vertex_binds, draw_stats.index_binds);
+
+	const veekay::ObjectCacheStats cache_stats = veekay::objectCacheStats();
+	ImGui::Text("State objects: %u created, %llu reused",
+	            cache_stats.created, (unsigned long long)cache_stats.reused);
+
+	const veekay::MemoryStats memory_stats = veekay::memoryStats();
+	ImGui::Text("Device memory: %.1f MiB (peak %.1f MiB)",
+	            memory_stats.bytes / (1024.0 * 1024.0), memory_stats.peak_bytes / (1024.0 * 1024.0));
+	ImGui::SameLine();
+	ImGui::Checkbox("Details", &show_memory);
+
+#ifdef VEEKAY_COUNT_ALLOCATIONS
+	ImGui::Text("Heap allocations last frame: %llu", (unsigned long long)veekay::frameHeapAllocations());
+#endif
+
+	ImGui::Separator();
+
+	// Снимок кадра и запись последовательности кадров для видео
+	if (ImGui::Button("Screenshot")) {
+		veekay::captureFrame("screenshot.png", veekay::ImageFormat::png);
+	}
+	ImGui::SameLine();
+	if (ImGui::Checkbox("Record frames", &recording_frames)) {
+		if (recording_frames) {
+			veekay::startRecording("frame_%05u.ppm", veekay::ImageFormat::ppm);
+		} else {
+			veekay::stopRecording();
+		}
+	}
+
+	// Трасса последних кадров CPU и GPU, открывается в ui.perfetto.dev
+	if (ImGui::Button("Dump trace")) {
+		veekay::dumpTrace("trace.json");
+	}
+	ImGui::SameLine();
+	if (ImGui::Checkbox("Dump on spikes (> 50 ms)", &trace_spikes)) {
+		veekay::dumpTraceOnSpike(trace_spikes ? 50.0 : 0.0, "spike_%u.json");
+	}
+
 	ImGui::End();
+}
+
+// Шаг симуляции с фиксированным delta_time, не зависит от частоты кадров
+void simulate(double delta_time) {
+	previous_position = model_position;
+	previous_rotation = model_rotation;
 
 	// ЛОГИКА АНИМАЦИИ: Обновление времени
 	if (!animation_paused) {
-		current_time += float(time) * animation_direction * animation_speed * 0.05f;
+		current_time += float(delta_time) * animation_direction * animation_speed;
 	}
 
 	float t = current_time;
@@ -684,7 +1659,7 @@ void update(double time) {
 	model_position.x = trajectory_scale * sinf(t);
 	model_position.y = trajectory_scale * sinf(t) * cosf(t);
     
-    if (current_projection == ProjectionType::ORTHOGRAPHIC) {
+    if (side_by_side || current_projection == ProjectionType::ORTHOGRAPHIC) {
         if (model_position.z < ORTHO_NEAR) model_position.z = ORTHO_NEAR + 0.1f;
         if (model_position.z > ORTHO_FAR) model_position.z = ORTHO_FAR - 0.1f;
     }
@@ -692,7 +1667,7 @@ void update(double time) {
 	// Собственное вращение (spin)
 	if (model_spin) {
 		// вращение: delta_time * revolutions_per_second * 2pi
-		model_rotation += float(time) * animation_direction * spin_speed_multiplier * 2.0f * (float)M_PI; 
+		model_rotation += float(delta_time) * animation_direction * spin_speed_multiplier * 2.0f * (float)M_PI; 
 	}
 
 	// Ограничение вращения
@@ -700,16 +1675,214 @@ void update(double time) {
     if (model_rotation < 0) model_rotation += 2.0f * (float)M_PI;
 }
 
-void render(VkCommandBuffer cmd, VkFramebuffer framebuffer) {
-	vkResetCommandBuffer(cmd, 0);
+void snapshot(uint32_t slot) {
+	snapshots[slot] = ModelSnapshot{
+		.previous_position = previous_position,
+		.position = model_position,
+		.previous_rotation = previous_rotation,
+		.rotation = model_rotation,
+	};
+}
+
+// Матрицы всех экземпляров на этот кадр: нужны и отсечению, и отрисовке
+void computeTransforms() {
+	// ПОСТРОЕНИЕ МОДЕЛЬНОЙ МАТРИЦЫ: M = R_X(Tilt) * R_Y * T 
+	// Порядок применения: Перемещение -> Вращение (вокруг Y) -> Наклон (вокруг X)
+	// Порядок умножения матриц (для V_world = M * V_model): M = Tilt * Rotation_Y * Translation
+
+	// Интерполяция между двумя последними шагами симуляции
+	const ModelSnapshot& state = snapshots[veekay::app.render_snapshot];
+	const float alpha = float(veekay::app.simulation_alpha);
+
+	Vector position{
+		state.previous_position.x + (state.position.x - state.previous_position.x) * alpha,
+		state.previous_position.y + (state.position.y - state.previous_position.y) * alpha,
+		state.previous_position.z + (state.position.z - state.previous_position.z) * alpha,
+	};
+
+	// Угол интерполируем по кратчайшей дуге, иначе на переходе через 2pi цилиндр дёрнется
+	float rotation_delta = state.rotation - state.previous_rotation;
+	if (rotation_delta > (float)M_PI) rotation_delta -= 2.0f * (float)M_PI;
+	if (rotation_delta < -(float)M_PI) rotation_delta += 2.0f * (float)M_PI;
+
+	float angle = state.previous_rotation + rotation_delta * alpha;
+
+	Matrix rotation_y = rotation({0.0f, 1.0f, 0.0f}, angle);
+	Matrix rotation_x_tilt = rotation({1.0f, 0.0f, 0.0f}, cylinder_tilt);
+
+	const float aspect_ratio = float(veekay::app.view_width) / float(veekay::app.view_height);
+
+	// В режиме двух видов левый всегда ортографический, правый перспективный
+	const ProjectionType type = side_by_side ? ProjectionType::ORTHOGRAPHIC : current_projection;
+
+	frame_projection = projection(type, camera_fov, aspect_ratio, camera_near_plane, camera_far_plane);
+
+	if (side_by_side) {
+		frame_second_projection = projection(ProjectionType::PERSPECTIVE, camera_fov, aspect_ratio,
+		                                     camera_near_plane, camera_far_plane);
+	}
+
+	// Экземпляры расставлены квадратной сеткой с центром в позиции модели
+	const int columns = (int)ceilf(sqrtf((float)instance_count));
+	const float grid_center = (columns - 1) * INSTANCE_SPACING * 0.5f;
+
+	// Неподвижные экземпляры сохраняют матрицы с прошлых кадров,
+	// пересчитываются только новые
+	const int previous_count = (int)instance_transforms.size();
+	const int moving_count = std::min(instance_count, moving_instance_count);
+
+	instance_transforms.resize(instance_count);
+
+	for (int i = 0; i < instance_count; ++i) {
+		if (i >= moving_count && i < previous_count) {
+			continue;
+		}
+
+		Vector instance_position{
+			position.x + (i % columns) * INSTANCE_SPACING - grid_center,
+			position.y + (i / columns) * INSTANCE_SPACING - grid_center,
+			position.z,
+		};
+
+		Matrix translation_matrix = translation(instance_position);
+
+		// Общая трансформация = Rotation_X_Tilt * (Rotation_Y * Translation)
+		Matrix transform_rot_y_trans = multiply(rotation_y, translation_matrix);
+		instance_transforms[i] = multiply(rotation_x_tilt, transform_rot_y_trans);
+	}
+}
+
+// Глубина центра экземпляра в [0, 1], очередь рисует спереди назад
+float instanceDepth(const Matrix& transform) {
+	const float* position = transform.m[3];
+
+	float z = 0.0f;
+	float w = 0.0f;
+
+	for (int k = 0; k < 4; ++k) {
+		z += position[k] * frame_projection.m[k][2];
+		w += position[k] * frame_projection.m[k][3];
+	}
+
+	return w > 0.0f ? z / w : 0.0f;
+}
+
+// Отсечение кластеров подробного цилиндра на GPU, до начала render pass.
+// Для каждого из первых CULLED_INSTANCE_COUNT экземпляров compute-шейдер
+// собирает свой сжатый индексный буфер и команду косвенной отрисовки
+void recordClusterCulling(VkCommandBuffer cmd, uint32_t culled_count) {
+	veekay::beginLabel(cmd, "cluster culling");
+	veekay::beginGpuZone(cmd, "cluster culling");
+
+	{ // NOTE: Previous frame may still be drawing from these buffers
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		};
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		                     1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	{ // NOTE: Reset draw commands, index count is accumulated by the shader
+		VkDrawIndexedIndirectCommand draws[CULLED_INSTANCE_COUNT];
+
+		for (uint32_t i = 0; i < CULLED_INSTANCE_COUNT; ++i) {
+			draws[i] = VkDrawIndexedIndirectCommand{
+				.indexCount = 0,
+				.instanceCount = 1,
+				.firstIndex = i * dense_cylinder_mesh.index_count,
+			};
+		}
+
+		vkCmdUpdateBuffer(cmd, draw_buffer.buffer, 0, sizeof(draws), draws);
+
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		};
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		                     1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout,
+	                        0, 1, &cull_descriptor_set, 0, nullptr);
+
+	const veekay::DepthPyramid& pyramid = veekay::depthPyramid();
+
+	for (uint32_t i = 0; i < culled_count; ++i) {
+		// NOTE: Pyramid is from the previous frame, geometry revealed since then
+		//       shows up one frame late
+		CullConstants constants{
+			.projection = frame_projection,
+			.transform = instance_transforms[i],
+			.meshlet_count = meshlet_count,
+			.draw_index = i,
+			.pyramid_size = {float(pyramid.width), float(pyramid.height)},
+			.occlusion = occlusion_culling,
+		};
+
+		vkCmdPushConstants(cmd, cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+		                   0, sizeof(CullConstants), &constants);
+
+		// NOTE: One workgroup per meshlet
+		vkCmdDispatch(cmd, meshlet_count, 1, 1);
+	}
 
-	{ // NOTE: Start recording rendering commands
-		VkCommandBufferBeginInfo info{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	{ // NOTE: Make culled indices and draw commands visible to drawing
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
 		};
 
-		vkBeginCommandBuffer(cmd, &info);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+		                     1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	veekay::endGpuZone(cmd);
+	veekay::endLabel(cmd);
+}
+
+void render(VkCommandBuffer cmd, VkFramebuffer framebuffer) {
+	// Фоновая сборка ещё идёт: только очищаем кадр
+	if (!scene_ready) {
+		scene_ready = veekay::isDone(pipeline_job) && veekay::isDone(mesh_job);
+	}
+
+	const bool draw_scene = scene_ready && pipeline;
+
+	// Отсечение кластеров работает только для подробного цилиндра
+	const bool culling = draw_scene && cluster_culling && high_detail && !streamed_geometry &&
+	                     !procedural_geometry &&
+	                     cull_pipeline && veekay::depthPyramid().view;
+
+	uint32_t culled_count = 0;
+
+	if (draw_scene) {
+		computeTransforms();
+
+		// Буфер сам сравнивает матрицы с прошлыми и отправляет только разницу
+		for (int i = 0; i < instance_count; ++i) {
+			instance_buffer.write(i, &instance_transforms[i]);
+		}
+
+		veekay::beginLabel(cmd, "instance upload");
+		veekay::beginGpuZone(cmd, "instance upload");
+		instance_buffer.upload(cmd, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		veekay::endGpuZone(cmd);
+		veekay::endLabel(cmd);
+	}
+
+	if (culling) {
+		culled_count = std::min((uint32_t)instance_count, CULLED_INSTANCE_COUNT);
+		recordClusterCulling(cmd, culled_count);
 	}
 
 	{ // NOTE: Use current swapchain framebuffer and clear it
@@ -724,8 +1897,8 @@ void render(VkCommandBuffer cmd, VkFramebuffer framebuffer) {
 			.framebuffer = framebuffer,
 			.renderArea = {
 				.extent = {
-					veekay::app.window_width,
-					veekay::app.window_height
+					veekay::app.view_width,
+					veekay::app.view_height
 				},
 			},
 			.clearValueCount = 2,
@@ -736,63 +1909,165 @@ void render(VkCommandBuffer cmd, VkFramebuffer framebuffer) {
 	}
 
 	// Обновление констант и отрисовка цилиндра
-	{
-		// NOTE: Use our new shiny graphics pipeline
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
+	if (draw_scene) {
+		// NOTE: Timestamps inside a multiview pass take a query per view,
+		//       GPU zones are only placed into ordinary passes
+		const bool gpu_zone = veekay::app.view_count == 1;
+
+		veekay::beginLabel(cmd, "cylinder");
+		if (gpu_zone) {
+			veekay::beginGpuZone(cmd, "cylinder");
+		}
 
-		// NOTE: Use our vertex buffer
-		VkDeviceSize offset = 0;
-		vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer.buffer, &offset);
+		const Mesh& mesh = high_detail ? dense_cylinder_mesh : cylinder_mesh;
 
-		// NOTE: Use our index buffer
-		vkCmdBindIndexBuffer(cmd, index_buffer.buffer, offset, VK_INDEX_TYPE_UINT32);
+		VkBuffer vertex_buffer = mesh.vertex_buffer.buffer;
+		VkBuffer index_buffer = mesh.index_buffer.buffer;
+		VkDeviceSize index_offset = 0;
+		uint32_t index_count = mesh.index_count;
 
-		// ПОСТРОЕНИЕ МОДЕЛЬНОЙ МАТРИЦЫ: M = R_X(Tilt) * R_Y * T 
-        // Порядок применения: Перемещение -> Вращение (вокруг Y) -> Наклон (вокруг X)
-        // Порядок умножения матриц (для V_world = M * V_model): M = Tilt * Rotation_Y * Translation
-		
-		Matrix translation_matrix = translation(model_position);
-		Matrix rotation_y = rotation({0.0f, 1.0f, 0.0f}, model_rotation);
-		Matrix rotation_x_tilt = rotation({1.0f, 0.0f, 0.0f}, cylinder_tilt);
-		
-		// Общая трансформация = Rotation_X_Tilt * (Rotation_Y * Translation)
-		Matrix transform_rot_y_trans = multiply(rotation_y, translation_matrix);
-		Matrix final_transform = multiply(rotation_x_tilt, transform_rot_y_trans);
+		const bool procedural = procedural_geometry && procedural_pipeline;
 
+		// Потоковый меш: вершины и индексы в одном буфере
+		veekay::StreamedMesh streamed;
+		if (!procedural && streamed_geometry &&
+		    veekay::requestMesh(streamed_cylinder, streamed_lod, streamed)) {
+			vertex_buffer = streamed.buffer;
+			index_buffer = streamed.buffer;
+			index_offset = streamed.index_offset;
+			index_count = streamed.index_count;
+		}
 
-		ShaderConstants constants{
-			.projection = projection(
-				camera_fov,
-				float(veekay::app.window_width) / float(veekay::app.window_height),
-				camera_near_plane, camera_far_plane),
+		const uint32_t features = (lighting ? SHADER_FEATURE_LIGHTING : 0) |
+		                          (height_gradient ? SHADER_FEATURE_GRADIENT : 0);
 
-		
-			.transform = final_transform,
+		VkPipeline frame_pipeline = specialized_pipelines ? pipeline_variants.get(features, pipeline) : pipeline;
+		if (procedural) {
+			frame_pipeline = procedural_pipeline;
+		}
 
-			.color = model_color,
-		};
+		const int base_segments = high_detail ? DENSE_CYLINDER_SEGMENTS : cylinder_segments;
+
+		for (int i = 0; i < instance_count; ++i) {
+			// Каждый четвёртый экземпляр повторяет форму, остальные тоньше и грубее
+			const int variation = procedural && procedural_variation ? i % 4 : 0;
+			const uint32_t segments = (uint32_t)std::max(3, base_segments >> variation);
+
+			ShaderConstants constants{
+				.projection = frame_projection,
+				.color = model_color,
+				.features = features,
+				.second_projection = frame_second_projection,
+				.radius = CYLINDER_RADIUS * (1.0f - 0.15f * variation),
+				.height = CYLINDER_HEIGHT,
+				.segments = segments,
+				.instance = (uint32_t)i,
+			};
+
+			// NOTE: Culled instances draw only visible clusters from their own index
+			//       buffer, count was written by the culling shader
+			const bool culled = (uint32_t)i < culled_count;
+
+			draw_queue.submit({
+				.pipeline = frame_pipeline,
+				.layout = pipeline_layout,
+				.descriptor_set = instance_descriptor_set,
+				.vertex_buffer = procedural ? VK_NULL_HANDLE : vertex_buffer,
+				.index_buffer = procedural ? VK_NULL_HANDLE : culled ? culled_index_buffer.buffer : index_buffer,
+				.index_offset = culled ? 0 : index_offset,
+				.index_count = index_count,
+				// NOTE: Six vertices, two triangles, per side segment
+				.vertex_count = procedural ? segments * 6 : 0,
+				.indirect_buffer = culled ? draw_buffer.buffer : VK_NULL_HANDLE,
+				.indirect_offset = culled ? i * sizeof(VkDrawIndexedIndirectCommand) : 0,
+				.push_constants = &constants,
+				.push_constants_size = sizeof(ShaderConstants),
+				.push_constant_stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				.depth = instanceDepth(instance_transforms[i]),
+			});
+		}
 
-		// NOTE: Update constant memory with new shader constants
-		vkCmdPushConstants(cmd, pipeline_layout,
-		                   VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-		                   0, sizeof(ShaderConstants), &constants);
+		{
+			veekay::TraceZone zone("flush draws");
+			draw_queue.flush(cmd);
+		}
 
-		// NOTE: Draw the cylinder using the index count
-		vkCmdDrawIndexed(cmd, index_count, 1, 0, 0, 0);
+		if (gpu_zone) {
+			veekay::endGpuZone(cmd);
+		}
+		veekay::endLabel(cmd);
 	}
 
 	vkCmdEndRenderPass(cmd);
-	vkEndCommandBuffer(cmd);
 }
 
 } // namespace
 
 int main() {
-	return veekay::run({
+	// TESTBED_HEADLESS=N: N кадров без окна, каждый пишется в frame_XXXXX.ppm
+	const char* headless_frames = std::getenv("TESTBED_HEADLESS");
+
+	golden_dir = std::getenv("TESTBED_GOLDEN");
+
+	// TESTBED_RECORD=файл: время и ввод интерфейса каждого кадра пишутся в лог.
+	// TESTBED_REPLAY=файл: тот же сеанс проигрывается без окна, кадр за кадром
+	const char* record_input = std::getenv("TESTBED_RECORD");
+	const char* replay_input = std::getenv("TESTBED_REPLAY");
+
+	// Эталоны сняты с одним видом
+	side_by_side = std::getenv("TESTBED_SIDE_BY_SIDE") && !golden_dir;
+
+	if (golden_dir) {
+		golden_update = std::getenv("TESTBED_GOLDEN_UPDATE") != nullptr;
+
+		if (!golden_update) {
+			loadGoldenTimings();
+		}
+
+		// Неподвижная сцена, чтобы кадр не зависел от скорости машины
+		animation_paused = true;
+		model_spin = false;
+	} else if (headless_frames) {
+		recording_frames = true;
+		veekay::startRecording("frame_%05u.ppm", veekay::ImageFormat::ppm);
+	}
+
+	// Страховка от зависания, если сцена так и не собралась
+	constexpr uint64_t golden_frame_limit = 10000;
+
+	uint64_t max_frames = 0;
+	if (golden_dir) {
+		max_frames = golden_frame_limit;
+	} else if (headless_frames) {
+		max_frames = std::strtoull(headless_frames, nullptr, 10);
+	}
+
+	const int result = veekay::run({
 		.init = initialize,
 		.shutdown = shutdown,
 		.update = update,
 		.render = render,
+		.simulate = simulate,
+		.snapshot = snapshot,
+		.threaded_simulation = true,
+		.headless = golden_dir || headless_frames || replay_input,
+		.max_frames = max_frames,
+		.depth_pyramid = true,
+		.record_input = record_input,
+		.replay_input = replay_input,
+		.view_count = side_by_side ? 2u : 1u,
 	});
+
+	if (golden_dir) {
+		if (golden_scene != golden_scene_count || golden_pending) {
+			std::cerr << "Golden run stopped before all scenes were checked\n";
+			golden_failed = true;
+		}
+
+		if (golden_failed) {
+			return 1;
+		}
+	}
+
+	return result;
 }